@@ -0,0 +1,184 @@
+// C++ Effects library
+// Maciej Pirog, Huawei Edinburgh Research Centre, maciej.pirog@huawei.com
+// License: MIT
+
+// Benchmark: Admission control of lightweight threads by a memory
+// budget. A spawner forks a burst of tasks (a load spike), every one of
+// which yields a number of times. The stacks of the threads are charged
+// to a budget (budgeted_stack), and so are the handler objects. Without
+// admission control, every fork creates a thread, so all the tasks are
+// alive at once. With admission control, Fork suspends the spawner
+// while the budget is exceeded, and the scheduler resumes it when
+// enough threads have finished. We report the time per task, and the
+// peak of the committed memory and of the resident set size.
+
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <iostream>
+
+#include <unistd.h>
+
+#include "cpp-effects/cpp-effects.h"
+#include "cpp-effects/growable-stack.h"
+#include "cpp-effects/memory-budget.h"
+#include "cpp-effects/resumption-queues.h"
+
+namespace eff = cpp_effects;
+
+volatile int64_t SUM = 0;
+
+// ------------------
+// Memory measurement
+// ------------------
+
+std::size_t residentBytes()
+{
+  std::ifstream statm("/proc/self/statm");
+  std::size_t size = 0, resident = 0;
+  statm >> size >> resident;
+  return resident * ::sysconf(_SC_PAGESIZE);
+}
+
+eff::memory_budget budget;
+
+eff::memory_budget& threadBudget() { return budget; }
+
+// Stacks that grow on demand up to 64KB (so that a stack is charged
+// with its reservation, which bounds the committed memory)
+
+struct SmallStack : eff::growable_stack {
+  SmallStack() : eff::growable_stack(64 * 1024) { }
+};
+
+// ---------
+// Scheduler
+// ---------
+
+struct Yield : eff::command<> { };
+
+struct Fork : eff::command<> {
+  std::function<void()> proc;
+};
+
+using Res = eff::resumption<void()>;
+
+class Scheduler : public eff::flat_handler<void, Yield, Fork> {
+public:
+  using stack_allocator = eff::budgeted_stack<SmallStack, threadBudget>;
+  static bool admission;
+
+  Scheduler() { budget.charge(sizeof(Scheduler)); }
+  ~Scheduler() { budget.release(sizeof(Scheduler)); }
+
+  static void Start(std::function<void()> f)
+  {
+    peakResident = residentBytes();
+    queue.push_back(eff::wrap<Scheduler>(f));
+    std::size_t steps = 0;
+    while (!queue.empty() || blocked) {
+      // Admit the spawner once the budget allows (or when nothing else
+      // can run, so that a too small budget does not deadlock)
+      if (blocked && (!budget.exceeded() || queue.empty())) {
+        blocked = false;
+        queue.push_back(eff::wrap<Scheduler>(std::move(pendingFork)));
+        queue.push_back(std::move(spawner));
+      }
+      queue.pop_front().resume();
+      if (++steps % 1024 == 0) { peakResident = std::max(peakResident, residentBytes()); }
+    }
+  }
+
+  static std::size_t peakResident;
+
+private:
+  static eff::resumption_queue<void()> queue;
+  static bool blocked;
+  static Res spawner;  // Suspended by backpressure
+  static std::function<void()> pendingFork;
+
+  void handle_command(Yield, Res r) override
+  {
+    queue.push_back(std::move(r));
+  }
+  void handle_command(Fork f, Res r) override
+  {
+    if (admission && budget.exceeded()) {
+      blocked = true;
+      spawner = std::move(r);
+      pendingFork = std::move(f.proc);
+      return;
+    }
+    queue.push_back(eff::wrap<Scheduler>(std::move(f.proc)));
+    std::move(r).tail_resume();
+  }
+};
+
+bool Scheduler::admission = false;
+std::size_t Scheduler::peakResident = 0;
+eff::resumption_queue<void()> Scheduler::queue;
+bool Scheduler::blocked = false;
+Res Scheduler::spawner;
+std::function<void()> Scheduler::pendingFork;
+
+// --------
+// Workload
+// --------
+
+const int STEPS = 20;  // Yields per task
+
+void task(int k)
+{
+  volatile char buffer[4096];  // Every task uses some stack
+  for (int i = 0; i < STEPS; i++) {
+    buffer[(i * 256) % sizeof(buffer)] = i;
+    SUM += k;
+    eff::invoke_command(Yield{});
+  }
+}
+
+void spike(int tasks)
+{
+  for (int k = 0; k < tasks; k++) {
+    eff::invoke_command(Fork{{}, [k](){ task(k); }});
+  }
+}
+
+// ----------
+// Measuring
+// ----------
+
+void measure(const char* name, int tasks, bool admission)
+{
+  std::cout << name << std::flush;
+  Scheduler::admission = admission;
+  budget.reset_peak();
+  std::size_t before = residentBytes();
+  auto begin = std::chrono::high_resolution_clock::now();
+  Scheduler::Start([tasks](){ spike(tasks); });
+  auto end = std::chrono::high_resolution_clock::now();
+  auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(end-begin).count();
+  std::cout << ns << "ns \t(" << ns / tasks << "ns per task, "
+            << budget.peak() / (1024 * 1024) << "MB committed, "
+            << (Scheduler::peakResident - std::min(before, Scheduler::peakResident)) / (1024 * 1024) << "MB more resident)"
+            << std::endl;
+}
+
+// ----
+// Main
+// ----
+
+int main()
+{
+  std::cout << "--- admission: spawning threads with and without a memory budget ---" << std::endl;
+
+  budget.set_limit(32 * 1024 * 1024);
+  std::cout << "budget: " << budget.limit() / (1024 * 1024) << "MB" << std::endl;
+
+  for (int tasks : {4000, 16000, 32000}) {
+    std::cout << tasks << " tasks:" << std::endl;
+    measure("  unbounded:         ", tasks, false);
+    measure("  admission control: ", tasks, true);
+  }
+}
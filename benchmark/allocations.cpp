@@ -0,0 +1,181 @@
+// C++ Effects library
+// Maciej Pirog, Huawei Edinburgh Research Centre, maciej.pirog@huawei.com
+// License: MIT
+
+// Benchmark: The hot paths that should not allocate memory (or create
+// stacks): plain clauses, static invokes via handler_ref, tail
+// resumes, and resuming a generator. The program fails if any of them
+// allocates.
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <optional>
+
+#include "cpp-effects/cpp-effects.h"
+#include "cpp-effects/clause-modifiers.h"
+#include "cpp-effects/prompts.h"
+
+#include "count-allocations.h"
+
+namespace eff = cpp_effects;
+
+volatile int64_t SUM = 0;
+
+const int64_t MAX = 1000000;
+
+struct Foo : eff::command<int> { int x; };
+
+// ---------------
+// Plain clauses
+// ---------------
+
+class PHan : public eff::handler<void, void, eff::plain<Foo>> {
+  void handle_return() override { }
+  int handle_command(Foo c) override
+  {
+    return c.x + 1;
+  }
+};
+
+// ------------
+// Tail resumes
+// ------------
+
+class Han : public eff::handler<void, void, Foo> {
+  void handle_return() override { }
+  void handle_command(Foo c, eff::resumption<void(int)> r) override
+  {
+    std::move(r).tail_resume(c.x + 1);
+  }
+};
+
+// ----------
+// Generators
+// ----------
+
+struct Yield : eff::command<> {
+  int value;
+};
+
+class Generator;
+
+class GeneratorHandler : public eff::handler<void, void, Yield> {
+public:
+  GeneratorHandler(Generator* gen) : gen(gen) { }
+private:
+  Generator* gen;
+  void handle_command(Yield y, eff::resumption<void()> r) override;
+  void handle_return() override { }
+};
+
+class Generator {
+public:
+  Generator(std::function<void(eff::handler_ref)> f)
+  {
+    eff::handle_ref<GeneratorHandler>(f, this);
+  }
+  int Value() const { return value; }
+  void Next() { std::move(resumption).resume(); }
+private:
+  friend class GeneratorHandler;
+  int value = 0;
+  eff::resumption<void()> resumption;
+};
+
+void GeneratorHandler::handle_command(Yield y, eff::resumption<void()> r)
+{
+  gen->value = y.value;
+  gen->resumption = std::move(r);
+}
+
+// -----------
+// Hot paths
+// -----------
+
+bool OK = true;
+
+// Measures the loop run inside the body of a handler (so that creating
+// the handler is not counted). Only the checked paths must not allocate.
+
+template <typename F>
+void measure(const char* name, int64_t iterations, F loop, bool checked = true)
+{
+  std::cout << name << std::flush;
+  auto begin = std::chrono::high_resolution_clock::now();
+  AllocationCount count;
+  loop();
+  int64_t allocations = count.Allocations();
+  int64_t stacks = count.Stacks();
+  auto end = std::chrono::high_resolution_clock::now();
+  std::cout << std::chrono::duration_cast<std::chrono::nanoseconds>(end-begin).count() << "ns" << " \t(" << (int)(std::chrono::duration_cast<std::chrono::nanoseconds>(end-begin).count() / iterations) << "ns per iteration" << count.PerIteration(iterations) << ")";
+  if (checked && (allocations != 0 || stacks != 0)) {
+    std::cout << " ALLOCATES";
+    OK = false;
+  }
+  std::cout << std::endl;
+}
+
+void invokeLoop()
+{
+  for (int i = 0; i < MAX; i++) { SUM += eff::invoke_command(Foo{{}, i}); }
+}
+
+// ----
+// Main
+// ----
+
+int main()
+{
+  std::cout << "--- allocations: hot paths that should not allocate ---" << std::endl;
+
+  eff::handle<PHan>([](){
+    invokeLoop();  // Warm up
+    measure("plain:                ", MAX, invokeLoop);
+    measure("static plain:         ", MAX, [](){
+      for (int i = 0; i < MAX; i++) { SUM += eff::static_invoke_command<PHan>(Foo{{}, i}); }
+    });
+  });
+
+  eff::handle_ref<PHan>([](eff::handler_ref it){
+    measure("handler_ref plain:    ", MAX, [it](){
+      for (int i = 0; i < MAX; i++) { SUM += eff::static_invoke_command<PHan>(it, Foo{{}, i}); }
+    });
+  });
+
+  eff::handle<Han>([](){
+    invokeLoop();  // Warm up
+    measure("tail resume:          ", MAX, invokeLoop);
+  });
+
+  eff::handle_ref<Han>([](eff::handler_ref it){
+    measure("handler_ref tail:     ", MAX, [it](){
+      for (int i = 0; i < MAX; i++) { SUM += eff::static_invoke_command<Han>(it, Foo{{}, i}); }
+    });
+  });
+
+  Generator naturals([](eff::handler_ref it){
+    for (int i = 0; true; i++) { eff::static_invoke_command<GeneratorHandler>(it, Yield{{}, i}); }
+  });
+  naturals.Next();  // Warm up
+  measure("generator Next:       ", MAX, [&](){
+    for (int i = 0; i < MAX; i++) {
+      SUM += naturals.Value();
+      naturals.Next();
+    }
+  });
+
+  // Not a hot path, to check that the counting works
+  measure("handle (unchecked):   ", 1000, [](){
+    for (int i = 0; i < 1000; i++) { eff::handle<PHan>([i](){ SUM += eff::invoke_command(Foo{{}, i}); }); }
+  }, false);
+  measure("prompt (unchecked):   ", 1000, [](){
+    for (int i = 0; i < 1000; i++) { SUM += eff::push_prompt(eff::new_prompt<int>(), [i](){ return i; }); }
+  }, false);
+
+  if (!OK) {
+    std::cout << "a hot path allocates" << std::endl;
+    return 1;
+  }
+}
@@ -0,0 +1,457 @@
+// C++ Effects library
+// Maciej Pirog, Huawei Edinburgh Research Centre, maciej.pirog@huawei.com
+// License: MIT
+
+// Benchmark: Async generators. A parser reads records from a socket
+// and yields them to the consumer, awaiting I/O between the yields.
+// The generator is handled on top of the consumer, so a command to the
+// scheduler (sleep, await fd, await future) invoked by the body of the
+// generator suspends the consumer (waiting in Next) together with the
+// generator. We compare with a hand-written parser with a callback,
+// and with a parser thread that sends records to the consumer thread
+// via a channel.
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "cpp-effects/cpp-effects.h"
+#include "cpp-effects/clause-modifiers.h"
+#include "cpp-effects/resumption-queues.h"
+
+namespace eff = cpp_effects;
+
+using Res = eff::resumption<void()>;
+
+// ----------------------------------------
+// Effect interface for lightweight threads
+// ----------------------------------------
+
+struct Yield : eff::command<> { };
+
+struct Fork : eff::command<> {
+  std::function<void()> proc;
+};
+
+struct Sleep : eff::command<> {
+  int64_t ns;
+};
+
+struct AwaitFd : eff::command<> {
+  int fd;
+  short events;
+};
+
+// Park the thread in a queue, until someone wakes it up
+
+struct Wait : eff::command<> {
+  eff::resumption_queue<void()>* queue;
+};
+
+void yield()
+{
+  eff::invoke_command(Yield{});
+}
+
+void spawn(std::function<void()> proc)
+{
+  eff::invoke_command(Fork{{}, proc});
+}
+
+void sleepFor(int64_t ns)
+{
+  eff::invoke_command(Sleep{{}, ns});
+}
+
+void awaitFd(int fd, short events)
+{
+  eff::invoke_command(AwaitFd{{}, fd, events});
+}
+
+int64_t now()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// --------------------------
+// Scheduler with an I/O loop
+// --------------------------
+
+// Ready threads run in the round-robin fashion. When there are no
+// ready threads, the scheduler blocks in poll until a file descriptor
+// is ready or the nearest timer expires.
+
+class Scheduler : public eff::flat_handler<void, Yield, Fork, Sleep, AwaitFd, Wait> {
+public:
+  static void Start(std::function<void()> f)
+  {
+    ready.push_back(eff::wrap<Scheduler>(f));
+    while (!ready.empty() || !timers.empty() || !fds.empty()) {
+      for (std::size_t n = ready.size(); n > 0; n--) { ready.pop_front().resume(); }
+      if (!fds.empty() || (ready.empty() && !timers.empty())) { poll(); }
+      while (!timers.empty() && timers.top_key() <= now()) { ready.push_back(timers.pop()); }
+    }
+  }
+  static void WakeAll(eff::resumption_queue<void()>& queue)
+  {
+    while (!queue.empty()) { ready.push_back(queue.pop_front()); }
+  }
+private:
+  static eff::resumption_queue<void()> ready;
+  static eff::resumption_heap<void()> timers;
+  static std::vector<pollfd> fds;
+  static std::vector<Res> awaiting;  // awaiting[i] waits for fds[i]
+
+  static void poll()
+  {
+    int timeout = -1;
+    if (!ready.empty()) {
+      timeout = 0;
+    } else if (!timers.empty()) {
+      timeout = (int)std::max<int64_t>(0, (timers.top_key() - now() + 999999) / 1000000);
+    }
+    if (::poll(fds.data(), fds.size(), timeout) <= 0) { return; }
+    for (std::size_t i = 0; i < fds.size(); ) {
+      if (fds[i].revents != 0) {
+        ready.push_back(std::move(awaiting[i]));
+        fds[i] = fds.back();
+        fds.pop_back();
+        awaiting[i] = std::move(awaiting.back());
+        awaiting.pop_back();
+      } else {
+        i++;
+      }
+    }
+  }
+  void handle_command(Yield, Res r) override
+  {
+    ready.push_back(std::move(r));
+  }
+  void handle_command(Fork f, Res r) override
+  {
+    ready.push_back(std::move(r));
+    ready.push_back(eff::wrap<Scheduler>(f.proc));
+  }
+  void handle_command(Sleep s, Res r) override
+  {
+    timers.push(std::move(r), now() + s.ns);
+  }
+  void handle_command(AwaitFd a, Res r) override
+  {
+    fds.push_back(pollfd{a.fd, a.events, 0});
+    awaiting.push_back(std::move(r));
+  }
+  void handle_command(Wait w, Res r) override
+  {
+    w.queue->push_back(std::move(r));
+  }
+};
+
+eff::resumption_queue<void()> Scheduler::ready;
+eff::resumption_heap<void()> Scheduler::timers;
+std::vector<pollfd> Scheduler::fds;
+std::vector<Res> Scheduler::awaiting;
+
+// Futures
+
+template <typename T>
+class Future {
+public:
+  void Set(T v)
+  {
+    value = std::move(v);
+    Scheduler::WakeAll(waiting);
+  }
+  const T& Get()
+  {
+    while (!value) { eff::invoke_command(Wait{{}, &waiting}); }
+    return *value;
+  }
+private:
+  std::optional<T> value;
+  eff::resumption_queue<void()> waiting;
+};
+
+// ----------------
+// Async generators
+// ----------------
+
+// An async_generator: the body is started by the first call to Next
+// (so that it runs on top of the thread of the consumer), and then
+// every call to Next resumes the body until the next yield. There are
+// no fibers other than the one of the body, and no additional
+// switches: if the body awaits something, the whole thread is
+// suspended by the scheduler and later resumed by it.
+
+template <typename T>
+class AsyncGenerator;
+
+template <typename T>
+struct GenYield : eff::command<> {
+  T value;
+};
+
+// The clause only stores the resumption, so it does not need to keep
+// the handler alive (see no_manage)
+
+template <typename T>
+class AsyncGeneratorHandler : public eff::flat_handler<void, eff::no_manage<GenYield<T>>> {
+public:
+  AsyncGeneratorHandler(AsyncGenerator<T>* gen) : gen(gen) { }
+private:
+  AsyncGenerator<T>* gen;
+  void handle_command(GenYield<T> y, Res r) final override
+  {
+    gen->value = std::move(y.value);
+    gen->resumption = std::move(r);
+  }
+};
+
+template <typename T>
+struct AsyncYield {
+  eff::handler_ref it;
+  void operator()(T x) const
+  {
+    eff::static_invoke_command<AsyncGeneratorHandler<T>>(it, GenYield<T>{{}, std::move(x)});
+  }
+};
+
+template <typename T>
+class AsyncGenerator {
+  friend class AsyncGeneratorHandler<T>;
+public:
+  AsyncGenerator(std::function<void(AsyncYield<T>)> body) : body(std::move(body)) { }
+  AsyncGenerator(const AsyncGenerator&) = delete;
+  AsyncGenerator& operator=(const AsyncGenerator&) = delete;
+  bool Next()
+  {
+    value = {};
+    if (!started) {
+      started = true;
+      eff::handle_ref<AsyncGeneratorHandler<T>>([this](eff::handler_ref it) {
+        body(AsyncYield<T>{it});
+      }, this);
+    } else if (!done) {
+      std::move(resumption).resume();
+    }
+    done = !value;
+    return !done;
+  }
+  const T& Value() const { return *value; }
+private:
+  std::function<void(AsyncYield<T>)> body;
+  bool started = false;
+  bool done = false;
+  std::optional<T> value;
+  Res resumption;
+};
+
+// ---------------------------------
+// Channel (for the threaded parser)
+// ---------------------------------
+
+template <typename T>
+class Channel {
+public:
+  void Send(T x)
+  {
+    while (slot) { eff::invoke_command(Wait{{}, &senders}); }
+    slot = std::move(x);
+    Scheduler::WakeAll(receivers);
+  }
+  void Close()
+  {
+    closed = true;
+    Scheduler::WakeAll(receivers);
+  }
+  std::optional<T> Receive()
+  {
+    while (!slot && !closed) { eff::invoke_command(Wait{{}, &receivers}); }
+    std::optional<T> x = std::move(slot);
+    slot = {};
+    Scheduler::WakeAll(senders);
+    return x;
+  }
+private:
+  std::optional<T> slot;
+  bool closed = false;
+  eff::resumption_queue<void()> senders;
+  eff::resumption_queue<void()> receivers;
+};
+
+// ---------------------
+// Socket and the parser
+// ---------------------
+
+// The records are decimal numbers, one per line
+
+const std::size_t BUFFER = 16 * 1024;
+
+void writeAll(int fd, const std::string& data)
+{
+  std::size_t pos = 0;
+  while (pos < data.size()) {
+    ssize_t n = ::write(fd, data.data() + pos, std::min(BUFFER, data.size() - pos));
+    if (n > 0) {
+      pos += n;
+    } else if (n < 0 && errno == EAGAIN) {
+      awaitFd(fd, POLLOUT);
+    } else {
+      break;
+    }
+  }
+  ::close(fd);
+}
+
+// Read the socket until the end, and call emit for every record.
+// When there is nothing to read, await the socket.
+
+template <typename F>
+void parse(int fd, F emit)
+{
+  char buffer[BUFFER];
+  int64_t record = 0;
+  while (true) {
+    ssize_t n = ::read(fd, buffer, BUFFER);
+    if (n < 0 && errno == EAGAIN) {
+      awaitFd(fd, POLLIN);
+      continue;
+    }
+    if (n <= 0) { break; }
+    for (ssize_t i = 0; i < n; i++) {
+      char c = buffer[i];
+      if (c == '\n') {
+        emit(record);
+        record = 0;
+      } else {
+        record = record * 10 + (c - '0');
+      }
+    }
+  }
+  ::close(fd);
+}
+
+// Records and a socket pair with the records written by a thread
+
+std::string makeRecords(int64_t count)
+{
+  std::string data;
+  uint64_t x = 88172645463325252ull;
+  for (int64_t i = 0; i < count; i++) {
+    x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+    data += std::to_string(x % 1000000);
+    data += '\n';
+  }
+  return data;
+}
+
+int openPipeline(const std::string& data)
+{
+  int sv[2];
+  if (::socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0) { std::perror("socketpair"); std::exit(1); }
+  for (int fd : sv) { ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK); }
+  spawn([fd = sv[1], &data](){ writeAll(fd, data); });
+  return sv[0];
+}
+
+// ---------
+// Pipelines
+// ---------
+
+int64_t callbackPipeline(const std::string& data)
+{
+  int64_t sum = 0;
+  Scheduler::Start([&](){
+    int fd = openPipeline(data);
+    parse(fd, [&](int64_t record) { sum += record; });
+  });
+  return sum;
+}
+
+int64_t generatorPipeline(const std::string& data)
+{
+  int64_t sum = 0;
+  Scheduler::Start([&](){
+    int fd = openPipeline(data);
+    AsyncGenerator<int64_t> records([fd](auto yield) {
+      parse(fd, [&](int64_t record) { yield(record); });
+    });
+    while (records.Next()) { sum += records.Value(); }
+  });
+  return sum;
+}
+
+int64_t channelPipeline(const std::string& data)
+{
+  int64_t sum = 0;
+  Scheduler::Start([&](){
+    int fd = openPipeline(data);
+    Channel<int64_t> records;
+    spawn([fd, &records](){
+      parse(fd, [&](int64_t record) { records.Send(record); });
+      records.Close();
+    });
+    while (auto record = records.Receive()) { sum += *record; }
+  });
+  return sum;
+}
+
+// ---------
+// Measuring
+// ---------
+
+template <typename F>
+void measure(const char* name, int64_t iterations, F f)
+{
+  std::cout << name << std::flush;
+  auto begin = std::chrono::high_resolution_clock::now();
+  int64_t sum = f();
+  auto end = std::chrono::high_resolution_clock::now();
+  std::cout << std::chrono::duration_cast<std::chrono::nanoseconds>(end-begin).count() << "ns" << " \t(" << (int)(std::chrono::duration_cast<std::chrono::nanoseconds>(end-begin).count() / iterations) << "ns per iteration, sum " << sum << ")" << std::endl;
+}
+
+// ----
+// Main
+// ----
+
+int main()
+{
+  std::cout << "--- async-generator: socket to parser pipeline ---" << std::endl;
+
+  // A generator that sleeps and awaits a future between the yields
+
+  std::cout << "ticks:" << std::flush;
+  Scheduler::Start([](){
+    Future<int> start;
+    spawn([&](){ sleepFor(1000000); start.Set(10); });
+    AsyncGenerator<int> ticks([&](auto yield) {
+      int first = start.Get();
+      for (int i = 0; i < 5; i++) {
+        sleepFor(100000);
+        yield(first + i);
+      }
+    });
+    while (ticks.Next()) { std::cout << " " << ticks.Value(); }
+    std::cout << std::endl;
+  });
+
+  const int64_t RECORDS = 2000000;
+  std::string data = makeRecords(RECORDS);
+
+  measure("callback:        ", RECORDS, [&](){ return callbackPipeline(data); });
+  measure("async generator: ", RECORDS, [&](){ return generatorPipeline(data); });
+  measure("channel:         ", RECORDS, [&](){ return channelPipeline(data); });
+}
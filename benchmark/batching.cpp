@@ -0,0 +1,154 @@
+// C++ Effects library
+// Maciej Pirog, Huawei Edinburgh Research Centre, maciej.pirog@huawei.com
+// License: MIT
+
+// Benchmark: Dynamic batching across lightweight threads. Threads
+// invoke a command that hashes a single value. The scheduler parks the
+// resumptions of the threads that invoke it, and when the batch is
+// full, the oldest parked thread has waited longer than the latency
+// bound, or there are no other threads ready to run, it runs a single
+// (vectorised) kernel over all the parked inputs, stores the results,
+// and puts the threads back in the queue of ready threads. We measure
+// the throughput and the time that batches wait, for different batch
+// sizes and latency bounds, and compare with hashing every value when
+// it is needed.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+#include "cpp-effects/cpp-effects.h"
+#include "cpp-effects/batching.h"
+
+namespace eff = cpp_effects;
+
+int64_t now()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// ------
+// Kernel
+// ------
+
+// A few rounds of multiply-xorshift over every input. Every round is a
+// loop over the inputs with no dependencies between iterations, so the
+// compiler vectorises it.
+
+const int ROUNDS = 32;
+
+void kernel(const uint32_t* in, uint32_t* out, std::size_t n)
+{
+  for (std::size_t i = 0; i < n; i++) { out[i] = in[i]; }
+  for (int r = 0; r < ROUNDS; r++) {
+    for (std::size_t i = 0; i < n; i++) {
+      uint32_t x = out[i];
+      x ^= x >> 16;
+      x *= 0x7feb352d;
+      x ^= x >> 15;
+      x *= 0x846ca68b;
+      out[i] = x;
+    }
+  }
+}
+
+using Loop = eff::batch_loop<uint32_t, uint32_t>;
+
+// --------
+// Workload
+// --------
+
+// Every thread does some work of varying length between the hashes
+
+const int THREADS = 256;
+const int HASHES = 2000;  // Per thread
+
+uint32_t work(uint32_t seed)
+{
+  uint32_t x = seed;
+  for (uint32_t i = seed % 64; i > 0; i--) { x = x * 33 + i; }
+  return x;
+}
+
+template <typename H>
+uint32_t thread(int id, H h)
+{
+  uint32_t sum = 0;
+  for (int i = 0; i < HASHES; i++) {
+    uint32_t x = work(id * HASHES + i);
+    sum += h(x);
+  }
+  return sum;
+}
+
+// ----------
+// Measuring
+// ----------
+
+std::vector<int64_t> waits;  // Of every batch
+
+// Returns false if the sum is wrong
+
+bool report(int64_t ns, uint32_t sum, uint32_t expected)
+{
+  std::cout << ns / (THREADS * HASHES) << "ns per hash";
+  if (!waits.empty()) {
+    auto& w = waits;
+    std::sort(w.begin(), w.end());
+    int64_t total = 0;
+    for (auto x : w) { total += x; }
+    std::cout << ", " << THREADS * HASHES / w.size() << " per batch, batch wait avg: "
+              << total / (int64_t)w.size() << "ns, p99: " << w[w.size() * 99 / 100] << "ns";
+  }
+  std::cout << (sum == expected ? "" : " WRONG") << std::endl;
+  return sum == expected;
+}
+
+bool batched(std::size_t maxBatch, int64_t maxLatency, uint32_t expected)
+{
+  Loop loop(kernel, maxBatch, std::chrono::nanoseconds(maxLatency));
+  waits.clear();
+  loop.on_batch = [](std::size_t, std::chrono::nanoseconds wait) { waits.push_back(wait.count()); };
+  uint32_t sum = 0;
+  for (int i = 0; i < THREADS; i++) {
+    loop.spawn([i, &sum](){ sum += thread(i, Loop::call); });
+  }
+  auto begin = now();
+  loop.run();
+  return report(now() - begin, sum, expected);
+}
+
+// ----
+// Main
+// ----
+
+int main()
+{
+  std::cout << "--- batching: hashing in batches across lightweight threads ---" << std::endl;
+  std::cout << THREADS << " threads, " << HASHES << " hashes each:" << std::endl;
+
+  std::cout << "  one at a time, no threads:   " << std::flush;
+  bool ok = true;
+  uint32_t expected = 0;
+  auto begin = now();
+  for (int i = 0; i < THREADS; i++) {
+    expected += thread(i, [](uint32_t x) { uint32_t y; kernel(&x, &y, 1); return y; });
+  }
+  waits.clear();
+  report(now() - begin, expected, expected);
+
+  for (std::size_t size : {1, 8, 64, 256}) {
+    std::cout << "  batch " << size << ":" << std::string(22 - std::to_string(size).size(), ' ') << std::flush;
+    ok = batched(size, 0, expected) && ok;
+  }
+  std::cout << "  batch 1024 (flush on idle):  " << std::flush;
+  ok = batched(1024, 0, expected) && ok;
+  for (int64_t latency : {1000, 5000}) {
+    std::cout << "  batch 256, bound " << latency / 1000 << "us:        " << std::flush;
+    ok = batched(256, latency, expected) && ok;
+  }
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,114 @@
+// C++ Effects library
+// Maciej Pirog, Huawei Edinburgh Research Centre, maciej.pirog@huawei.com
+// License: MIT
+
+// Counting allocations in benchmarks. This file replaces the global
+// operator new and delete, so it should be included in exactly one
+// translation unit of the program (every benchmark is a single file).
+// The allocations are counted per thread. Stacks of fibers are not
+// allocated with operator new, so they are counted separately (by the
+// library, see allocated_stacks).
+
+#ifndef CPP_EFFECTS_BENCHMARK_COUNT_ALLOCATIONS_H
+#define CPP_EFFECTS_BENCHMARK_COUNT_ALLOCATIONS_H
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+#include "cpp-effects/cpp-effects.h"
+
+thread_local int64_t ALLOCATIONS = 0;
+
+// All the forms of operator new go through countedAlloc (the array
+// forms and the nothrow forms are replaced too, as their default
+// versions do not necessarily call the replaced operator new), and all
+// the forms of operator delete go through std::free
+
+inline void* countedAlloc(std::size_t size, std::size_t alignment = 0)
+{
+  ALLOCATIONS++;
+  if (size == 0) { size = 1; }
+  void* p;
+  if (alignment > __STDCPP_DEFAULT_NEW_ALIGNMENT__) {
+    // The size of aligned_alloc has to be a multiple of the alignment
+    p = std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+  } else {
+    p = std::malloc(size);
+  }
+  if (p) { return p; }
+  throw std::bad_alloc();
+}
+
+inline void* countedAllocNoThrow(std::size_t size, std::size_t alignment = 0) noexcept
+{
+  try {
+    return countedAlloc(size, alignment);
+  } catch (const std::bad_alloc&) {
+    return nullptr;
+  }
+}
+
+void* operator new(std::size_t size) { return countedAlloc(size); }
+void* operator new[](std::size_t size) { return countedAlloc(size); }
+void* operator new(std::size_t size, std::align_val_t al) { return countedAlloc(size, (std::size_t)al); }
+void* operator new[](std::size_t size, std::align_val_t al) { return countedAlloc(size, (std::size_t)al); }
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+  return countedAllocNoThrow(size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept
+{
+  return countedAllocNoThrow(size);
+}
+
+void* operator new(std::size_t size, std::align_val_t al, const std::nothrow_t&) noexcept
+{
+  return countedAllocNoThrow(size, (std::size_t)al);
+}
+
+void* operator new[](std::size_t size, std::align_val_t al, const std::nothrow_t&) noexcept
+{
+  return countedAllocNoThrow(size, (std::size_t)al);
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { std::free(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { std::free(p); }
+void operator delete(void* p, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void* p, std::align_val_t, const std::nothrow_t&) noexcept { std::free(p); }
+void operator delete[](void* p, std::align_val_t, const std::nothrow_t&) noexcept { std::free(p); }
+
+// The allocations and stacks from the creation of the object
+
+class AllocationCount {
+public:
+  AllocationCount() : allocations(ALLOCATIONS), stacks(cpp_effects::allocated_stacks()) { }
+  int64_t Allocations() const { return ALLOCATIONS - allocations; }
+  int64_t Stacks() const { return cpp_effects::allocated_stacks() - stacks; }
+
+  // E.g., ", 0.00 allocations, 0.00 stacks per iteration" (formatted
+  // in a buffer, so that printing does not allocate)
+  const char* PerIteration(int64_t iterations, const char* unit = "iteration")
+  {
+    double a = (double)Allocations() / iterations;
+    double s = (double)Stacks() / iterations;
+    std::snprintf(buffer, sizeof(buffer), ", %.2f allocations, %.2f stacks per %s", a, s, unit);
+    return buffer;
+  }
+private:
+  int64_t allocations;
+  int64_t stacks;
+  char buffer[96];
+};
+
+#endif // CPP_EFFECTS_BENCHMARK_COUNT_ALLOCATIONS_H
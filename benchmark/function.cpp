@@ -11,6 +11,8 @@
 #include "cpp-effects/cpp-effects.h"
 #include "cpp-effects/clause-modifiers.h"
 
+#include "count-allocations.h"
+
 namespace eff = cpp_effects;
 
 volatile int a = 19;
@@ -215,24 +217,27 @@ std::cout << "--- plain handler ---" << std::endl;
 
 std::cout << "loop:             " << std::flush;
 
+AllocationCount countloop;
 auto beginloop = std::chrono::high_resolution_clock::now();
 testLoop(MAX);
 auto endloop = std::chrono::high_resolution_clock::now();
-std::cout << std::chrono::duration_cast<std::chrono::nanoseconds>(endloop-beginloop).count() << "ns" << " \t(" << (int)(std::chrono::duration_cast<std::chrono::nanoseconds>(endloop-beginloop).count() / MAX) << "ns per iteration)" <<std::endl;
+std::cout << std::chrono::duration_cast<std::chrono::nanoseconds>(endloop-beginloop).count() << "ns" << " \t(" << (int)(std::chrono::duration_cast<std::chrono::nanoseconds>(endloop-beginloop).count() / MAX) << "ns per iteration" << countloop.PerIteration(MAX) << ")" <<std::endl;
 
 std::cout << "native:           " << std::flush;
 
+AllocationCount count;
 auto begin = std::chrono::high_resolution_clock::now();
 testNative(MAX);
 auto end = std::chrono::high_resolution_clock::now();
-std::cout << std::chrono::duration_cast<std::chrono::nanoseconds>(end-begin).count() << "ns" << " \t(" << (int)(std::chrono::duration_cast<std::chrono::nanoseconds>(end-begin).count() / MAX) << "ns per iteration)" <<std::endl;
+std::cout << std::chrono::duration_cast<std::chrono::nanoseconds>(end-begin).count() << "ns" << " \t(" << (int)(std::chrono::duration_cast<std::chrono::nanoseconds>(end-begin).count() / MAX) << "ns per iteration" << count.PerIteration(MAX) << ")" <<std::endl;
 
 std::cout << "native-inline:    " << std::flush;
 
+AllocationCount counti;
 auto begini = std::chrono::high_resolution_clock::now();
 testInline(MAX);
 auto endi = std::chrono::high_resolution_clock::now();
-std::cout << std::chrono::duration_cast<std::chrono::nanoseconds>(endi-begini).count() << "ns" << " \t(" << (int)(std::chrono::duration_cast<std::chrono::nanoseconds>(endi-begini).count() / MAX) << "ns per iteration)" <<std::endl;
+std::cout << std::chrono::duration_cast<std::chrono::nanoseconds>(endi-begini).count() << "ns" << " \t(" << (int)(std::chrono::duration_cast<std::chrono::nanoseconds>(endi-begini).count() / MAX) << "ns per iteration" << counti.PerIteration(MAX) << ")" <<std::endl;
 
 std::cout << "lambda:           " << std::flush;
 
@@ -240,10 +245,11 @@ std::cout << "lambda:           " << std::flush;
 std::function<int(int)> lamX = [](int x){ return x; };
 if (argc == 7) { lamFoo = lamX; }
 
+AllocationCount countl;
 auto beginl = std::chrono::high_resolution_clock::now();
 testLambda(MAX);
 auto endl = std::chrono::high_resolution_clock::now();
-std::cout << std::chrono::duration_cast<std::chrono::nanoseconds>(endl-beginl).count() << "ns" << " \t(" << (int)(std::chrono::duration_cast<std::chrono::nanoseconds>(endl-beginl).count() / MAX) << "ns per iteration)" << std::endl;
+std::cout << std::chrono::duration_cast<std::chrono::nanoseconds>(endl-beginl).count() << "ns" << " \t(" << (int)(std::chrono::duration_cast<std::chrono::nanoseconds>(endl-beginl).count() / MAX) << "ns per iteration" << countl.PerIteration(MAX) << ")" << std::endl;
 
 std::cout << "dynamic_cast:     " << std::flush;
 
@@ -253,43 +259,49 @@ if (argc % 123 == 7) {
   dCastPtr = new Derived();
 }
 
+AllocationCount countdc;
 auto begindc = std::chrono::high_resolution_clock::now();
 testDCast(MAX);
 auto enddc = std::chrono::high_resolution_clock::now();
-std::cout << std::chrono::duration_cast<std::chrono::nanoseconds>(enddc-begindc).count() << "ns" << " \t(" << (int)(std::chrono::duration_cast<std::chrono::nanoseconds>(enddc-begindc).count() / MAX) << "ns per iteration)" << std::endl;
+std::cout << std::chrono::duration_cast<std::chrono::nanoseconds>(enddc-begindc).count() << "ns" << " \t(" << (int)(std::chrono::duration_cast<std::chrono::nanoseconds>(enddc-begindc).count() / MAX) << "ns per iteration" << countdc.PerIteration(MAX) << ")" << std::endl;
 
 std::cout << "handlers:         " << std::flush;
 
+AllocationCount count2;
 auto begin2 = std::chrono::high_resolution_clock::now();
 testHandlers(MAX);
 auto end2 = std::chrono::high_resolution_clock::now();
-std::cout << std::chrono::duration_cast<std::chrono::nanoseconds>(end2-begin2).count() << "ns" << " \t(" << (int)(std::chrono::duration_cast<std::chrono::nanoseconds>(end2-begin2).count() / MAX) << "ns per iteration)" <<std::endl;
+std::cout << std::chrono::duration_cast<std::chrono::nanoseconds>(end2-begin2).count() << "ns" << " \t(" << (int)(std::chrono::duration_cast<std::chrono::nanoseconds>(end2-begin2).count() / MAX) << "ns per iteration" << count2.PerIteration(MAX) << ")" <<std::endl;
 
 std::cout << "plain-handlers:   " << std::flush;
 
+AllocationCount count3;
 auto begin3 = std::chrono::high_resolution_clock::now();
 testPlainHandlers(MAX);
 auto end3 = std::chrono::high_resolution_clock::now();
-std::cout << std::chrono::duration_cast<std::chrono::nanoseconds>(end3-begin3).count() << "ns" << " \t(" << (int)(std::chrono::duration_cast<std::chrono::nanoseconds>(end3-begin3).count() / MAX) << "ns per iteration)" <<std::endl;
+std::cout << std::chrono::duration_cast<std::chrono::nanoseconds>(end3-begin3).count() << "ns" << " \t(" << (int)(std::chrono::duration_cast<std::chrono::nanoseconds>(end3-begin3).count() / MAX) << "ns per iteration" << count3.PerIteration(MAX) << ")" <<std::endl;
 
 std::cout << "s-handlers:       " << std::flush;
 
+AllocationCount counts2;
 auto begins2 = std::chrono::high_resolution_clock::now();
 testStaticHandlers(MAX);
 auto ends2 = std::chrono::high_resolution_clock::now();
-std::cout << std::chrono::duration_cast<std::chrono::nanoseconds>(ends2-begins2).count() << "ns" << " \t(" << (int)(std::chrono::duration_cast<std::chrono::nanoseconds>(ends2-begins2).count() / MAX) << "ns per iteration)" << std::endl;
+std::cout << std::chrono::duration_cast<std::chrono::nanoseconds>(ends2-begins2).count() << "ns" << " \t(" << (int)(std::chrono::duration_cast<std::chrono::nanoseconds>(ends2-begins2).count() / MAX) << "ns per iteration" << counts2.PerIteration(MAX) << ")" << std::endl;
 
 std::cout << "s-plain-handlers: " << std::flush;
 
+AllocationCount counts3;
 auto begins3 = std::chrono::high_resolution_clock::now();
 testStaticPlainHandlers(MAX);
 auto ends3 = std::chrono::high_resolution_clock::now();
-std::cout << std::chrono::duration_cast<std::chrono::nanoseconds>(ends3-begins3).count() << "ns" << " \t(" << (int)(std::chrono::duration_cast<std::chrono::nanoseconds>(ends3-begins3).count() / MAX) << "ns per iteration)" << std::endl;
+std::cout << std::chrono::duration_cast<std::chrono::nanoseconds>(ends3-begins3).count() << "ns" << " \t(" << (int)(std::chrono::duration_cast<std::chrono::nanoseconds>(ends3-begins3).count() / MAX) << "ns per iteration" << counts3.PerIteration(MAX) << ")" << std::endl;
 
 std::cout << "known-handlers:   " << std::flush;
 
+AllocationCount countks3;
 auto beginks3 = std::chrono::high_resolution_clock::now();
 testKnownPlainHandlers(MAX);
 auto endks3 = std::chrono::high_resolution_clock::now();
-std::cout << std::chrono::duration_cast<std::chrono::nanoseconds>(endks3-beginks3).count() << "ns" << " \t(" << (int)(std::chrono::duration_cast<std::chrono::nanoseconds>(endks3-beginks3).count() / MAX) << "ns per iteration)" << std::endl;
+std::cout << std::chrono::duration_cast<std::chrono::nanoseconds>(endks3-beginks3).count() << "ns" << " \t(" << (int)(std::chrono::duration_cast<std::chrono::nanoseconds>(endks3-beginks3).count() / MAX) << "ns per iteration" << countks3.PerIteration(MAX) << ")" << std::endl;
 }
@@ -12,6 +12,8 @@
 #include "cpp-effects/cpp-effects.h"
 #include "cpp-effects/clause-modifiers.h"
 
+#include "count-allocations.h"
+
 namespace eff = cpp_effects;
 
 namespace DynamicGenerator {
@@ -606,9 +608,9 @@ class Generator {
 public:
   Generator(std::function<void(Yield<T>)> f)
   {
-    auto label = eff::fresh_label();
-    eff::handle<GeneratorHandler<T>>(label, [&](){
-      auto it = eff::find_handler(label);
+    // The reference to the handler stays valid when the generator is
+    // suspended and resumed, so it is obtained only once
+    eff::handle_ref<GeneratorHandler<T>>([f](auto it){
       f(Yield<T>{it});
     }, this);
   }
@@ -718,9 +720,9 @@ class Generator {
 public:
   Generator(std::function<void(Yield<T>)> f)
   {
-    auto label = eff::fresh_label();
-    eff::handle<GeneratorHandler<T>>(label, [&](){
-      auto it = eff::find_handler(label);
+    // The reference to the handler stays valid when the generator is
+    // suspended and resumed, so it is obtained only once
+    eff::handle_ref<GeneratorHandler<T>>([f](auto it){
       f(Yield<T>{it});
     }, this);
   }
@@ -780,6 +782,7 @@ int main()
 
   std::cout << "loop:          " << std::flush;
 
+  AllocationCount count;
   auto begin = std::chrono::high_resolution_clock::now();
 
   for (int i = 0; i <= MAX; i++) {
@@ -787,7 +790,7 @@ int main()
   }
 
   auto end = std::chrono::high_resolution_clock::now();
-  std::cout << std::chrono::duration_cast<std::chrono::nanoseconds>(end-begin).count() << "ns" << " \t(" << (int)(std::chrono::duration_cast<std::chrono::nanoseconds>(end-begin).count() / MAX) << "ns per iteration)" <<std::endl;
+  std::cout << std::chrono::duration_cast<std::chrono::nanoseconds>(end-begin).count() << "ns" << " \t(" << (int)(std::chrono::duration_cast<std::chrono::nanoseconds>(end-begin).count() / MAX) << "ns per iteration" << count.PerIteration(MAX) << ")" <<std::endl;
 
   }
 
@@ -802,6 +805,7 @@ int main()
     while (true) { yield(i++); }
   });
 
+  AllocationCount count;
   auto begin = std::chrono::high_resolution_clock::now();
 
   for (int i = 0; i <= MAX; i++) {
@@ -810,7 +814,7 @@ int main()
   }
 
   auto end = std::chrono::high_resolution_clock::now();
-  std::cout << std::chrono::duration_cast<std::chrono::nanoseconds>(end-begin).count() << "ns" << " \t(" << (int)(std::chrono::duration_cast<std::chrono::nanoseconds>(end-begin).count() / MAX) << "ns per iteration)" <<std::endl;
+  std::cout << std::chrono::duration_cast<std::chrono::nanoseconds>(end-begin).count() << "ns" << " \t(" << (int)(std::chrono::duration_cast<std::chrono::nanoseconds>(end-begin).count() / MAX) << "ns per iteration" << count.PerIteration(MAX) << ")" <<std::endl;
 
   }
 
@@ -825,6 +829,7 @@ int main()
     while (true) { yield(i++); }
   });
 
+  AllocationCount count;
   auto begin = std::chrono::high_resolution_clock::now();
 
   for (int i = 0; i <= MAX; i++) {
@@ -833,7 +838,7 @@ int main()
   }
 
   auto end = std::chrono::high_resolution_clock::now();
-  std::cout << std::chrono::duration_cast<std::chrono::nanoseconds>(end-begin).count() << "ns" << " \t(" << (int)(std::chrono::duration_cast<std::chrono::nanoseconds>(end-begin).count() / MAX) << "ns per iteration)" <<std::endl;
+  std::cout << std::chrono::duration_cast<std::chrono::nanoseconds>(end-begin).count() << "ns" << " \t(" << (int)(std::chrono::duration_cast<std::chrono::nanoseconds>(end-begin).count() / MAX) << "ns per iteration" << count.PerIteration(MAX) << ")" <<std::endl;
 
   }
 
@@ -848,6 +853,7 @@ int main()
     while (true) { yield(i++); }
   });
 
+  AllocationCount count;
   auto begin = std::chrono::high_resolution_clock::now();
 
   for (int i = 0; i <= MAX; i++) {
@@ -856,7 +862,7 @@ int main()
   }
 
   auto end = std::chrono::high_resolution_clock::now();
-  std::cout << std::chrono::duration_cast<std::chrono::nanoseconds>(end-begin).count() << "ns" << " \t(" << (int)(std::chrono::duration_cast<std::chrono::nanoseconds>(end-begin).count() / MAX) << "ns per iteration)" <<std::endl;
+  std::cout << std::chrono::duration_cast<std::chrono::nanoseconds>(end-begin).count() << "ns" << " \t(" << (int)(std::chrono::duration_cast<std::chrono::nanoseconds>(end-begin).count() / MAX) << "ns per iteration" << count.PerIteration(MAX) << ")" <<std::endl;
 
   }
 
@@ -871,6 +877,7 @@ int main()
     while (true) { yield(i++); }
   });
 
+  AllocationCount count;
   auto begin = std::chrono::high_resolution_clock::now();
 
   for (int i = 0; i <= MAX; i++) {
@@ -879,7 +886,7 @@ int main()
   }
 
   auto end = std::chrono::high_resolution_clock::now();
-  std::cout << std::chrono::duration_cast<std::chrono::nanoseconds>(end-begin).count() << "ns" << " \t(" << (int)(std::chrono::duration_cast<std::chrono::nanoseconds>(end-begin).count() / MAX) << "ns per iteration)" <<std::endl;
+  std::cout << std::chrono::duration_cast<std::chrono::nanoseconds>(end-begin).count() << "ns" << " \t(" << (int)(std::chrono::duration_cast<std::chrono::nanoseconds>(end-begin).count() / MAX) << "ns per iteration" << count.PerIteration(MAX) << ")" <<std::endl;
 
   }
 
@@ -894,6 +901,7 @@ int main()
     while (true) { yield(i++); }
   });
 
+  AllocationCount count;
   auto begin = std::chrono::high_resolution_clock::now();
 
   for (int i = 0; i <= MAX; i++) {
@@ -902,7 +910,7 @@ int main()
   }
 
   auto end = std::chrono::high_resolution_clock::now();
-  std::cout << std::chrono::duration_cast<std::chrono::nanoseconds>(end-begin).count() << "ns" << " \t(" << (int)(std::chrono::duration_cast<std::chrono::nanoseconds>(end-begin).count() / MAX) << "ns per iteration)" <<std::endl;
+  std::cout << std::chrono::duration_cast<std::chrono::nanoseconds>(end-begin).count() << "ns" << " \t(" << (int)(std::chrono::duration_cast<std::chrono::nanoseconds>(end-begin).count() / MAX) << "ns per iteration" << count.PerIteration(MAX) << ")" <<std::endl;
 
   }
 
@@ -917,6 +925,7 @@ int main()
     while (true) { yield(i++); }
   });
 
+  AllocationCount count;
   auto begin = std::chrono::high_resolution_clock::now();
 
   for (int i = 0; i <= MAX; i++) {
@@ -925,7 +934,7 @@ int main()
   }
 
   auto end = std::chrono::high_resolution_clock::now();
-  std::cout << std::chrono::duration_cast<std::chrono::nanoseconds>(end-begin).count() << "ns" << " \t(" << (int)(std::chrono::duration_cast<std::chrono::nanoseconds>(end-begin).count() / MAX) << "ns per iteration)" <<std::endl;
+  std::cout << std::chrono::duration_cast<std::chrono::nanoseconds>(end-begin).count() << "ns" << " \t(" << (int)(std::chrono::duration_cast<std::chrono::nanoseconds>(end-begin).count() / MAX) << "ns per iteration" << count.PerIteration(MAX) << ")" <<std::endl;
 
   }
 
@@ -940,6 +949,7 @@ int main()
     while (true) { yield(i++); }
   });
 
+  AllocationCount count;
   auto begin = std::chrono::high_resolution_clock::now();
 
   for (int i = 0; i <= MAX; i++) {
@@ -948,7 +958,7 @@ int main()
   }
 
   auto end = std::chrono::high_resolution_clock::now();
-  std::cout << std::chrono::duration_cast<std::chrono::nanoseconds>(end-begin).count() << "ns" << " \t(" << (int)(std::chrono::duration_cast<std::chrono::nanoseconds>(end-begin).count() / MAX) << "ns per iteration)" <<std::endl;
+  std::cout << std::chrono::duration_cast<std::chrono::nanoseconds>(end-begin).count() << "ns" << " \t(" << (int)(std::chrono::duration_cast<std::chrono::nanoseconds>(end-begin).count() / MAX) << "ns per iteration" << count.PerIteration(MAX) << ")" <<std::endl;
 
   }
 }
@@ -0,0 +1,273 @@
+// C++ Effects library
+// Maciej Pirog, Huawei Edinburgh Research Centre, maciej.pirog@huawei.com
+// License: MIT
+
+// Benchmark: Hiding the latency of memory by interleaving lookups in a
+// hash table that does not fit in the cache. Every lookup is a
+// lightweight computation that prefetches the next node of a chain
+// and yields, so that other lookups run while the node is fetched. The
+// computations are created once for a group of lookups. We compare
+// two ways to yield: a command with a no_manage clause that puts the
+// computation in a queue (each computation performs every G-th
+// lookup), and the light path of interleave.h (a direct switch to the
+// next member of the group). The baselines are sequential lookups, and
+// lookups interleaved by hand (a state machine per lookup). It pays
+// off only if a yield is cheaper than a cache miss.
+
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include "cpp-effects/cpp-effects.h"
+#include "cpp-effects/clause-modifiers.h"
+#include "cpp-effects/interleave.h"
+#include "cpp-effects/resumption-queues.h"
+
+namespace eff = cpp_effects;
+
+// ----------
+// Hash table
+// ----------
+
+// Chained hash table with the nodes scattered in memory
+
+struct Node {
+  uint64_t key;
+  uint64_t value;
+  Node* next;
+};
+
+const std::size_t NODES = 1 << 21;
+const std::size_t BUCKETS = NODES / 4;
+
+uint64_t random(uint64_t& seed)
+{
+  seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+  return seed >> 17;
+}
+
+std::size_t bucket(uint64_t key)
+{
+  return (key * 0x9e3779b97f4a7c15ULL) >> 40 & (BUCKETS - 1);
+}
+
+class Table {
+public:
+  Table() : nodes(NODES), buckets(BUCKETS, nullptr)
+  {
+    // Insert the nodes in a random order, so that chains are scattered
+    std::vector<std::size_t> order(NODES);
+    uint64_t seed = 7;
+    for (std::size_t i = 0; i < NODES; i++) { order[i] = i; }
+    for (std::size_t i = NODES - 1; i > 0; i--) { std::swap(order[i], order[random(seed) % (i + 1)]); }
+    for (std::size_t i = 0; i < NODES; i++) {
+      Node& n = nodes[order[i]];
+      n.key = i * 2 + 1;
+      n.value = i;
+      n.next = buckets[bucket(n.key)];
+      buckets[bucket(n.key)] = &n;
+    }
+  }
+  Node* const* Bucket(uint64_t key) const { return &buckets[bucket(key)]; }
+private:
+  std::vector<Node> nodes;
+  std::vector<Node*> buckets;
+};
+
+// -----------
+// Sequential
+// -----------
+
+uint64_t lookup(const Table& table, uint64_t key)
+{
+  for (Node* n = *table.Bucket(key); n; n = n->next) {
+    if (n->key == key) { return n->value; }
+  }
+  return 0;
+}
+
+// --------------------------
+// Interleaved with effects
+// --------------------------
+
+struct Yield : eff::command<> { };
+
+using Res = eff::resumption<void()>;
+
+class Interleaver : public eff::flat_handler<void, eff::no_manage<Yield>> {
+public:
+  static void Spawn(std::function<void()> f)
+  {
+    queue.push_back(eff::wrap<Interleaver>(f));
+  }
+  static void Run()
+  {
+    while (!queue.empty()) { queue.pop_front().resume(); }
+  }
+private:
+  static eff::resumption_queue<void()> queue;
+  void handle_command(Yield, Res r) override
+  {
+    queue.push_back(std::move(r));
+  }
+};
+
+eff::resumption_queue<void()> Interleaver::queue;
+
+void effectsYield()
+{
+  eff::static_invoke_command<Interleaver>(Yield{});
+}
+
+// After every prefetch, let the other lookups run while the node is
+// fetched
+
+template <void (*yield)()>
+uint64_t yieldingLookup(const Table& table, uint64_t key)
+{
+  Node* const* b = table.Bucket(key);
+  __builtin_prefetch(b);
+  yield();
+  for (Node* n = *b; n; n = n->next) {
+    __builtin_prefetch(n);
+    yield();
+    if (n->key == key) { return n->value; }
+  }
+  return 0;
+}
+
+uint64_t interleaved(const Table& table, const std::vector<uint64_t>& keys, std::size_t group)
+{
+  uint64_t sum = 0;
+  for (std::size_t g = 0; g < group; g++) {
+    Interleaver::Spawn([&, g](){
+      for (std::size_t i = g; i < keys.size(); i += group) { sum += yieldingLookup<effectsYield>(table, keys[i]); }
+    });
+  }
+  Interleaver::Run();
+  return sum;
+}
+
+// --------------------------
+// Interleaved by interleave.h
+// --------------------------
+
+uint64_t lightInterleaved(const Table& table, const std::vector<uint64_t>& keys, std::size_t group)
+{
+  uint64_t sum = 0;
+  eff::interleave(keys.size(), group, [&](std::size_t i) {
+    sum += yieldingLookup<eff::interleave_yield>(table, keys[i]);
+  });
+  return sum;
+}
+
+// -----------------------
+// Interleaved by hand
+// -----------------------
+
+// Every slot of the group is a lookup in progress: a key and the node
+// to visit next (prefetched when the lookup moved to it)
+
+uint64_t handInterleaved(const Table& table, const std::vector<uint64_t>& keys, std::size_t group)
+{
+  struct Slot {
+    uint64_t key;
+    Node* const* bucket;  // Before the first node
+    Node* node;
+    bool active;
+  };
+  std::vector<Slot> slots(group);
+  std::size_t next = 0;
+  uint64_t sum = 0;
+  auto start = [&](Slot& s) {
+    s.active = next < keys.size();
+    if (!s.active) { return; }
+    s.key = keys[next++];
+    s.bucket = table.Bucket(s.key);
+    s.node = nullptr;
+    __builtin_prefetch(s.bucket);
+  };
+  for (auto& s : slots) { start(s); }
+  std::size_t active = group;
+  while (active > 0) {
+    for (auto& s : slots) {
+      if (!s.active) { continue; }
+      Node* n = s.bucket ? *s.bucket : s.node->next;
+      s.bucket = nullptr;
+      if (s.node && s.node->key == s.key) { sum += s.node->value; n = nullptr; }
+      if (n) {
+        s.node = n;
+        __builtin_prefetch(n);
+      } else {
+        start(s);
+        if (!s.active) { active--; }
+      }
+    }
+  }
+  return sum;
+}
+
+// ----------
+// Measuring
+// ----------
+
+template <typename F>
+void measure(const char* name, int64_t iterations, F f, const char* unit = "lookup")
+{
+  std::cout << name << std::flush;
+  auto begin = std::chrono::high_resolution_clock::now();
+  f();
+  auto end = std::chrono::high_resolution_clock::now();
+  std::cout << std::chrono::duration_cast<std::chrono::nanoseconds>(end-begin).count() << "ns" << " \t(" << (int)(std::chrono::duration_cast<std::chrono::nanoseconds>(end-begin).count() / iterations) << "ns per " << unit << ")" << std::endl;
+}
+
+// ----
+// Main
+// ----
+
+int main()
+{
+  std::cout << "--- interleave: hiding memory latency with prefetch and yield ---" << std::endl;
+
+  const std::size_t LOOKUPS = 1 << 20;
+
+  Table table;
+  std::vector<uint64_t> keys(LOOKUPS);
+  uint64_t seed = 42;
+  for (auto& k : keys) { k = (random(seed) % NODES) * 2 + 1; }
+
+  uint64_t expected = 0;
+  measure("sequential:          ", LOOKUPS, [&](){
+    for (auto k : keys) { expected += lookup(table, k); }
+  });
+  bool agree = true;
+  for (std::size_t group : {4, 16}) {
+    std::cout << "group of " << group << ":" << std::endl;
+    uint64_t sum = 0;
+    measure("  by hand:           ", LOOKUPS, [&](){ sum = handInterleaved(table, keys, group); });
+    agree = agree && sum == expected;
+    measure("  effects:           ", LOOKUPS, [&](){ sum = interleaved(table, keys, group); });
+    agree = agree && sum == expected;
+    measure("  interleave:        ", LOOKUPS, [&](){ sum = lightInterleaved(table, keys, group); });
+    agree = agree && sum == expected;
+  }
+  std::cout << "results " << (agree ? "agree" : "DIFFER") << std::endl;
+
+  // The cost of a yield alone, to compare with a miss (a lookup makes
+  // about 3.5 dependent accesses to memory, including the bucket)
+  measure("yields only, effects:", LOOKUPS, [&](){
+    for (std::size_t g = 0; g < 16; g++) {
+      Interleaver::Spawn([&](){
+        for (std::size_t i = 0; i < LOOKUPS / 16; i++) { eff::static_invoke_command<Interleaver>(Yield{}); }
+      });
+    }
+    Interleaver::Run();
+  }, "yield");
+  measure("yields only, light:  ", LOOKUPS, [&](){
+    eff::interleave(16, 16, [&](std::size_t) {
+      for (std::size_t i = 0; i < LOOKUPS / 16; i++) { eff::interleave_yield(); }
+    });
+  }, "yield");
+}
@@ -0,0 +1,154 @@
+// C++ Effects library
+// Maciej Pirog, Huawei Edinburgh Research Centre, maciej.pirog@huawei.com
+// License: MIT
+
+// Benchmark: Asynchronous logging. The handler formats messages into a
+// per-thread ring buffer and a background thread batches the writes to
+// the sink, vs a handler that writes to the sink in the clause (as in
+// examples/dep-injection.cpp)
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "cpp-effects/cpp-effects.h"
+#include "cpp-effects/async-log.h"
+
+namespace eff = cpp_effects;
+
+// ---------------------------------
+// Synchronous logging (the example)
+// ---------------------------------
+
+// The clause writes to the stream and flushes it, so the computation
+// is blocked on I/O. The stream is shared by all threads. (Unlike in
+// the example, we resume in the tail position, as there are many log
+// calls.)
+
+std::mutex syncMutex;
+
+template <typename Answer>
+class SyncLog : public eff::flat_handler<Answer, eff::log_line> {
+public:
+  SyncLog(std::ostream* output) : output(output) { }
+private:
+  std::ostream* output;
+  Answer handle_command(eff::log_line l, eff::resumption<Answer()> r) final override
+  {
+    {
+      std::lock_guard<std::mutex> lock(syncMutex);
+      *output << l.text;
+      if (l.with_value) { *output << l.value; }
+      *output << std::endl;
+    }
+    return std::move(r).tail_resume();
+  }
+};
+
+// --------
+// Workload
+// --------
+
+// A computation that logs on every iteration. The loggers are generic,
+// so that exactly the same code runs with both handlers.
+
+volatile uint64_t SUM = 0;
+
+template <typename L>
+void work(L log, int id, int n)
+{
+  uint64_t x = id + 1;
+  for (int i = 0; i < n; i++) {
+    x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+    log("worker ", (int64_t)(x % 1000000));
+  }
+  SUM += x;
+}
+
+std::string tempName(const char* suffix)
+{
+  const char* dir = std::getenv("TMPDIR");
+  return std::string(dir ? dir : "/tmp") + "/cpp-effects-logging-" +
+    std::to_string(getpid()) + "-" + suffix;
+}
+
+template <typename F>
+void measure(const char* name, int threads, int calls, const std::string& file, F f)
+{
+  std::cout << name << threads << " thread(s): " << std::flush;
+  auto begin = std::chrono::high_resolution_clock::now();
+  f();
+  auto end = std::chrono::high_resolution_clock::now();
+  auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(end-begin).count();
+  std::ifstream in(file, std::ios::binary | std::ios::ate);
+  std::cout << ns << "ns" << " \t(" << (int64_t)(threads * (int64_t)calls * 1000000000.0 / ns)
+            << " calls/s, " << in.tellg() << " bytes)" << std::endl;
+}
+
+// ----
+// Main
+// ----
+
+int main()
+{
+  std::cout << "--- logging: synchronous vs asynchronous log handler ---" << std::endl;
+
+  const int CALLS = 200000;  // per thread
+  const std::size_t RING = 1 << 16;
+  const std::size_t BATCH = 1 << 16;
+
+  int maxThreads = std::max(2, std::min(4, (int)std::thread::hardware_concurrency()));
+  std::string file = tempName("log");
+
+  for (int threads : {1, maxThreads}) {
+    {
+      std::ofstream output(file, std::ios::binary | std::ios::trunc);
+      measure("sync:  ", threads, CALLS, file, [&](){
+        std::vector<std::thread> ts;
+        for (int t = 0; t < threads; t++) {
+          ts.emplace_back([&, t](){
+            eff::handle_ref<SyncLog<void>>([&](auto href) {
+              work(eff::logger<SyncLog<void>>(href), t, CALLS);
+            }, &output);
+          });
+        }
+        for (auto& t : ts) { t.join(); }
+        output.flush();
+      });
+    }
+    {
+      int fd = ::open(file.c_str(), O_WRONLY | O_TRUNC);
+      std::size_t stalls = 0;
+      measure("async: ", threads, CALLS, file, [&](){
+        eff::log_flusher flusher(fd, BATCH);
+        std::vector<eff::log_ring*> rings;
+        for (int t = 0; t < threads; t++) { rings.push_back(flusher.add_ring(RING)); }
+        std::vector<std::thread> ts;
+        for (int t = 0; t < threads; t++) {
+          ts.emplace_back([&, t](){
+            eff::handle_ref<eff::async_log<void>>([&](auto href) {
+              work(eff::logger<eff::async_log<void>>(href), t, CALLS);
+            }, rings[t]);
+          });
+        }
+        for (auto& t : ts) { t.join(); }
+        for (auto ring : rings) { stalls += ring->stalls(); }
+      });
+      std::cout << "       (" << stalls << " stalls on a full ring)" << std::endl;
+      ::close(fd);
+    }
+  }
+
+  std::remove(file.c_str());
+}
@@ -0,0 +1,195 @@
+// C++ Effects library
+// Maciej Pirog, Huawei Edinburgh Research Centre, maciej.pirog@huawei.com
+// License: MIT
+
+// Benchmark: External sort. The sorted runs (temporary files) are
+// merged by a k-way merge of generators vs a hand-written buffered
+// merge
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "cpp-effects/cpp-effects.h"
+#include "cpp-effects/generator.h"
+
+namespace eff = cpp_effects;
+
+// ---------------
+// Sorted runs I/O
+// ---------------
+
+const std::size_t IO_BUFFER = 4096;  // values per read/write
+
+std::string tempName(int i)
+{
+  const char* dir = std::getenv("TMPDIR");
+  return std::string(dir ? dir : "/tmp") + "/cpp-effects-merge-" +
+    std::to_string(getpid()) + "-" + std::to_string(i);
+}
+
+// Read a run as a generator
+
+eff::generator<uint64_t> readRun(const std::string& name, std::size_t batchSize)
+{
+  return eff::generator<uint64_t>([name](auto yield) {
+    FILE* f = std::fopen(name.c_str(), "rb");
+    std::vector<uint64_t> buffer(IO_BUFFER);
+    std::size_t n;
+    while ((n = std::fread(buffer.data(), sizeof(uint64_t), IO_BUFFER, f)) > 0) {
+      for (std::size_t i = 0; i < n; i++) { yield(buffer[i]); }
+    }
+    std::fclose(f);
+  }, batchSize);
+}
+
+// Hand-written buffered reader with the same interface
+
+class RunReader {
+public:
+  RunReader(const std::string& name) : f(std::fopen(name.c_str(), "rb")), buffer(IO_BUFFER)
+  {
+    fill();
+  }
+  RunReader(RunReader&& other) : f(other.f), buffer(std::move(other.buffer)), pos(other.pos), count(other.count)
+  {
+    other.f = nullptr;
+  }
+  ~RunReader() { if (f) { std::fclose(f); } }
+  uint64_t value() const { return buffer[pos]; }
+  bool next()
+  {
+    if (++pos == count) { fill(); }
+    return (bool)*this;
+  }
+  explicit operator bool() const { return pos < count; }
+private:
+  FILE* f;
+  std::vector<uint64_t> buffer;
+  std::size_t pos = 0;
+  std::size_t count = 0;
+  void fill()
+  {
+    pos = 0;
+    count = std::fread(buffer.data(), sizeof(uint64_t), IO_BUFFER, f);
+  }
+};
+
+class RunWriter {
+public:
+  RunWriter(const std::string& name) : f(std::fopen(name.c_str(), "wb")) { buffer.reserve(IO_BUFFER); }
+  ~RunWriter()
+  {
+    flush();
+    std::fclose(f);
+  }
+  void put(uint64_t x)
+  {
+    buffer.push_back(x);
+    if (buffer.size() == IO_BUFFER) { flush(); }
+  }
+private:
+  FILE* f;
+  std::vector<uint64_t> buffer;
+  void flush()
+  {
+    std::fwrite(buffer.data(), sizeof(uint64_t), buffer.size(), f);
+    buffer.clear();
+  }
+};
+
+// ----
+// Main
+// ----
+
+int main()
+{
+  std::cout << "--- merge: external sort with k-way merge of generators ---" << std::endl;
+
+  const int RUNS = 16;
+  const std::size_t RUN_SIZE = 256 * 1024;
+  const std::size_t TOTAL = RUNS * RUN_SIZE;
+
+  // Create the sorted runs
+
+  std::mt19937_64 rng(42);
+  std::vector<std::string> names;
+  for (int i = 0; i < RUNS; i++) {
+    std::vector<uint64_t> run(RUN_SIZE);
+    for (auto& x : run) { x = rng(); }
+    std::sort(run.begin(), run.end());
+    names.push_back(tempName(i));
+    RunWriter w(names.back());
+    for (auto x : run) { w.put(x); }
+  }
+  std::string outName = tempName(RUNS);
+
+  auto report = [&](auto begin, auto end, uint64_t checksum, bool sorted) {
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(end-begin).count();
+    std::cout << ns << "ns" << " \t(" << (int)(ns / TOTAL) << "ns per value, "
+              << (int)(TOTAL * sizeof(uint64_t) * 1000.0 / ns) << "MB/s, checksum "
+              << checksum << (sorted ? "" : ", NOT SORTED") << ")" << std::endl;
+  };
+
+  {
+    std::cout << "hand-written:   " << std::flush;
+
+    auto begin = std::chrono::high_resolution_clock::now();
+    uint64_t checksum = 0, prev = 0;
+    bool sorted = true;
+    {
+      std::vector<RunReader> readers;
+      for (auto& name : names) { readers.emplace_back(name); }
+      eff::loser_tree<RunReader> tree(readers);
+      RunWriter out(outName);
+      while (!tree.empty()) {
+        uint64_t x = tree.top().value();
+        sorted = sorted && prev <= x;
+        prev = x;
+        checksum += x;
+        out.put(x);
+        tree.top().next();
+        tree.replay();
+      }
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    report(begin, end, checksum, sorted);
+  }
+
+  // Batch size 1 suspends on every value, as the generators in
+  // examples/generators.cpp do
+
+  for (std::size_t batchSize : {1, 256}) {
+    std::cout << (batchSize == 1 ? "generators-1:   " : "generators-256: ") << std::flush;
+
+    auto begin = std::chrono::high_resolution_clock::now();
+    uint64_t checksum = 0, prev = 0;
+    bool sorted = true;
+    {
+      std::vector<eff::generator<uint64_t>> inputs;
+      for (auto& name : names) { inputs.push_back(readRun(name, batchSize)); }
+      auto merged = eff::merge(std::move(inputs), batchSize);
+      RunWriter out(outName);
+      while (merged) {
+        uint64_t x = merged.value();
+        sorted = sorted && prev <= x;
+        prev = x;
+        checksum += x;
+        out.put(x);
+        merged.next();
+      }
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    report(begin, end, checksum, sorted);
+  }
+
+  for (auto& name : names) { std::remove(name.c_str()); }
+  std::remove(outName.c_str());
+}
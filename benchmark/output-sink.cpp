@@ -0,0 +1,131 @@
+// C++ Effects library
+// Maciej Pirog, Huawei Edinburgh Research Centre, maciej.pirog@huawei.com
+// License: MIT
+
+// Benchmark: Streaming serialisation via an output effect (the
+// producer fills chunks owned by the handler, which hands them over
+// to a sink) vs building the whole output in a std::string
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "cpp-effects/cpp-effects.h"
+#include "cpp-effects/output-sink.h"
+
+namespace eff = cpp_effects;
+
+// ---------------------------
+// Serialisation of some data
+// ---------------------------
+
+struct Record {
+  int64_t id;
+  std::string name;
+  double score;
+  std::vector<std::string> tags;
+};
+
+std::vector<Record> makeData(int n)
+{
+  std::vector<Record> data;
+  data.reserve(n);
+  for (int i = 0; i < n; i++) {
+    data.push_back({i, "user-" + std::to_string(i * 7919 % 100003), (i % 1000) / 7.0,
+      {"alpha", "beta" + std::to_string(i % 13), "gamma"}});
+  }
+  return data;
+}
+
+// The serialiser is generic in the output, so that exactly the same
+// code produces the std::string and the stream of chunks.
+
+template <typename Out>
+void serialise(Out& out, const std::vector<Record>& data)
+{
+  char num[32];
+  out.put('[');
+  for (std::size_t i = 0; i < data.size(); i++) {
+    const Record& r = data[i];
+    if (i > 0) { out.put(','); }
+    out.write("{\"id\":", 6);
+    out.write(num, std::snprintf(num, sizeof(num), "%lld", (long long)r.id));
+    out.write(",\"name\":\"", 9);
+    out.write(r.name);
+    out.write("\",\"score\":", 10);
+    out.write(num, std::snprintf(num, sizeof(num), "%.3f", r.score));
+    out.write(",\"tags\":[", 9);
+    for (std::size_t j = 0; j < r.tags.size(); j++) {
+      if (j > 0) { out.put(','); }
+      out.put('"');
+      out.write(r.tags[j]);
+      out.put('"');
+    }
+    out.write("]}", 2);
+  }
+  out.put(']');
+}
+
+struct StringOut {
+  std::string str;
+  void put(char c) { str.push_back(c); }
+  void write(const char* data, std::size_t size) { str.append(data, size); }
+  void write(const std::string& s) { str.append(s); }
+};
+
+// ----
+// Main
+// ----
+
+int main()
+{
+  std::cout << "--- output-sink: chunked output effect vs std::string ---" << std::endl;
+
+  const int RECORDS = 1000000;
+  const std::size_t CHUNK = 64 * 1024;
+
+  auto data = makeData(RECORDS);
+
+  // We write to /dev/null, so that the benchmark measures the
+  // serialisation and the handover, not the disk
+  int fd = ::open("/dev/null", O_WRONLY);
+  eff::fd_sink sink(fd);
+
+  {
+    std::cout << "std::string:  " << std::flush;
+
+    auto begin = std::chrono::high_resolution_clock::now();
+    StringOut out;
+    serialise(out, data);
+    sink.consume(out.str.data(), out.str.size());
+    auto end = std::chrono::high_resolution_clock::now();
+
+    std::cout << std::chrono::duration_cast<std::chrono::nanoseconds>(end-begin).count() << "ns" << " \t(" << (int)(std::chrono::duration_cast<std::chrono::nanoseconds>(end-begin).count() / RECORDS) << "ns per record, "
+              << out.str.size() << " bytes, " << out.str.capacity() << " bytes buffered)" << std::endl;
+  }
+
+  {
+    std::cout << "output-sink:  " << std::flush;
+
+    std::size_t before = sink.written();
+    auto begin = std::chrono::high_resolution_clock::now();
+    eff::handle_ref<eff::output<void>>([&](auto href) {
+      eff::output_writer<void> out(href);
+      serialise(out, data);
+    }, &sink, CHUNK);
+    auto end = std::chrono::high_resolution_clock::now();
+
+    std::cout << std::chrono::duration_cast<std::chrono::nanoseconds>(end-begin).count() << "ns" << " \t(" << (int)(std::chrono::duration_cast<std::chrono::nanoseconds>(end-begin).count() / RECORDS) << "ns per record, "
+              << sink.written() - before << " bytes, " << CHUNK << " bytes buffered)" << std::endl;
+  }
+
+  ::close(fd);
+}
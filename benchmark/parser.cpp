@@ -0,0 +1,393 @@
+// C++ Effects library
+// Maciej Pirog, Huawei Edinburgh Research Centre, maciej.pirog@huawei.com
+// License: MIT
+
+// Benchmark: Parser combinators from cpp-effects/parser.h. The
+// primitive operations (peek at the rest of the input, advance, fail,
+// and save/restore the position) are commands handled by a parser
+// handler that owns the input. We compare with a hand-written
+// recursive-descent parser on a large JSON document, given either
+// entirely or in chunks (incremental input, with the parser suspended
+// until the next chunk arrives), and show the packrat memoization on a
+// grammar that backtracks exponentially on nested arrays.
+
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <string_view>
+
+#include "cpp-effects/cpp-effects.h"
+#include "cpp-effects/parser.h"
+
+namespace eff = cpp_effects;
+
+using P = eff::parser;
+
+// ----
+// JSON
+// ----
+
+// Instead of building a tree, both parsers compute a digest of the
+// document, which is used to check that they agree
+
+struct Digest {
+  int64_t values = 0;
+  int64_t chars = 0;
+  double numbers = 0;
+  Digest& operator+=(const Digest& other)
+  {
+    values += other.values;
+    chars += other.chars;
+    numbers += other.numbers;
+    return *this;
+  }
+  bool operator==(const Digest& other) const
+  {
+    return values == other.values && chars == other.chars && numbers == other.numbers;
+  }
+};
+
+// In the backtracking variant, the elements of an array are parsed as
+// (value ',' elements | value ']'), so the last element is parsed
+// twice, and a nesting of depth n is parsed 2^n times
+
+class Json {
+public:
+  Json(bool packrat, bool backtracking) : packrat(packrat), backtracking(backtracking) { }
+  bool Parse(std::string_view input, Digest& result)
+  {
+    memo.clear();
+    return P::parse(input, [&](){ result = Value(); P::spaces(); });
+  }
+
+  // The input is fed in chunks of the given size
+  bool ParseChunks(std::string_view input, std::size_t chunk, Digest& result)
+  {
+    memo.clear();
+    eff::push_parser parser([&](){ result = Value(); P::spaces(); });
+    for (std::size_t i = 0; i < input.size() && !parser.done(); i += chunk) {
+      parser.feed(input.substr(i, chunk));
+    }
+    return parser.finish();
+  }
+private:
+  bool packrat;
+  bool backtracking;
+  P::memo<Digest> memo;
+
+  // A failed alternative runs on until its choice point, so recursive
+  // rules stop early
+
+  Digest Value()
+  {
+    if (P::failed()) { return {}; }
+    if (packrat) { return memo([this](){ return PlainValue(); }); }
+    return PlainValue();
+  }
+  Digest PlainValue()
+  {
+    P::spaces();
+    return P::alt(
+      [this](){ return Object(); },
+      [this](){ return Array(); },
+      [](){ return String(); },
+      [](){ return Number(); },
+      [](){ return Literal("true"); },
+      [](){ return Literal("false"); },
+      [](){ return Literal("null"); });
+  }
+  static Digest Literal(std::string_view s)
+  {
+    P::keyword(s);
+    return {1, 0, 0};
+  }
+  static Digest String()
+  {
+    Digest d{1, 0, 0};
+    P::lookahead r;
+    if (r[0] != '"') { P::fail(); return d; }
+    for (std::size_t n = 1; r[n] >= 0; n++) {
+      if (r[n] == '"') { P::advance(n + 1); return d; }
+      if (r[n] == '\\') { n++; }
+      d.chars++;
+    }
+    P::fail();
+    return d;
+  }
+  static Digest Number()
+  {
+    P::lookahead r;
+    std::size_t n = 0;
+    bool negative = r[n] == '-';
+    if (negative) { n++; }
+    if (r[n] < '0' || r[n] > '9') { P::fail(); return {}; }
+    double x = 0;
+    for (; r[n] >= '0' && r[n] <= '9'; n++) { x = x * 10 + (r[n] - '0'); }
+    if (r[n] == '.') {
+      double scale = 1;
+      for (n++; r[n] >= '0' && r[n] <= '9'; n++) { scale /= 10; x += scale * (r[n] - '0'); }
+    }
+    P::advance(n);
+    return {1, 0, negative ? -x : x};
+  }
+  Digest Array()
+  {
+    Digest d{1, 0, 0};
+    P::ch('[');
+    P::spaces();
+    if (P::peek() == ']') { P::advance(); return d; }
+    if (backtracking) { d += Elements(); return d; }
+    d += Value();
+    P::many([this](){ P::spaces(); P::ch(','); return Value(); }, [&](const Digest& x){ d += x; });
+    P::spaces();
+    P::ch(']');
+    return d;
+  }
+  Digest Elements()
+  {
+    if (P::failed()) { return {}; }
+    return P::alt(
+      [this](){ Digest d = Value(); P::spaces(); P::ch(','); d += Elements(); return d; },
+      [this](){ Digest d = Value(); P::spaces(); P::ch(']'); return d; });
+  }
+  Digest Member()
+  {
+    P::spaces();
+    Digest d = String();
+    P::spaces();
+    P::ch(':');
+    d += Value();
+    return d;
+  }
+  Digest Object()
+  {
+    Digest d{1, 0, 0};
+    P::ch('{');
+    P::spaces();
+    if (P::peek() == '}') { P::advance(); return d; }
+    d += Member();
+    P::many([this](){ P::spaces(); P::ch(','); return Member(); }, [&](const Digest& x){ d += x; });
+    P::spaces();
+    P::ch('}');
+    return d;
+  }
+};
+
+// -------------------------------
+// Hand-written recursive descent
+// -------------------------------
+
+class HandJson {
+public:
+  bool Parse(std::string_view input, Digest& result)
+  {
+    p = input.data();
+    end = p + input.size();
+    ok = true;
+    result = Value();
+    Spaces();
+    return ok && p == end;
+  }
+private:
+  const char* p;
+  const char* end;
+  bool ok;
+
+  int Peek() const { return p < end ? *p : -1; }
+  void Spaces()
+  {
+    while (p < end && (*p == ' ' || *p == '\n' || *p == '\t' || *p == '\r')) { p++; }
+  }
+  void Expect(char c)
+  {
+    if (Peek() == c) { p++; } else { ok = false; }
+  }
+  void Keyword(const char* s)
+  {
+    for (; *s; s++) { Expect(*s); }
+  }
+  Digest Value()
+  {
+    Spaces();
+    switch (Peek()) {
+    case '{': return Object();
+    case '[': return Array();
+    case '"': return String();
+    case 't': Keyword("true"); return {1, 0, 0};
+    case 'f': Keyword("false"); return {1, 0, 0};
+    case 'n': Keyword("null"); return {1, 0, 0};
+    default: return Number();
+    }
+  }
+  Digest String()
+  {
+    Digest d{1, 0, 0};
+    Expect('"');
+    while (true) {
+      if (p == end) { ok = false; return d; }
+      if (*p == '"') { p++; return d; }
+      if (*p == '\\') { p++; }
+      p++;
+      d.chars++;
+    }
+  }
+  Digest Number()
+  {
+    bool negative = Peek() == '-';
+    if (negative) { p++; }
+    if (Peek() < '0' || Peek() > '9') { ok = false; return {}; }
+    double x = 0;
+    while (Peek() >= '0' && Peek() <= '9') { x = x * 10 + (*p - '0'); p++; }
+    if (Peek() == '.') {
+      p++;
+      double scale = 1;
+      while (Peek() >= '0' && Peek() <= '9') { scale /= 10; x += scale * (*p - '0'); p++; }
+    }
+    return {1, 0, negative ? -x : x};
+  }
+  Digest Array()
+  {
+    Digest d{1, 0, 0};
+    Expect('[');
+    Spaces();
+    if (Peek() == ']') { p++; return d; }
+    d += Value();
+    while (ok) {
+      Spaces();
+      if (Peek() != ',') { break; }
+      p++;
+      d += Value();
+    }
+    Expect(']');
+    return d;
+  }
+  Digest Member()
+  {
+    Spaces();
+    Digest d = String();
+    Spaces();
+    Expect(':');
+    d += Value();
+    return d;
+  }
+  Digest Object()
+  {
+    Digest d{1, 0, 0};
+    Expect('{');
+    Spaces();
+    if (Peek() == '}') { p++; return d; }
+    d += Member();
+    while (ok) {
+      Spaces();
+      if (Peek() != ',') { break; }
+      p++;
+      d += Member();
+    }
+    Expect('}');
+    return d;
+  }
+};
+
+// ---------
+// Documents
+// ---------
+
+// An array of records with strings, numbers, literals, and nested
+// objects and arrays
+
+std::string records(int n)
+{
+  uint64_t seed = 42;
+  auto random = [&](int k) { seed = seed * 6364136223846793005ULL + 1442695040888963407ULL; return (int)((seed >> 33) % k); };
+  std::string s = "[\n";
+  for (int i = 0; i < n; i++) {
+    s += "  {\"id\": " + std::to_string(i) + ", \"name\": \"item";
+    for (int j = random(20); j > 0; j--) { s += (char)('a' + random(26)); }
+    s += "\", \"score\": " + std::to_string(random(1000)) + "." + std::to_string(random(100));
+    s += ", \"active\": " + std::string(random(2) ? "true" : "false");
+    s += ", \"tags\": [\"x\", \"y\\\"z\"], \"nested\": {\"a\": null, \"b\": [";
+    for (int j = random(8); j > 0; j--) { s += std::to_string(random(100000)) + ", "; }
+    s += "-1]}}";
+    s += i + 1 < n ? ",\n" : "\n";
+  }
+  s += "]\n";
+  return s;
+}
+
+// Arrays nested n times, with the nested array as the last element
+
+std::string nested(int n)
+{
+  std::string s;
+  for (int i = 0; i < n; i++) { s += "[1, "; }
+  s += "2";
+  for (int i = 0; i < n; i++) { s += "]"; }
+  return s;
+}
+
+// ----------
+// Measuring
+// ----------
+
+template <typename F>
+void measure(const char* name, int64_t iterations, F f)
+{
+  std::cout << name << std::flush;
+  auto begin = std::chrono::high_resolution_clock::now();
+  f();
+  auto end = std::chrono::high_resolution_clock::now();
+  std::cout << std::chrono::duration_cast<std::chrono::nanoseconds>(end-begin).count() << "ns" << " \t(" << (double)std::chrono::duration_cast<std::chrono::nanoseconds>(end-begin).count() / iterations << "ns per byte)" << std::endl;
+}
+
+template <typename F>
+Digest run(const char* name, const std::string& input, int reps, F parse)
+{
+  Digest d;
+  bool ok = true;
+  measure(name, reps * input.size(), [&](){
+    for (int i = 0; i < reps; i++) { ok = parse(input, d) && ok; }
+  });
+  if (!ok) { std::cout << "PARSE ERROR" << std::endl; }
+  return d;
+}
+
+template <typename Parser>
+Digest run(const char* name, Parser& parser, const std::string& input, int reps)
+{
+  return run(name, input, reps, [&](const std::string& input, Digest& d) { return parser.Parse(input, d); });
+}
+
+// ----
+// Main
+// ----
+
+int main()
+{
+  std::cout << "--- parser: combinators with effects vs recursive descent ---" << std::endl;
+
+  std::string doc = records(20000);
+  std::cout << "JSON records (" << doc.size() / 1024 << " KiB):" << std::endl;
+  HandJson hand;
+  Json combinators(false, false);
+  Json packrat(true, false);
+  Digest d1 = run("  recursive descent:     ", hand, doc, 3);
+  Digest d2 = run("  combinators:           ", combinators, doc, 3);
+  Digest d3 = run("  combinators + packrat: ", packrat, doc, 3);
+  bool agree = d1 == d2 && d1 == d3;
+  for (std::size_t chunk : {64, 4096}) {
+    Digest d = run(chunk == 64 ? "  combinators, 64 B chunks:   " : "  combinators, 4 KiB chunks:  ", doc, 3,
+      [&](const std::string& input, Digest& d) { return combinators.ParseChunks(input, chunk, d); });
+    agree = agree && d == d1;
+  }
+  std::cout << "  " << d1.values << " values, results " << (agree ? "agree" : "DIFFER") << std::endl;
+
+  std::string deep = nested(16);
+  std::cout << "Nested arrays (depth 16), backtracking grammar:" << std::endl;
+  Json backtracking(false, true);
+  Json backtrackingPackrat(true, true);
+  Digest d4 = run("  recursive descent:     ", hand, deep, 1);
+  Digest d5 = run("  combinators:           ", backtracking, deep, 1);
+  Digest d6 = run("  combinators + packrat: ", backtrackingPackrat, deep, 1);
+  std::cout << "  " << d4.values << " values, results " << (d4 == d5 && d4 == d6 ? "agree" : "DIFFER") << std::endl;
+}
@@ -0,0 +1,223 @@
+// C++ Effects library
+// Maciej Pirog, Huawei Edinburgh Research Centre, maciej.pirog@huawei.com
+// License: MIT
+
+// Benchmark: Two lightweight threads send a message back and forth,
+// while other threads do some background work (which evicts the
+// caches). When the receiver woken by a send is pushed to the back of
+// the queue of the scheduler, it runs only after all the background
+// threads, when its stack and the message are cold. With a "run next"
+// slot (resumption_run_queue), the receiver runs as soon as the sender
+// waits for the reply.
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include "cpp-effects/cpp-effects.h"
+#include "cpp-effects/clause-modifiers.h"
+#include "cpp-effects/resumption-queues.h"
+
+namespace eff = cpp_effects;
+
+using Res = eff::resumption<void()>;
+
+int64_t now()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// ---------
+// Scheduler
+// ---------
+
+struct Mailbox;
+struct Message;
+
+struct Yield : eff::command<> { };
+
+struct Await : eff::command<> {
+  Mailbox* box;
+};
+
+struct Mailbox {
+  Message* msg = nullptr;
+  bool waiting = false;
+  Res receiver;
+};
+
+class Scheduler : public eff::flat_handler<void, eff::no_manage<Yield>, eff::no_manage<Await>> {
+public:
+  static bool runNext;
+  static eff::resumption_run_queue<void()> queue;
+  static void Run()
+  {
+    while (!queue.empty()) { queue.pop_front().resume(); }
+  }
+  static void Spawn(std::function<void()> f)
+  {
+    queue.push_back(eff::wrap<Scheduler>(f));
+  }
+  static void Wake(Res r)
+  {
+    if (runNext) { queue.push_next(std::move(r)); } else { queue.push_back(std::move(r)); }
+  }
+private:
+  void handle_command(Yield, Res r) override
+  {
+    queue.push_back(std::move(r));
+  }
+  void handle_command(Await a, Res r) override
+  {
+    a.box->receiver = std::move(r);
+    a.box->waiting = true;
+  }
+};
+
+bool Scheduler::runNext = false;
+eff::resumption_run_queue<void()> Scheduler::queue;
+
+void yield()
+{
+  eff::static_invoke_command<Scheduler>(Yield{});
+}
+
+// --------
+// Messages
+// --------
+
+const int PAYLOAD = 512;  // 4 KiB
+
+struct Message {
+  int64_t sentAt;
+  int64_t payload[PAYLOAD];
+};
+
+void send(Mailbox& box, Message* msg)
+{
+  msg->sentAt = now();
+  box.msg = msg;
+  if (box.waiting) {
+    box.waiting = false;
+    Scheduler::Wake(std::move(box.receiver));
+  }
+}
+
+// Statistics of received messages: the time from sending to receiving,
+// and the time of reading the payload
+
+int64_t hops = 0;
+int64_t hopTime = 0;
+int64_t readTime = 0;
+
+Message* receive(Mailbox& box)
+{
+  if (!box.msg) { eff::static_invoke_command<Scheduler>(Await{{}, &box}); }
+  Message* msg = box.msg;
+  box.msg = nullptr;
+  hops++;
+  hopTime += now() - msg->sentAt;
+  return msg;
+}
+
+int64_t read(const Message* msg)
+{
+  int64_t begin = now();
+  int64_t sum = 0;
+  for (int i = 0; i < PAYLOAD; i++) { sum += msg->payload[i]; }
+  readTime += now() - begin;
+  return sum;
+}
+
+void write(Message* msg, int64_t value)
+{
+  for (int i = 0; i < PAYLOAD; i++) { msg->payload[i] = value + i; }
+}
+
+// ---------
+// Ping-pong
+// ---------
+
+bool stop = false;
+int64_t slices = 0;
+volatile int64_t SUM = 0;
+
+void background(std::vector<int64_t>& buffer)
+{
+  while (!stop) {
+    for (auto& x : buffer) { x++; }
+    slices++;
+    yield();
+  }
+}
+
+void pingPong(int rounds, int threads, std::size_t bufferSize)
+{
+  stop = false;
+  slices = hops = hopTime = readTime = 0;
+
+  Mailbox pingBox, pongBox;
+  auto pingMsg = std::make_unique<Message>();
+  auto pongMsg = std::make_unique<Message>();
+
+  Scheduler::Spawn([&](){
+    for (int i = 0; i < rounds; i++) {
+      write(pingMsg.get(), i);
+      send(pongBox, pingMsg.get());
+      SUM += read(receive(pingBox));
+    }
+    stop = true;
+  });
+  Scheduler::Spawn([&](){
+    for (int i = 0; i < rounds; i++) {
+      Message* msg = receive(pongBox);
+      write(pongMsg.get(), read(msg));
+      send(pingBox, pongMsg.get());
+    }
+  });
+  std::vector<std::vector<int64_t>> buffers(threads, std::vector<int64_t>(bufferSize / sizeof(int64_t)));
+  for (auto& b : buffers) {
+    Scheduler::Spawn([&b](){ background(b); });
+  }
+
+  auto begin = std::chrono::high_resolution_clock::now();
+  Scheduler::Run();
+  auto end = std::chrono::high_resolution_clock::now();
+  auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(end-begin).count();
+
+  std::cout << ns / rounds << "ns per round trip, "
+            << hopTime / hops << "ns per hop, "
+            << readTime / hops << "ns per payload read, "
+            << (double)slices / rounds << " background slices per round trip" << std::endl;
+}
+
+// ----
+// Main
+// ----
+
+int main()
+{
+  std::cout << "--- ping-pong: fifo vs run-next slot ---" << std::endl;
+
+  const int ROUNDS = 2000;
+  const std::size_t BUFFER = 256 * 1024;
+
+  for (int threads : {0, 16}) {
+    std::cout << threads << " background threads (" << BUFFER / 1024 << " KiB each):" << std::endl;
+
+    Scheduler::runNext = false;
+    std::cout << "  fifo:                " << std::flush;
+    pingPong(ROUNDS, threads, BUFFER);
+
+    for (std::size_t limit : {8, 64}) {
+      Scheduler::runNext = true;
+      Scheduler::queue = eff::resumption_run_queue<void()>(limit);
+      std::cout << "  run next (limit " << limit << "): " << (limit < 10 ? " " : "") << std::flush;
+      pingPong(ROUNDS, threads, BUFFER);
+    }
+  }
+}
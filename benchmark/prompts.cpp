@@ -0,0 +1,172 @@
+// C++ Effects library
+// Maciej Pirog, Huawei Edinburgh Research Centre, maciej.pirog@huawei.com
+// License: MIT
+
+// Benchmark: Native prompts (cpp-effects/prompts.h) vs shift0/reset
+// encoded with a handler (as in examples/shift0-reset.cpp)
+
+#include <chrono>
+#include <functional>
+#include <iostream>
+
+#include "cpp-effects/cpp-effects.h"
+#include "cpp-effects/prompts.h"
+
+namespace eff = cpp_effects;
+
+volatile int64_t SUM = 0;
+
+// -----------------------------
+// Shift0 and reset via handlers
+// -----------------------------
+
+template <typename Answer, typename Hole>
+struct Shift0 : eff::command<Hole> {
+  std::function<Answer(eff::resumption<Answer(Hole)>)> e;
+};
+
+template <typename Answer, typename Hole>
+class Reset : public eff::flat_handler<Answer, Shift0<Answer, Hole>> {
+  Answer handle_command(
+    Shift0<Answer, Hole> s, eff::resumption<Answer(Hole)> r) final override
+  {
+    return s.e(std::move(r));
+  }
+};
+
+template <typename Answer, typename Hole>
+Answer reset(std::function<Answer()> f)
+{
+  return eff::handle<Reset<Answer, Hole>>(f);
+}
+
+template <typename Answer, typename Hole>
+Hole shift0(std::function<Answer(std::function<Answer(Hole)>)> e)
+{
+  return eff::invoke_command(Shift0<Answer, Hole>{{},
+    [=](eff::resumption<Answer(Hole)> k) -> Answer {
+      return e([k = k.release()](Hole out) -> Answer {
+        return eff::resumption<Answer(Hole)>(k).resume(out);
+      });
+    }
+  });
+}
+
+// ----------------------------------------
+// Handlers between the delimiter and shift
+// ----------------------------------------
+
+struct Ask : eff::command<int> { };
+
+class Reader : public eff::flat_handler<int, Ask> {
+  int handle_command(Ask, eff::resumption<int(int)> r) final override
+  {
+    return std::move(r).tail_resume(0);
+  }
+};
+
+int under(int depth, const std::function<int()>& f)
+{
+  if (depth == 0) { return f(); }
+  return eff::handle<Reader>([&](){ return under(depth - 1, f); });
+}
+
+// --------
+// Programs
+// --------
+
+// Delimit a computation and resume the subcontinuation once
+
+void testHandlerOnce(int max)
+{
+  for (int i = 0; i < max; i++) {
+    SUM += reset<int, int>([=](){
+      return shift0<int, int>([=](auto k) { return k(i); }) + 1;
+    });
+  }
+}
+
+void testPromptOnce(int max)
+{
+  auto p = eff::new_prompt<int>();
+  for (int i = 0; i < max; i++) {
+    SUM += eff::push_prompt(p, [=](){
+      return eff::take_subcont<int>(p, [=](auto k) { return eff::push_subcont(std::move(k), i); }) + 1;
+    });
+  }
+}
+
+// A generator: the subcontinuation is stored by the shift, and
+// resumed by a loop outside of the delimiter
+
+void testHandlerGenerator(int max, int depth)
+{
+  std::function<int(int)> saved;
+  reset<int, int>([&](){
+    return under(depth, [&](){
+      for (int i = 0; i < max; i++) {
+        SUM += shift0<int, int>([&](auto k) { saved = k; return 0; });
+      }
+      return 0;
+    });
+  });
+  for (int i = 0; i < max; i++) {
+    auto k = std::move(saved);
+    k(i);
+  }
+}
+
+void testPromptGenerator(int max, int depth)
+{
+  auto p = eff::new_prompt<int>();
+  eff::resumption<int(int)> saved;
+  eff::push_prompt(p, [&](){
+    return under(depth, [&](){
+      for (int i = 0; i < max; i++) {
+        SUM += eff::take_subcont<int>(p, [&](auto k) { saved = std::move(k); return 0; });
+      }
+      return 0;
+    });
+  });
+  for (int i = 0; i < max; i++) {
+    eff::push_subcont(std::move(saved), i);
+  }
+}
+
+// ----------
+// Measuring
+// ----------
+
+template <typename F>
+void measure(const char* name, int64_t iterations, F f)
+{
+  std::cout << name << std::flush;
+  auto begin = std::chrono::high_resolution_clock::now();
+  f();
+  auto end = std::chrono::high_resolution_clock::now();
+  std::cout << std::chrono::duration_cast<std::chrono::nanoseconds>(end-begin).count() << "ns" << " \t(" << (int)(std::chrono::duration_cast<std::chrono::nanoseconds>(end-begin).count() / iterations) << "ns per iteration)" << std::endl;
+}
+
+// ----
+// Main
+// ----
+
+int main()
+{
+  std::cout << "--- prompts: native prompts vs shift0/reset via handlers ---" << std::endl;
+
+  const int ONCE = 200000;
+  std::cout << "delimit and resume once:" << std::endl;
+  measure("  handler: ", ONCE, [](){ testHandlerOnce(ONCE); });
+  measure("  prompt:  ", ONCE, [](){ testPromptOnce(ONCE); });
+
+  // The handler has to be found by a search through the metastack,
+  // while the prompt knows its position
+
+  const int SHIFTS = 200000;
+  for (int depth : {0, 10, 100}) {
+    std::cout << "generator (" << depth << " handlers between delimiter and shift):" << std::endl;
+    measure("  handler: ", SHIFTS, [=](){ testHandlerGenerator(SHIFTS, depth); });
+    measure("  prompt:  ", SHIFTS, [=](){ testPromptGenerator(SHIFTS, depth); });
+  }
+}
@@ -0,0 +1,483 @@
+// C++ Effects library
+// Maciej Pirog, Huawei Edinburgh Research Centre, maciej.pirog@huawei.com
+// License: MIT
+
+// Benchmark: Safe memory reclamation for lock-free data structures
+// used by lightweight threads on many system threads. Every system
+// thread runs a scheduler, and the threads in it yield every few
+// operations. A lightweight thread does not keep pointers to the nodes
+// of a structure across commands, so a system thread is quiescent
+// whenever its scheduler is between resumptions. Epoch-based
+// reclamation (QSBR, see epoch-reclamation.h) announces the quiescent
+// states in the loop of the scheduler, and frees a retired node when
+// every system thread has passed a quiescent state since it was
+// retired, so that the operations themselves need no fences. We compare it with hazard
+// pointers (which publish and validate every pointer before it is
+// dereferenced), and with no reclamation at all. The structures are a
+// Michael-Scott queue, and a map whose buckets are immutable arrays
+// replaced with compare-and-swap.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+#include "cpp-effects/cpp-effects.h"
+#include "cpp-effects/clause-modifiers.h"
+#include "cpp-effects/epoch-reclamation.h"
+#include "cpp-effects/resumption-queues.h"
+
+namespace eff = cpp_effects;
+
+const int MAX_WORKERS = 64;
+
+// Retired nodes with their deleters
+
+struct Retired {
+  void* ptr;
+  void (*deleter)(void*);
+};
+
+template <typename T>
+Retired retired(T* p)
+{
+  return {p, [](void* q) { delete static_cast<T*>(q); }};
+}
+
+void freeAll(std::vector<Retired>& nodes)
+{
+  for (auto& r : nodes) { r.deleter(r.ptr); }
+  nodes.clear();
+}
+
+// The nodes left by the system threads that have stopped are freed
+// when all the threads are done (see Drain)
+
+std::mutex orphansMutex;
+std::vector<Retired> orphans;
+
+void orphan(std::vector<Retired>& nodes)
+{
+  std::lock_guard<std::mutex> lock(orphansMutex);
+  orphans.insert(orphans.end(), nodes.begin(), nodes.end());
+  nodes.clear();
+}
+
+// The number of workers that scans look at is raised by every worker
+// that comes online (a compare-and-swap loop, so that no raise is lost)
+
+void raiseWorkers(std::atomic<int>& workers, int n)
+{
+  int current = workers.load();
+  while (current < n && !workers.compare_exchange_weak(current, n)) { }
+}
+
+// ---------------
+// No reclamation
+// ---------------
+
+// Retired nodes are freed only when the benchmark is over
+
+struct Leak {
+  static constexpr const char* name = "no reclamation:  ";
+  static thread_local std::vector<Retired> retiredNodes;
+
+  static void Online(int) { }
+  static void Offline() { orphan(retiredNodes); }
+  static void Quiescent() { }
+  template <typename T>
+  static T* Protect(int, const std::atomic<T*>& src) { return src.load(std::memory_order_acquire); }
+  static void Clear() { }
+  template <typename T>
+  static void Retire(T* p) { retiredNodes.push_back(retired(p)); }
+  static void Drain()
+  {
+    freeAll(retiredNodes);
+    freeAll(orphans);
+  }
+};
+
+thread_local std::vector<Retired> Leak::retiredNodes;
+
+// ---------------
+// Hazard pointers
+// ---------------
+
+struct HazardPointers {
+  static constexpr const char* name = "hazard pointers: ";
+  static const int K = 2;  // Hazard pointers per thread
+
+  struct alignas(64) Slots {
+    std::atomic<void*> hp[K];
+  };
+  static Slots slots[MAX_WORKERS];
+  static std::atomic<int> workers;
+  static thread_local int me;
+  static thread_local std::vector<Retired> retiredNodes;
+
+  static void Online(int id)
+  {
+    me = id;
+    raiseWorkers(workers, id + 1);
+  }
+  static void Offline()
+  {
+    Clear();
+    orphan(retiredNodes);
+  }
+  static void Quiescent() { }
+  template <typename T>
+  static T* Protect(int k, const std::atomic<T*>& src)
+  {
+    T* p = src.load(std::memory_order_relaxed);
+    while (true) {
+      slots[me].hp[k].store(p, std::memory_order_seq_cst);
+      T* q = src.load(std::memory_order_acquire);
+      if (p == q) { return p; }
+      p = q;
+    }
+  }
+  static void Clear()
+  {
+    for (int k = 0; k < K; k++) { slots[me].hp[k].store(nullptr, std::memory_order_release); }
+  }
+  template <typename T>
+  static void Retire(T* p)
+  {
+    retiredNodes.push_back(retired(p));
+    if ((int)retiredNodes.size() >= 2 * K * workers + 64) { Scan(); }
+  }
+  // Free the retired nodes that are not protected by any thread
+  static void Scan()
+  {
+    std::vector<void*> hazards;
+    for (int i = 0; i < workers; i++) {
+      for (int k = 0; k < K; k++) {
+        if (void* p = slots[i].hp[k].load(std::memory_order_seq_cst)) { hazards.push_back(p); }
+      }
+    }
+    std::sort(hazards.begin(), hazards.end());
+    auto kept = std::partition(retiredNodes.begin(), retiredNodes.end(), [&](const Retired& r) {
+      return std::binary_search(hazards.begin(), hazards.end(), r.ptr);
+    });
+    for (auto it = kept; it != retiredNodes.end(); ++it) { it->deleter(it->ptr); }
+    retiredNodes.erase(kept, retiredNodes.end());
+  }
+  static void Drain()
+  {
+    freeAll(retiredNodes);
+    freeAll(orphans);
+  }
+};
+
+HazardPointers::Slots HazardPointers::slots[MAX_WORKERS];
+std::atomic<int> HazardPointers::workers{0};
+thread_local int HazardPointers::me = 0;
+thread_local std::vector<Retired> HazardPointers::retiredNodes;
+
+// -------------------------------------------
+// Epoch-based reclamation (quiescent states)
+// -------------------------------------------
+
+// See epoch-reclamation.h
+
+struct Epochs {
+  static constexpr const char* name = "epochs (QSBR):   ";
+  static eff::epoch_domain domain;
+  static thread_local std::optional<eff::epoch_participant> me;
+
+  static void Online(int) { me.emplace(domain); }
+  static void Offline() { me.reset(); }
+  static void Quiescent() { me->quiescent(); }
+  template <typename T>
+  static T* Protect(int, const std::atomic<T*>& src) { return src.load(std::memory_order_acquire); }
+  static void Clear() { }
+  template <typename T>
+  static void Retire(T* p) { me->retire(p); }
+  static void Drain() { domain.drain(); }
+};
+
+eff::epoch_domain Epochs::domain(MAX_WORKERS);
+thread_local std::optional<eff::epoch_participant> Epochs::me;
+
+// ----------
+// Structures
+// ----------
+
+// Michael-Scott queue
+
+template <typename R>
+class Queue {
+public:
+  Queue()
+  {
+    Node* dummy = new Node;
+    head.store(dummy);
+    tail.store(dummy);
+  }
+  ~Queue()
+  {
+    for (Node* n = head.load(); n; ) {
+      Node* next = n->next.load();
+      delete n;
+      n = next;
+    }
+  }
+  void Push(uint64_t value)
+  {
+    Node* n = new Node;
+    n->value = value;
+    while (true) {
+      Node* t = R::Protect(0, tail);
+      Node* next = t->next.load();
+      if (t != tail.load()) { continue; }
+      if (next) {
+        tail.compare_exchange_weak(t, next);
+      } else if (t->next.compare_exchange_weak(next, n)) {
+        tail.compare_exchange_strong(t, n);
+        break;
+      }
+    }
+    R::Clear();
+  }
+  bool Pop(uint64_t& value)
+  {
+    while (true) {
+      Node* h = R::Protect(0, head);
+      Node* t = tail.load();
+      Node* next = R::Protect(1, h->next);
+      if (h != head.load()) { continue; }
+      if (!next) {
+        R::Clear();
+        return false;
+      }
+      if (h == t) {
+        tail.compare_exchange_weak(t, next);
+        continue;
+      }
+      value = next->value;
+      if (head.compare_exchange_weak(h, next)) {
+        R::Clear();
+        R::Retire(h);
+        return true;
+      }
+    }
+  }
+private:
+  struct Node {
+    std::atomic<Node*> next{nullptr};
+    uint64_t value = 0;
+  };
+  alignas(64) std::atomic<Node*> head;
+  alignas(64) std::atomic<Node*> tail;
+};
+
+// A map with a fixed number of buckets. A bucket is an immutable array
+// of entries, and an update replaces it with an updated copy.
+
+template <typename R>
+class Map {
+public:
+  Map(std::size_t size) : size(size), buckets(new std::atomic<Bucket*>[size])
+  {
+    for (std::size_t i = 0; i < size; i++) { buckets[i].store(nullptr); }
+  }
+  ~Map()
+  {
+    for (std::size_t i = 0; i < size; i++) { delete buckets[i].load(); }
+  }
+  bool Get(uint64_t key, uint64_t& value)
+  {
+    Bucket* b = R::Protect(0, buckets[key % size]);
+    bool found = false;
+    if (b) {
+      for (auto& e : b->entries) {
+        if (e.first == key) { value = e.second; found = true; break; }
+      }
+    }
+    R::Clear();
+    return found;
+  }
+  void Put(uint64_t key, uint64_t value)
+  {
+    std::atomic<Bucket*>& slot = buckets[key % size];
+    while (true) {
+      Bucket* old = R::Protect(0, slot);
+      Bucket* b = old ? new Bucket(*old) : new Bucket;
+      auto it = std::find_if(b->entries.begin(), b->entries.end(), [&](auto& e) { return e.first == key; });
+      if (it != b->entries.end()) { it->second = value; } else { b->entries.push_back({key, value}); }
+      if (slot.compare_exchange_strong(old, b)) {
+        R::Clear();
+        if (old) { R::Retire(old); }
+        return;
+      }
+      delete b;
+    }
+  }
+private:
+  struct Bucket {
+    std::vector<std::pair<uint64_t, uint64_t>> entries;
+  };
+  std::size_t size;
+  std::unique_ptr<std::atomic<Bucket*>[]> buckets;
+};
+
+// ---------
+// Scheduler
+// ---------
+
+// Round-robin scheduler of a system thread, which announces a quiescent
+// state between resumptions
+
+struct Yield : eff::command<> { };
+
+using Res = eff::resumption<void()>;
+
+class Scheduler : public eff::flat_handler<void, eff::no_manage<Yield>> {
+public:
+  template <typename R>
+  static void Run(int id, const std::vector<std::function<void()>>& threads)
+  {
+    R::Online(id);
+    for (auto& f : threads) { ready.push_back(eff::wrap<Scheduler>(f)); }
+    while (!ready.empty()) {
+      ready.pop_front().resume();
+      R::Quiescent();
+    }
+    R::Offline();
+  }
+private:
+  static thread_local eff::resumption_queue<void()> ready;
+  void handle_command(Yield, Res r) override
+  {
+    ready.push_back(std::move(r));
+  }
+};
+
+thread_local eff::resumption_queue<void()> Scheduler::ready;
+
+void yield()
+{
+  eff::static_invoke_command<Scheduler>(Yield{});
+}
+
+// ---------
+// Workloads
+// ---------
+
+const int WORKERS = 4;
+const int THREADS = 8;  // Per worker
+const int OPS = 20000;  // Per thread
+const int YIELD_EVERY = 16;
+
+// Run a lightweight thread per (worker, thread) pair on WORKERS system
+// threads, and return the time
+
+template <typename R>
+int64_t run(std::function<void(int, int)> thread)
+{
+  std::vector<std::thread> workers;
+  auto begin = std::chrono::high_resolution_clock::now();
+  for (int w = 0; w < WORKERS; w++) {
+    workers.emplace_back([w, &thread](){
+      std::vector<std::function<void()>> threads;
+      for (int t = 0; t < THREADS; t++) { threads.push_back([w, t, &thread](){ thread(w, t); }); }
+      Scheduler::Run<R>(w, threads);
+    });
+  }
+  for (auto& t : workers) { t.join(); }
+  auto end = std::chrono::high_resolution_clock::now();
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(end-begin).count();
+}
+
+// Every operation pushes a value and pops a value (false if the
+// result is wrong)
+
+template <typename R>
+bool queue()
+{
+  std::cout << "  " << R::name << std::flush;
+  Queue<R> q;
+  std::atomic<uint64_t> sum{0};
+  int64_t ns = run<R>([&](int w, int t) {
+    uint64_t local = 0;
+    for (int i = 0; i < OPS; i++) {
+      q.Push((uint64_t)(w * THREADS + t) * OPS + i);
+      uint64_t v;
+      if (q.Pop(v)) { local += v; }
+      if (i % YIELD_EVERY == 0) { yield(); }
+    }
+    sum += local;
+  });
+  uint64_t v;
+  uint64_t rest = 0;
+  while (q.Pop(v)) { rest += v; }
+  R::Drain();
+  uint64_t n = (uint64_t)WORKERS * THREADS * OPS;
+  bool ok = sum + rest == n * (n - 1) / 2;
+  std::cout << ns / (WORKERS * THREADS * OPS) << "ns per push and pop"
+            << (ok ? "" : " WRONG") << std::endl;
+  return ok;
+}
+
+// 90% of the operations are lookups, 10% are updates
+
+template <typename R>
+bool map()
+{
+  std::cout << "  " << R::name << std::flush;
+  const uint64_t KEYS = 4096;
+  Map<R> m(1024);
+  R::Online(WORKERS);  // The main thread fills the map
+  for (uint64_t k = 0; k < KEYS; k++) { m.Put(k, k); }
+  R::Offline();
+  R::Drain();
+  std::atomic<int64_t> missing{0};
+  int64_t ns = run<R>([&](int w, int t) {
+    uint64_t seed = w * THREADS + t + 1;
+    for (int i = 0; i < OPS; i++) {
+      seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+      uint64_t key = (seed >> 33) % KEYS;
+      uint64_t v;
+      if (i % 10 == 0) {
+        m.Put(key, key);
+      } else if (!m.Get(key, v) || v != key) {
+        missing++;
+      }
+      if (i % YIELD_EVERY == 0) { yield(); }
+    }
+  });
+  std::cout << ns / (WORKERS * THREADS * OPS) << "ns per operation"
+            << (missing == 0 ? "" : " WRONG") << std::endl;
+  return missing == 0;
+}
+
+// ----
+// Main
+// ----
+
+int main()
+{
+  std::cout << "--- reclamation: epochs vs hazard pointers ---" << std::endl;
+  std::cout << WORKERS << " system threads, " << THREADS << " lightweight threads each:" << std::endl;
+
+  bool ok = true;
+  std::cout << "queue:" << std::endl;
+  ok = queue<Leak>() && ok;
+  ok = queue<HazardPointers>() && ok;
+  ok = queue<Epochs>() && ok;
+
+  std::cout << "map:" << std::endl;
+  ok = map<Leak>() && ok;
+  ok = map<HazardPointers>() && ok;
+  ok = map<Epochs>() && ok;
+
+  return ok ? 0 : 1;
+}
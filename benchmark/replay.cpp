@@ -0,0 +1,389 @@
+// C++ Effects library
+// Maciej Pirog, Huawei Edinburgh Research Centre, maciej.pirog@huawei.com
+// License: MIT
+
+// Benchmark: Multi-shot resumptions by replay. Resumptions in the
+// library are one-shot (and cloning a fiber is not safe in general),
+// so a handler of nondeterminism that needs to resume the same
+// computation many times re-runs the body from the start instead. The
+// handler keeps the log of the answers to the commands, and a
+// "resumption" is the body with the log up to the choice point. Every
+// command whose answer the body observes is logged, not only choices:
+// e.g., an answer of Input comes from the environment, which can change
+// between the runs, so a replayed run must see the logged answer. The
+// log is replayed by a plain clause, so replaying does not switch
+// contexts: only a new choice point (or a failure) leaves the body. All
+// the runs of a search share one log (the runs are nested, so a
+// resumption truncates the log to its choice point), so resuming does
+// not copy the log. We compare it with re-running the body in a handler
+// that answers every replayed command by resuming the body (with the
+// same shared log), and with the usual backtracking without effects,
+// on the search for all the solutions to the n-queens problem (where
+// the logs are short, and the cost of a run is dominated by creating
+// the handler and its fiber, so replay is only a few percent faster),
+// and on resuming a body at the end of a long log (where replay is a
+// few times faster).
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <optional>
+#include <vector>
+
+#include "cpp-effects/cpp-effects.h"
+#include "cpp-effects/clause-modifiers.h"
+
+namespace eff = cpp_effects;
+
+using Log = std::vector<uint32_t>;
+
+int64_t runs = 0;  // Executions of the body
+
+// The environment, which gives a different value every time it is read
+
+uint32_t environment()
+{
+  static uint32_t next = 0;
+  return next++;
+}
+
+template <typename T>
+void append(std::vector<T>& xs, std::vector<T>&& ys)
+{
+  xs.insert(xs.end(), std::make_move_iterator(ys.begin()), std::make_move_iterator(ys.end()));
+}
+
+namespace Replay {
+
+// ---------------------------
+// Resumptions by replay
+// ---------------------------
+
+struct Next : eff::command<std::optional<uint32_t>> { };  // The next logged answer
+struct Choose : eff::command<uint32_t> { uint32_t n; };
+struct Fail : eff::command<> { };
+struct Input : eff::command<uint32_t> { };  // A value from the environment
+
+template <typename T>
+std::vector<T> run(const std::function<T()>& body, Log& log);
+
+// A multi-shot resumption: the body and the log of the answers up to
+// the choice point. All the runs of a search share one log, and the
+// runs are nested (a run resumes the body at its choice point in the
+// clause of Choose), so a resumption only truncates the log to its
+// point, and no log is copied.
+
+template <typename T>
+class Resumption {
+public:
+  Resumption(const std::function<T()>& body, Log& log, std::size_t point)
+    : body(body), log(log), at(point) { }
+  std::size_t point() const { return at; }
+  std::vector<T> resume(uint32_t x) const
+  {
+    log.resize(at);
+    log.push_back(x);
+    return run(body, log);
+  }
+private:
+  const std::function<T()>& body;
+  Log& log;
+  std::size_t at;
+};
+
+// All the results of the body. The clauses of Choose and Fail do not
+// resume the body, but they are not no_resume: a no_resume clause runs
+// on top of the fiber of the handler, and the nested runs started by
+// Choose were slower that way (by about 20% per run on n-queens).
+
+template <typename T>
+class Search : public eff::handler<std::vector<T>, T,
+    eff::plain<Next>, Choose, Fail, eff::plain<Input>> {
+public:
+  Search(const std::function<T()>& body, Log& log) : body(body), log(log) { runs++; }
+private:
+  const std::function<T()>& body;
+  Log& log;
+  std::size_t pos = 0;
+  std::optional<uint32_t> handle_command(Next) override
+  {
+    if (pos < log.size()) { return log[pos++]; }
+    return {};
+  }
+  uint32_t handle_command(Input) override
+  {
+    log.push_back(environment());
+    pos++;
+    return log.back();
+  }
+  std::vector<T> handle_command(Choose c, eff::resumption<std::vector<T>(uint32_t)>) override
+  {
+    // The body has replayed the whole log, so the choice point is at
+    // its end
+    Resumption<T> k(body, log, log.size());
+    std::vector<T> results;
+    for (uint32_t i = 0; i < c.n; i++) { append(results, k.resume(i)); }
+    log.resize(k.point());
+    return results;
+  }
+  std::vector<T> handle_command(Fail, eff::resumption<std::vector<T>()>) override
+  {
+    return {};
+  }
+  std::vector<T> handle_return(T x) override
+  {
+    return {x};
+  }
+};
+
+template <typename T>
+uint32_t choose(uint32_t n)
+{
+  if (auto x = eff::static_invoke_command<Search<T>>(Next{})) { return *x; }
+  return eff::static_invoke_command<Search<T>>(Choose{{}, n});
+}
+
+template <typename T>
+void fail()
+{
+  eff::static_invoke_command<Search<T>>(Fail{});
+}
+
+template <typename T>
+uint32_t input()
+{
+  if (auto x = eff::static_invoke_command<Search<T>>(Next{})) { return *x; }
+  return eff::static_invoke_command<Search<T>>(Input{});
+}
+
+// Run the body replaying the log
+
+template <typename T>
+std::vector<T> run(const std::function<T()>& body, Log& log)
+{
+  return eff::handle<Search<T>>(body, body, log);
+}
+
+template <typename T>
+std::vector<T> run(const std::function<T()>& body)
+{
+  Log log;
+  return run(body, log);
+}
+
+}
+
+namespace Naive {
+
+// ------------------------------------------
+// Re-running with every command in the handler
+// ------------------------------------------
+
+struct Choose : eff::command<uint32_t> { uint32_t n; };
+struct Fail : eff::command<> { };
+struct Input : eff::command<uint32_t> { };
+
+template <typename T>
+std::vector<T> run(const std::function<T()>& body, Log& log);
+
+// The runs share one log, as in Replay
+
+template <typename T>
+class Search : public eff::handler<std::vector<T>, T, Choose, Fail, Input> {
+public:
+  Search(const std::function<T()>& body, Log& log) : body(body), log(log) { runs++; }
+private:
+  const std::function<T()>& body;
+  Log& log;
+  std::size_t pos = 0;
+  std::vector<T> handle_command(Choose c, eff::resumption<std::vector<T>(uint32_t)> r) override
+  {
+    if (pos < log.size()) { return std::move(r).tail_resume(log[pos++]); }
+    std::size_t point = log.size();
+    std::vector<T> results;
+    for (uint32_t i = 0; i < c.n; i++) {
+      log.resize(point);
+      log.push_back(i);
+      append(results, run(body, log));
+    }
+    log.resize(point);
+    return results;
+  }
+  std::vector<T> handle_command(Fail, eff::resumption<std::vector<T>()>) override
+  {
+    return {};
+  }
+  std::vector<T> handle_command(Input, eff::resumption<std::vector<T>(uint32_t)> r) override
+  {
+    if (pos == log.size()) { log.push_back(environment()); }
+    return std::move(r).tail_resume(log[pos++]);
+  }
+  std::vector<T> handle_return(T x) override
+  {
+    return {x};
+  }
+};
+
+template <typename T>
+uint32_t choose(uint32_t n)
+{
+  return eff::static_invoke_command<Search<T>>(Choose{{}, n});
+}
+
+template <typename T>
+void fail()
+{
+  eff::static_invoke_command<Search<T>>(Fail{});
+}
+
+template <typename T>
+uint32_t input()
+{
+  return eff::static_invoke_command<Search<T>>(Input{});
+}
+
+template <typename T>
+std::vector<T> run(const std::function<T()>& body, Log& log)
+{
+  return eff::handle<Search<T>>(body, body, log);
+}
+
+template <typename T>
+std::vector<T> run(const std::function<T()>& body)
+{
+  Log log;
+  return run(body, log);
+}
+
+}
+
+// --------
+// N-queens
+// --------
+
+using Board = std::vector<uint32_t>;  // The column of the queen in each row
+
+bool safe(const Board& b, uint32_t col)
+{
+  uint32_t row = b.size();
+  for (uint32_t r = 0; r < row; r++) {
+    if (b[r] == col || b[r] + (row - r) == col || col + (row - r) == b[r]) { return false; }
+  }
+  return true;
+}
+
+template <typename Choose, typename Fail>
+Board queens(uint32_t n, Choose choose, Fail fail)
+{
+  Board b;
+  for (uint32_t row = 0; row < n; row++) {
+    uint32_t col = choose(n);
+    if (!safe(b, col)) { fail(); }
+    b.push_back(col);
+  }
+  return b;
+}
+
+// Backtracking without effects
+
+void directQueens(uint32_t n, Board& b, std::vector<Board>& results)
+{
+  if (b.size() == n) { results.push_back(b); return; }
+  for (uint32_t col = 0; col < n; col++) {
+    if (!safe(b, col)) { continue; }
+    b.push_back(col);
+    directQueens(n, b, results);
+    b.pop_back();
+  }
+}
+
+// ----------
+// Measuring
+// ----------
+
+// Reports the time per replayed command if given their number, and
+// per execution of the body otherwise
+
+template <typename F>
+std::vector<Board> measure(const char* name, F f, int64_t replayed = 0)
+{
+  std::cout << name << std::flush;
+  runs = 0;
+  auto begin = std::chrono::high_resolution_clock::now();
+  std::vector<Board> results = f();
+  auto end = std::chrono::high_resolution_clock::now();
+  auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(end-begin).count();
+  std::cout << ns << "ns \t(" << results.size() << " solutions";
+  if (replayed > 0) {
+    std::cout << ", " << ns / replayed << "ns per replayed command";
+  } else if (runs > 0) {
+    std::cout << ", " << runs << " runs, " << ns / runs << "ns per run";
+  }
+  std::cout << ")" << std::endl;
+  return results;
+}
+
+// ----
+// Main
+// ----
+
+int main()
+{
+  std::cout << "--- replay: multi-shot resumptions by replay vs re-running in the handler ---" << std::endl;
+
+  const uint32_t N = 8;
+
+  auto direct = measure("backtracking:       ", [&](){
+    Board b;
+    std::vector<Board> results;
+    directQueens(N, b, results);
+    return results;
+  });
+  auto naive = measure("re-running:         ", [&](){
+    return Naive::run<Board>([&](){
+      return queens(N, Naive::choose<Board>, Naive::fail<Board>);
+    });
+  });
+  auto replay = measure("replay:             ", [&](){
+    return Replay::run<Board>([&](){
+      return queens(N, Replay::choose<Board>, Replay::fail<Board>);
+    });
+  });
+  bool agree = direct == naive && direct == replay;
+
+  // The cost of replaying alone: resume a body at the end of a long log
+  const uint32_t LENGTH = 1000000;
+  Log log(LENGTH - 1, 1);
+  auto longBody = [&](auto choose) {
+    Board b;
+    for (uint32_t i = 0; i < LENGTH; i++) { b.push_back(choose(2)); }
+    return b;
+  };
+  std::cout << "a log of " << LENGTH << " commands:" << std::endl;
+  naive = measure("  re-running:       ", [&](){
+    Log full(log);
+    full.push_back(1);
+    return Naive::run<Board>([&](){ return longBody(Naive::choose<Board>); }, full);
+  }, LENGTH);
+  replay = measure("  replay:           ", [&](){
+    std::function<Board()> body = [&](){ return longBody(Replay::choose<Board>); };
+    return Replay::Resumption<Board>(body, log, log.size()).resume(1);
+  }, LENGTH);
+  agree = agree && naive == replay && naive.size() == 1;
+
+  // A replayed run sees the logged input, not a new one, so all the
+  // results have the same first element
+  auto inputBody = [&](auto input, auto choose) {
+    uint32_t x = input();
+    return Board{x, choose(3)};
+  };
+  naive = Naive::run<Board>([&](){ return inputBody(Naive::input<Board>, Naive::choose<Board>); });
+  replay = Replay::run<Board>([&](){ return inputBody(Replay::input<Board>, Replay::choose<Board>); });
+  for (auto* rs : {&naive, &replay}) {
+    agree = agree && rs->size() == 3;
+    for (uint32_t i = 0; i < rs->size(); i++) { agree = agree && (*rs)[i] == Board{(*rs)[0][0], i}; }
+  }
+  std::cout << "results " << (agree ? "agree" : "DIFFER") << std::endl;
+  return agree ? 0 : 1;
+}
@@ -0,0 +1,105 @@
+// C++ Effects library
+// Maciej Pirog, Huawei Edinburgh Research Centre, maciej.pirog@huawei.com
+// License: MIT
+
+// Benchmark: Lightweight threads that await senders in the style of
+// P2300 (std::execution), using the adapter in cpp-effects/senders.h.
+// The operation state and the result live on the stack of the thread,
+// so awaiting does not allocate. We compare with the same chain of
+// operations written with callbacks on the same run loop.
+
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+#include "cpp-effects/cpp-effects.h"
+#include "cpp-effects/senders.h"
+
+namespace eff = cpp_effects;
+
+using Loop = eff::sender_loop;
+
+// ---------
+// Workloads
+// ---------
+
+const int THREADS = 100;
+const int STEPS = 10000;  // Per thread
+
+int64_t SUM = 0;
+
+// Every step of a thread awaits a sender
+
+template <typename MakeSender>
+void threads(MakeSender make)
+{
+  for (int t = 0; t < THREADS; t++) {
+    Loop::spawn([make](){
+      int64_t x = 0;
+      for (int i = 0; i < STEPS; i++) { x = eff::await_sender(make(x)); }
+      SUM += x;
+    });
+  }
+  Loop::run();
+}
+
+// The same steps as a chain of callbacks: every step schedules the
+// next one on the loop (the state of a chain is posted as a task)
+
+void callbacks()
+{
+  struct Chain : eff::sender_task {
+    int64_t x = 0;
+    int step = 0;
+  };
+  std::vector<Chain> chains(THREADS);
+  for (auto& c : chains) {
+    c.run = [](eff::sender_task* t) {
+      Chain* c = static_cast<Chain*>(t);
+      c->x = c->x + 1;
+      if (++c->step < STEPS) { Loop::post(c); } else { SUM += c->x; }
+    };
+    Loop::post(&c);
+  }
+  Loop::run();
+}
+
+// ----------
+// Measuring
+// ----------
+
+// Returns false if the sum is wrong
+
+template <typename F>
+bool measure(const char* name, int64_t iterations, F f)
+{
+  std::cout << name << std::flush;
+  SUM = 0;
+  auto begin = std::chrono::high_resolution_clock::now();
+  f();
+  auto end = std::chrono::high_resolution_clock::now();
+  std::cout << std::chrono::duration_cast<std::chrono::nanoseconds>(end-begin).count() << "ns" << " \t(" << (int)(std::chrono::duration_cast<std::chrono::nanoseconds>(end-begin).count() / iterations) << "ns per step)"
+            << (SUM == (int64_t)THREADS * STEPS ? "" : " WRONG") << std::endl;
+  return SUM == (int64_t)THREADS * STEPS;
+}
+
+// ----
+// Main
+// ----
+
+int main()
+{
+  std::cout << "--- senders: awaiting senders in lightweight threads vs callbacks ---" << std::endl;
+
+  const int64_t N = THREADS * STEPS;
+  bool ok = true;
+  ok = measure("await just | then:       ", N, [](){
+    threads([](int64_t x) { return eff::then(eff::just(x), [](int64_t y) { return y + 1; }); });
+  }) && ok;
+  ok = measure("await schedule | then:   ", N, [](){
+    threads([](int64_t x) { return eff::then(Loop::schedule(), [x]() { return x + 1; }); });
+  }) && ok;
+  ok = measure("callbacks on the loop:   ", N, [](){ callbacks(); }) && ok;
+  return ok ? 0 : 1;
+}
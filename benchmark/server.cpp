@@ -0,0 +1,310 @@
+// C++ Effects library
+// Maciej Pirog, Huawei Edinburgh Research Centre, maciej.pirog@huawei.com
+// License: MIT
+
+// Benchmark: A request server over Unix domain sockets, using the
+// framework from cpp-effects/unix-server.h. Each system thread runs an
+// I/O loop, which accepts connections and runs every connection in a
+// lightweight thread. A request handler is a straight-line function
+// that reads lines from the connection: the reader invokes the command
+// need_input when it runs out of input, and the handler of need_input
+// reads from the socket (suspending the
+// thread until the socket is readable). Responses are buffered, and
+// flushed when the handler needs more input. We compare with a server
+// in the callback style, which keeps the state of the protocol of each
+// connection in a state machine. Both are loaded by a closed-loop load
+// generator that measures the latency of each request.
+//
+// The protocol: a request is "SUM n" followed by n lines with
+// numbers, and the response is a line with their sum.
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "cpp-effects/cpp-effects.h"
+#include "cpp-effects/unix-server.h"
+
+namespace eff = cpp_effects;
+
+int64_t now()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// ---------------------------------
+// Server with lightweight threads
+// ---------------------------------
+
+// The request handler is a straight-line function (run by
+// unix_server::serve for every connection)
+
+void sumHandler(eff::connection& conn)
+{
+  while (auto header = conn.read_line()) {
+    int64_t count = std::atoll(header->data() + 4);  // "SUM n"
+    int64_t sum = 0;
+    for (int64_t i = 0; i < count; i++) {
+      auto line = conn.read_line();
+      if (!line) { return; }
+      sum += std::atoll(line->data());
+    }
+    conn.write(std::to_string(sum));
+    conn.write("\n");
+  }
+}
+
+// ------------------------
+// Server with callbacks
+// ------------------------
+
+// The same protocol with a loop that calls a callback for each line,
+// and the state of the request kept between the callbacks
+
+struct CallbackConnection {
+  int fd;
+  std::string input;
+  std::string output;
+  int64_t remaining = -1;  // Lines of the current request, -1 before the header
+  int64_t sum = 0;
+};
+
+void onLine(CallbackConnection& c, std::string_view line)
+{
+  if (c.remaining < 0) {
+    c.remaining = std::atoll(line.data() + 4);
+    c.sum = 0;
+  } else {
+    c.sum += std::atoll(line.data());
+    c.remaining--;
+  }
+  if (c.remaining == 0) {
+    c.output.append(std::to_string(c.sum));
+    c.output.append("\n");
+    c.remaining = -1;
+  }
+}
+
+// Returns false if the connection is closed
+
+bool onReadable(CallbackConnection& c)
+{
+  char buffer[16 * 1024];
+  while (true) {
+    ssize_t n = ::read(c.fd, buffer, sizeof(buffer));
+    if (n == 0 || (n < 0 && errno != EAGAIN)) { return false; }
+    if (n < 0) { break; }
+    c.input.append(buffer, n);
+  }
+  std::size_t pos = 0;
+  while (true) {
+    std::size_t nl = c.input.find('\n', pos);
+    if (nl == std::string::npos) { break; }
+    onLine(c, std::string_view(c.input.data() + pos, nl - pos));
+    pos = nl + 1;
+  }
+  c.input.erase(0, pos);
+  return true;
+}
+
+void flush(CallbackConnection& c)
+{
+  ssize_t n = ::write(c.fd, c.output.data(), c.output.size());
+  if (n > 0) { c.output.erase(0, n); }
+}
+
+void serveCallbacks(eff::unix_server& server, int loops)
+{
+  int listenFd = server.socket();
+  std::vector<std::thread> threads;
+  for (int i = 0; i < loops; i++) {
+    threads.emplace_back([&server, listenFd](){
+      std::vector<pollfd> fds{{listenFd, POLLIN, 0}};
+      std::vector<CallbackConnection> conns;  // conns[i] is fds[i + 1]
+      while (true) {
+        ::poll(fds.data(), fds.size(), -1);
+        if (server.stopping()) { break; }
+        for (std::size_t i = 1; i < fds.size(); ) {
+          CallbackConnection& c = conns[i - 1];
+          bool open = true;
+          if (fds[i].revents & (POLLIN | POLLHUP | POLLERR)) { open = onReadable(c); }
+          if (open && !c.output.empty()) { flush(c); }
+          if (!open) {
+            ::close(c.fd);
+            fds[i] = fds.back();
+            fds.pop_back();
+            conns[i - 1] = std::move(conns.back());
+            conns.pop_back();
+            continue;
+          }
+          fds[i].events = c.output.empty() ? POLLIN : POLLIN | POLLOUT;
+          i++;
+        }
+        if (fds[0].revents & POLLIN) {
+          int fd = ::accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK);
+          if (fd >= 0) {
+            fds.push_back({fd, POLLIN, 0});
+            conns.push_back(CallbackConnection{fd, {}, {}});
+          }
+        }
+      }
+      for (auto& c : conns) { ::close(c.fd); }
+    });
+  }
+  for (auto& t : threads) { t.join(); }
+}
+
+// --------------
+// Load generator
+// --------------
+
+// Every client thread keeps a number of connections busy: it sends a
+// request on each, and sends the next one when the response arrives.
+
+int connectTo(const std::string& path)
+{
+  int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  sockaddr_un addr{};
+  addr.sun_family = AF_UNIX;
+  std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+  if (::connect(fd, (sockaddr*)&addr, sizeof(addr)) != 0) {
+    std::perror("connect");
+    std::exit(1);
+  }
+  return fd;
+}
+
+const int NUMBERS = 4;  // Numbers per request
+
+struct ClientConnection {
+  int fd;
+  int64_t sent = 0;
+  int64_t sentAt = 0;
+  int64_t expected = 0;
+  std::string input;
+};
+
+void sendRequest(ClientConnection& c)
+{
+  std::string request = "SUM " + std::to_string(NUMBERS) + "\n";
+  c.expected = 0;
+  for (int i = 0; i < NUMBERS; i++) {
+    int64_t x = c.sent * NUMBERS + i;
+    request += std::to_string(x) + "\n";
+    c.expected += x;
+  }
+  c.sent++;
+  c.sentAt = now();
+  if (::write(c.fd, request.data(), request.size()) != (ssize_t)request.size()) {
+    std::perror("write");
+    std::exit(1);
+  }
+}
+
+void client(const std::string& path, int conns, int64_t requests, std::vector<int64_t>& latencies,
+            bool& wrong)
+{
+  std::vector<ClientConnection> cs;
+  std::vector<pollfd> fds;
+  for (int i = 0; i < conns; i++) {
+    cs.push_back({connectTo(path), 0, 0, 0, {}});
+    fds.push_back({cs.back().fd, POLLIN, 0});
+  }
+  int64_t perConnection = requests / conns;
+  int active = conns;
+  for (auto& c : cs) { sendRequest(c); }
+  while (active > 0) {
+    ::poll(fds.data(), fds.size(), -1);
+    for (int i = 0; i < conns; i++) {
+      if (!(fds[i].revents & POLLIN)) { continue; }
+      ClientConnection& c = cs[i];
+      char buffer[4096];
+      ssize_t n = ::read(c.fd, buffer, sizeof(buffer));
+      if (n <= 0) { std::perror("read"); std::exit(1); }
+      c.input.append(buffer, n);
+      std::size_t nl = c.input.find('\n');
+      if (nl == std::string::npos) { continue; }
+      latencies.push_back(now() - c.sentAt);
+      if (std::atoll(c.input.c_str()) != c.expected) { wrong = true; }
+      c.input.erase(0, nl + 1);
+      if (c.sent < perConnection) {
+        sendRequest(c);
+      } else {
+        fds[i].events = 0;
+        active--;
+      }
+    }
+  }
+  for (auto& c : cs) { ::close(c.fd); }
+}
+
+// Run the server (in the background) and the clients, and report the
+// throughput and the percentiles of latency
+
+const int CLIENTS = 2;
+const int CONNECTIONS = 16;  // Per client
+const int64_t REQUESTS = 100000;
+
+template <typename Server>
+void measure(const char* name, const std::string& path, int loops, Server server)
+{
+  std::cout << name << std::flush;
+  eff::unix_server srv(path);
+  std::thread serverThread([&](){ server(srv, loops); });
+
+  std::vector<std::vector<int64_t>> latencies(CLIENTS);
+  bool wrong[CLIENTS] = {};
+  auto begin = now();
+  std::vector<std::thread> clients;
+  for (int i = 0; i < CLIENTS; i++) {
+    clients.emplace_back([&, i](){
+      client(path, CONNECTIONS, REQUESTS / CLIENTS, latencies[i], wrong[i]);
+    });
+  }
+  for (auto& t : clients) { t.join(); }
+  auto end = now();
+
+  srv.stop();
+  serverThread.join();
+
+  std::vector<int64_t> all;
+  for (auto& l : latencies) { all.insert(all.end(), l.begin(), l.end()); }
+  std::sort(all.begin(), all.end());
+  auto percentile = [&](double p) { return all[std::min(all.size() - 1, (std::size_t)(p * all.size()))] / 1000; };
+  std::cout << (int64_t)(all.size() * 1e9 / (end - begin)) << " req/s, latency p50: " << percentile(0.5)
+            << "us, p99: " << percentile(0.99) << "us, p99.9: " << percentile(0.999) << "us"
+            << (std::any_of(wrong, wrong + CLIENTS, [](bool w) { return w; }) ? " WRONG" : "") << std::endl;
+}
+
+// ----
+// Main
+// ----
+
+int main()
+{
+  std::cout << "--- server: request handlers in lightweight threads vs callbacks ---" << std::endl;
+
+  std::string path = "/tmp/cpp-effects-bench-server-" + std::to_string(::getpid()) + ".sock";
+  int loops = std::max(1, std::min(4, (int)std::thread::hardware_concurrency()));
+  std::cout << loops << " loops, " << CLIENTS * CONNECTIONS << " connections, "
+            << REQUESTS << " requests:" << std::endl;
+
+  measure("  callbacks:           ", path, loops, serveCallbacks);
+  measure("  lightweight threads: ", path, loops, [](eff::unix_server& server, int loops) {
+    server.serve(loops, sumHandler);
+  });
+}
@@ -0,0 +1,242 @@
+// C++ Effects library
+// Maciej Pirog, Huawei Edinburgh Research Centre, maciej.pirog@huawei.com
+// License: MIT
+
+// Benchmark: Fixed-size stacks (Boost's default) vs growable stacks of
+// fibers: memory per suspended fiber, the cost of growth in deep
+// recursion, and the cost of creating fibers
+
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <iostream>
+#include <vector>
+
+#include <boost/context/protected_fixedsize_stack.hpp>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "cpp-effects/cpp-effects.h"
+#include "cpp-effects/clause-modifiers.h"
+#include "cpp-effects/growable-stack.h"
+
+namespace eff = cpp_effects;
+
+using Res = eff::resumption<void()>;
+
+// ---------------------------------
+// Handlers with different policies
+// ---------------------------------
+
+struct Yield : eff::command<> { };
+
+struct Consume : eff::command<> { };
+
+// Parks the suspended computations
+
+template <typename StackAllocator>
+class Park : public eff::flat_handler<void, Yield> {
+public:
+  using stack_allocator = StackAllocator;
+  static std::vector<Res> parked;
+private:
+  void handle_command(Yield, Res r) override
+  {
+    parked.push_back(std::move(r));
+  }
+};
+
+template <typename StackAllocator>
+std::vector<Res> Park<StackAllocator>::parked;
+
+// Counts the steps of a computation (as MeasureFuel in
+// examples/fuel.cpp, but with a plain clause)
+
+template <typename StackAllocator>
+class Fuel : public eff::flat_handler<void, eff::plain<Consume>> {
+public:
+  using stack_allocator = StackAllocator;
+  int64_t steps = 0;
+private:
+  void handle_command(Consume) override { steps++; }
+};
+
+// An 8 MiB stack with a guard page, allocated with mmap on every
+// fiber, as an example of a big fixed-size stack
+
+struct BigProtectedStack : boost::context::protected_fixedsize_stack {
+  BigProtectedStack() : boost::context::protected_fixedsize_stack(8 * 1024 * 1024) { }
+};
+
+// A growable stack that keeps all its memory when it goes back to the
+// pool, so the pages touched by one fiber are reused by the next one
+
+struct GrowableKeep : eff::growable_stack {
+  GrowableKeep() : eff::growable_stack(8 * 1024 * 1024, 8 * 1024 * 1024) { }
+};
+
+// --------
+// Programs
+// --------
+
+// Recursion that uses about 256 bytes of stack per level
+
+__attribute__((noinline))
+int64_t deep(int64_t n)
+{
+  volatile char frame[240];
+  frame[0] = (char)n;
+  if (n == 0) { return frame[0]; }
+  return deep(n - 1) + frame[0];
+}
+
+int64_t fib(int64_t n)
+{
+  eff::invoke_command(Consume{});
+  if (n < 2) { return n; }
+  return fib(n - 1) + fib(n - 2);
+}
+
+volatile int64_t SUM = 0;
+
+// ----------
+// Measuring
+// ----------
+
+std::size_t residentBytes()
+{
+  long pages = 0, resident = 0;
+  FILE* f = std::fopen("/proc/self/statm", "r");
+  if (std::fscanf(f, "%ld %ld", &pages, &resident) != 2) { resident = 0; }
+  std::fclose(f);
+  return resident * ::sysconf(_SC_PAGESIZE);
+}
+
+// Run in a separate process, so that the memory freed by one
+// measurement does not influence the next one
+
+template <typename F>
+void isolated(F f)
+{
+  std::cout << std::flush;
+  pid_t pid = fork();
+  if (pid == 0) {
+    f();
+    std::cout << std::flush;
+    _exit(0);
+  }
+  int status;
+  waitpid(pid, &status, 0);
+  if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) { std::cout << "crashed" << std::endl; }
+}
+
+// Suspend FIBERS fibers, each after a recursion of the given depth
+
+const int FIBERS = 2000;
+
+template <typename StackAllocator>
+void memoryPerFiber(const char* name, int64_t depth)
+{
+  isolated([=](){
+    std::cout << name << std::flush;
+    std::size_t before = residentBytes();
+    for (int i = 0; i < FIBERS; i++) {
+      eff::handle<Park<StackAllocator>>([=](){
+        SUM += deep(depth);
+        eff::invoke_command(Yield{});
+      });
+    }
+    std::size_t after = residentBytes();
+    std::cout << (after - before) / FIBERS << " bytes per fiber" << std::endl;
+    Park<StackAllocator>::parked.clear();
+  });
+}
+
+template <typename F>
+void measure(const char* name, int64_t iterations, F f)
+{
+  std::cout << name << std::flush;
+  auto begin = std::chrono::high_resolution_clock::now();
+  f();
+  auto end = std::chrono::high_resolution_clock::now();
+  std::cout << std::chrono::duration_cast<std::chrono::nanoseconds>(end-begin).count() << "ns" << " \t(" << (int)(std::chrono::duration_cast<std::chrono::nanoseconds>(end-begin).count() / iterations) << "ns per iteration)" << std::endl;
+}
+
+// ----
+// Main
+// ----
+
+int main()
+{
+  using Fixed = boost::context::fixedsize_stack;
+  using Growable = eff::growable_stack;
+
+  std::cout << "--- stacks: fixed-size vs growable stacks of fibers ---" << std::endl;
+
+  // Depth 16 is about 4 KiB of stack, depth 128 is about 32 KiB, and
+  // depth 4096 is about 1 MiB, which overflows the default stack
+  // (128 KiB)
+
+  std::cout << "memory per suspended fiber:" << std::endl;
+  for (int64_t depth : {16, 128}) {
+    std::cout << "  depth " << depth << std::endl;
+    memoryPerFiber<Fixed>("    fixed-128k:    ", depth);
+    memoryPerFiber<BigProtectedStack>("    protected-8m:  ", depth);
+    memoryPerFiber<Growable>("    growable:      ", depth);
+  }
+  std::cout << "  depth 4096" << std::endl;
+  std::cout << "    fixed-128k:    (overflows the stack)" << std::endl;
+  memoryPerFiber<BigProtectedStack>("    protected-8m:  ", 4096);
+  memoryPerFiber<Growable>("    growable:      ", 4096);
+
+  // The cost of growth: every fiber starts with a trimmed stack, so a
+  // deep recursion pays for zero-filling the pages it touches (unless
+  // the stack keeps its memory)
+
+  const int RUNS = 1000;
+  std::cout << "deep recursion (depth 4096, about 1 MiB of stack):" << std::endl;
+  measure("  main stack:    ", RUNS, [](){
+    for (int i = 0; i < RUNS; i++) { SUM += deep(4096); }
+  });
+  measure("  protected-8m:  ", RUNS, [](){
+    for (int i = 0; i < RUNS; i++) {
+      eff::handle<Fuel<BigProtectedStack>>([](){ SUM += deep(4096); });
+    }
+  });
+  measure("  growable:      ", RUNS, [](){
+    for (int i = 0; i < RUNS; i++) {
+      eff::handle<Fuel<Growable>>([](){ SUM += deep(4096); });
+    }
+  });
+  measure("  growable-keep: ", RUNS, [](){
+    for (int i = 0; i < RUNS; i++) {
+      eff::handle<Fuel<GrowableKeep>>([](){ SUM += deep(4096); });
+    }
+  });
+
+  // Once the stack has grown, there is no overhead
+
+  std::cout << "fib(30) with a fuel counter:" << std::endl;
+  measure("  fixed-128k:    ", 1, [](){
+    eff::handle<Fuel<Fixed>>([](){ SUM += fib(30); });
+  });
+  measure("  growable:      ", 1, [](){
+    eff::handle<Fuel<Growable>>([](){ SUM += fib(30); });
+  });
+
+  // Creating short-lived fibers
+
+  const int TASKS = 200000;
+  std::cout << "short-lived fibers:" << std::endl;
+  measure("  fixed-128k:    ", TASKS, [](){
+    for (int i = 0; i < TASKS; i++) { eff::handle<Fuel<Fixed>>([=](){ SUM += i; }); }
+  });
+  measure("  protected-8m:  ", TASKS, [](){
+    for (int i = 0; i < TASKS; i++) { eff::handle<Fuel<BigProtectedStack>>([=](){ SUM += i; }); }
+  });
+  measure("  growable:      ", TASKS, [](){
+    for (int i = 0; i < TASKS; i++) { eff::handle<Fuel<Growable>>([=](){ SUM += i; }); }
+  });
+  std::cout << "  (growable stacks mapped: " << Growable::mapped_stacks() << ")" << std::endl;
+}
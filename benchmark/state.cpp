@@ -0,0 +1,140 @@
+// C++ Effects library
+// Maciej Pirog, Huawei Edinburgh Research Centre, maciej.pirog@huawei.com
+// License: MIT
+
+// Benchmark: State using lambdas (HLambda from examples/state.cpp),
+// with the computation interpreted as std::function that captures the
+// released resumption_data (which allocates the closure on the heap if
+// it does not fit the small buffer of std::function, and leaks the
+// resumption if the function is never called) vs resumption_function
+// (which holds the resumption in its own buffer)
+
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <string>
+
+#include "cpp-effects/cpp-effects.h"
+#include "cpp-effects/resumption-function.h"
+
+namespace eff = cpp_effects;
+
+template <typename S>
+struct Put : eff::command<> {
+  S newState;
+};
+
+template <typename S>
+struct Get : eff::command<S> { };
+
+// ---------------------------
+// std::function with release
+// ---------------------------
+
+template <typename Answer, typename S>
+class HStdFunction : public eff::handler<std::function<Answer(S)>, Answer, Put<S>, Get<S>> {
+  std::function<Answer(S)> handle_command(Put<S> p,
+    eff::resumption<std::function<Answer(S)>()> r) override
+  {
+    return [p, r = r.release()](S) -> Answer {
+      return eff::resumption<std::function<Answer(S)>()>(r).resume()(p.newState);
+    };
+  }
+  std::function<Answer(S)> handle_command(Get<S>,
+    eff::resumption<std::function<Answer(S)>(S)> r) override
+  {
+    return [r = r.release()](S s) -> Answer {
+      return eff::resumption<std::function<Answer(S)>(S)>(r).resume(s)(s);
+    };
+  }
+  std::function<Answer(S)> handle_return(Answer a) override
+  {
+    return [a](S){ return a; };
+  }
+};
+
+// -------------------
+// resumption_function
+// -------------------
+
+template <typename Answer, typename S>
+class HResumptionFunction : public eff::handler<eff::resumption_function<Answer(S)>, Answer, Put<S>, Get<S>> {
+  eff::resumption_function<Answer(S)> handle_command(Put<S> p,
+    eff::resumption<eff::resumption_function<Answer(S)>()> r) override
+  {
+    return [p, r = std::move(r)](S) mutable -> Answer {
+      return std::move(r).resume()(p.newState);
+    };
+  }
+  eff::resumption_function<Answer(S)> handle_command(Get<S>,
+    eff::resumption<eff::resumption_function<Answer(S)>(S)> r) override
+  {
+    return [r = std::move(r)](S s) mutable -> Answer {
+      return std::move(r).resume(s)(s);
+    };
+  }
+  eff::resumption_function<Answer(S)> handle_return(Answer a) override
+  {
+    return [a](S){ return a; };
+  }
+};
+
+// --------
+// Workload
+// --------
+
+// Every call of the function resumes the computation in the clause of
+// the previous command, so the (native) stack grows with the number of
+// commands, and we run many short computations
+
+const int COMMANDS = 1000;  // Per computation
+const int RUNS = 1000;
+
+// The answer is a string, which does not fit the small buffer of
+// std::function in the return clause
+
+std::string counter()
+{
+  for (int i = 0; i < COMMANDS / 2; i++) {
+    eff::invoke_command(Put<int>{{}, eff::invoke_command(Get<int>{}) + 1});
+  }
+  return "counted to " + std::to_string(eff::invoke_command(Get<int>{}));
+}
+
+template <typename H>
+std::string run()
+{
+  std::string result;
+  for (int i = 0; i < RUNS; i++) {
+    result = eff::handle<H>(counter)(0);
+  }
+  return result;
+}
+
+// ----------
+// Measuring
+// ----------
+
+template <typename F>
+void measure(const char* name, int64_t iterations, F f)
+{
+  std::cout << name << std::flush;
+  std::string result;
+  auto begin = std::chrono::high_resolution_clock::now();
+  result = f();
+  auto end = std::chrono::high_resolution_clock::now();
+  std::cout << std::chrono::duration_cast<std::chrono::nanoseconds>(end-begin).count() << "ns" << " \t(" << (int)(std::chrono::duration_cast<std::chrono::nanoseconds>(end-begin).count() / iterations) << "ns per command, " << result << ")" << std::endl;
+}
+
+// ----
+// Main
+// ----
+
+int main()
+{
+  std::cout << "--- state: std::function vs resumption_function ---" << std::endl;
+
+  const int64_t N = (int64_t)COMMANDS * RUNS;
+  measure("std::function:        ", N, run<HStdFunction<std::string, int>>);
+  measure("resumption_function:  ", N, run<HResumptionFunction<std::string, int>>);
+}
@@ -0,0 +1,358 @@
+// C++ Effects library
+// Maciej Pirog, Huawei Edinburgh Research Centre, maciej.pirog@huawei.com
+// License: MIT
+
+// Benchmark: Software transactional memory for lightweight threads
+// running on a number of system threads. Transactional reads and
+// writes are commands handled by a transaction handler (in the style
+// of TL2: a global version clock, versioned locks, and read/write sets
+// in memory reused by all the transactions of a system thread). A
+// conflict aborts the transaction by discarding its resumption, and
+// the transaction is run again. A transaction that calls retry is
+// aborted too, and its thread is suspended until one of the variables
+// that it has read changes. We compare bank transfers in transactions
+// with a global lock and with per-account locks.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+#include "cpp-effects/cpp-effects.h"
+#include "cpp-effects/clause-modifiers.h"
+#include "cpp-effects/resumption-queues.h"
+#include "cpp-effects/stm.h"
+
+namespace eff = cpp_effects;
+
+using Res = eff::resumption<void()>;
+
+// --------------------------------------------
+// Multi-core scheduler for lightweight threads
+// --------------------------------------------
+
+// Every system thread (worker) runs a round-robin scheduler of its own
+// lightweight threads. Resumptions have to be resumed in the system
+// thread in which they were captured, so a lightweight thread always
+// stays on its worker, and a thread woken up by another worker is sent
+// to the inbox of its own worker.
+
+struct Yield : eff::command<> { };
+
+class Worker;
+
+thread_local Worker* currentWorker = nullptr;
+
+class Scheduler : public eff::handler<void, void, Yield, eff::stm_await> {
+  void handle_command(Yield, Res r) override;
+  void handle_command(eff::stm_await, Res r) override;
+  void handle_return() override;
+};
+
+class Worker {
+public:
+  // Run the given threads (and the threads woken up by other workers)
+  // until all of them finish
+  void Run(const std::vector<std::function<void()>>& threads)
+  {
+    currentWorker = this;
+    for (auto& f : threads) {
+      live++;
+      ready.push_back(eff::wrap<Scheduler>(f));
+    }
+    while (live > 0) {
+      for (std::size_t n = ready.size(); n > 0; n--) { ready.pop_front().resume(); }
+      if (ready.empty() || mail.load(std::memory_order_acquire)) {
+        std::unique_lock<std::mutex> lock(inboxMutex);
+        if (ready.empty() && live > 0) {
+          inboxCv.wait(lock, [&](){ return !inbox.empty(); });
+        }
+        for (auto& r : inbox) { ready.push_back(std::move(r)); }
+        inbox.clear();
+        mail.store(false, std::memory_order_relaxed);
+      }
+    }
+    currentWorker = nullptr;
+  }
+  // Can be called from any system thread
+  void Wake(Res r)
+  {
+    std::lock_guard<std::mutex> lock(inboxMutex);
+    inbox.push_back(std::move(r));
+    mail.store(true, std::memory_order_release);
+    inboxCv.notify_one();
+  }
+  eff::resumption_queue<void()> ready;
+  int64_t live = 0;
+private:
+  std::mutex inboxMutex;
+  std::condition_variable inboxCv;
+  std::vector<Res> inbox;
+  std::atomic<bool> mail{false};
+};
+
+void Scheduler::handle_command(Yield, Res r)
+{
+  currentWorker->ready.push_back(std::move(r));
+}
+
+void Scheduler::handle_return()
+{
+  currentWorker->live--;
+}
+
+void yield()
+{
+  eff::invoke_command(Yield{});
+}
+
+// A retrying transaction suspends its thread, which is sent back to
+// its worker when one of the variables that it has read changes
+
+void Scheduler::handle_command(eff::stm_await, Res r)
+{
+  Worker* worker = currentWorker;
+  eff::stm_on_change([worker, r = std::move(r)]() mutable { worker->Wake(std::move(r)); });
+}
+
+// Run each group of threads on a separate worker (and discard the
+// runner of transactions of the worker at the end)
+
+void runWorkers(const std::vector<std::vector<std::function<void()>>>& groups)
+{
+  std::vector<Worker> workers(groups.size());
+  std::vector<std::thread> threads;
+  for (std::size_t i = 0; i < groups.size(); i++) {
+    threads.emplace_back([&, i](){
+      workers[i].Run(groups[i]);
+      eff::stm_release_thread();
+    });
+  }
+  for (auto& t : threads) { t.join(); }
+}
+
+// --------------
+// Bank transfers
+// --------------
+
+const int64_t INITIAL = 1000;
+
+struct Account : eff::tvar {
+  Account() : eff::tvar(INITIAL) { }
+};
+
+struct Random {
+  uint64_t x;
+  uint64_t Next()
+  {
+    x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+    return x;
+  }
+};
+
+// Transfer between random accounts (if there are enough funds)
+
+void stmTransfers(std::vector<Account>& accounts, int64_t count, uint64_t seed)
+{
+  Random rnd{seed};
+  for (int64_t i = 0; i < count; i++) {
+    std::size_t from = rnd.Next() % accounts.size();
+    std::size_t to = rnd.Next() % accounts.size();
+    int64_t amount = rnd.Next() % 10 + 1;
+    eff::atomically([&](const eff::tx& tx) {
+      int64_t balance = tx.read(accounts[from]);
+      if (from == to || balance < amount) { return; }
+      tx.write(accounts[from], balance - amount);
+      tx.write(accounts[to], tx.read(accounts[to]) + amount);
+    });
+    if (i % 16 == 0) { yield(); }
+  }
+}
+
+struct LockedAccount {
+  std::mutex m;
+  int64_t balance = INITIAL;
+};
+
+void globalLockTransfers(std::vector<LockedAccount>& accounts, std::mutex& global,
+                         int64_t count, uint64_t seed)
+{
+  Random rnd{seed};
+  for (int64_t i = 0; i < count; i++) {
+    std::size_t from = rnd.Next() % accounts.size();
+    std::size_t to = rnd.Next() % accounts.size();
+    int64_t amount = rnd.Next() % 10 + 1;
+    {
+      std::lock_guard<std::mutex> lock(global);
+      if (from != to && accounts[from].balance >= amount) {
+        accounts[from].balance -= amount;
+        accounts[to].balance += amount;
+      }
+    }
+    if (i % 16 == 0) { yield(); }
+  }
+}
+
+void accountLockTransfers(std::vector<LockedAccount>& accounts, int64_t count, uint64_t seed)
+{
+  Random rnd{seed};
+  for (int64_t i = 0; i < count; i++) {
+    std::size_t from = rnd.Next() % accounts.size();
+    std::size_t to = rnd.Next() % accounts.size();
+    int64_t amount = rnd.Next() % 10 + 1;
+    if (from != to) {
+      std::scoped_lock lock(accounts[std::min(from, to)].m, accounts[std::max(from, to)].m);
+      if (accounts[from].balance >= amount) {
+        accounts[from].balance -= amount;
+        accounts[to].balance += amount;
+      }
+    }
+    if (i % 16 == 0) { yield(); }
+  }
+}
+
+// ----------
+// Measuring
+// ----------
+
+const int THREADS_PER_WORKER = 16;
+const int64_t TRANSFERS = 400000;
+
+template <typename F>
+void measure(const char* name, F f)
+{
+  std::cout << name << std::flush;
+  auto begin = std::chrono::high_resolution_clock::now();
+  f();
+  auto end = std::chrono::high_resolution_clock::now();
+  auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(end-begin).count();
+  std::cout << ns << "ns" << " \t(" << (int)(ns / TRANSFERS) << "ns per transfer, "
+            << (int64_t)(TRANSFERS * 1e9 / ns) << " transfers/s)" << std::flush;
+}
+
+// Create the threads of the workers, each with a different seed
+
+template <typename F>
+std::vector<std::vector<std::function<void()>>> groups(int workers, F f)
+{
+  std::vector<std::vector<std::function<void()>>> gs(workers);
+  int64_t count = TRANSFERS / (workers * THREADS_PER_WORKER);
+  for (int w = 0; w < workers; w++) {
+    for (int t = 0; t < THREADS_PER_WORKER; t++) {
+      uint64_t seed = 88172645463325252ull + w * THREADS_PER_WORKER + t;
+      gs[w].push_back([=](){ f(count, seed); });
+    }
+  }
+  return gs;
+}
+
+// Returns false if the total of the accounts changed
+
+bool bank(int workers, std::size_t size)
+{
+  bool ok;
+  {
+    std::vector<Account> accounts(size);
+    std::atomic<int64_t> aborts{0};
+    measure("  stm:           ", [&](){
+      runWorkers(groups(workers, [&](int64_t count, uint64_t seed) {
+        stmTransfers(accounts, count, seed);
+        aborts += eff::stm_take_stats().aborts;
+      }));
+    });
+    int64_t total = 0;
+    for (auto& a : accounts) { total += a.peek(); }
+    ok = total == INITIAL * (int64_t)size;
+    std::cout << " aborts: " << aborts << (ok ? "" : " WRONG TOTAL") << std::endl;
+  }
+  {
+    std::vector<LockedAccount> accounts(size);
+    std::mutex global;
+    measure("  global lock:   ", [&](){
+      runWorkers(groups(workers, [&](int64_t count, uint64_t seed) {
+        globalLockTransfers(accounts, global, count, seed);
+      }));
+    });
+    std::cout << std::endl;
+  }
+  {
+    std::vector<LockedAccount> accounts(size);
+    measure("  account locks: ", [&](){
+      runWorkers(groups(workers, [&](int64_t count, uint64_t seed) {
+        accountLockTransfers(accounts, count, seed);
+      }));
+    });
+    std::cout << std::endl;
+  }
+  return ok;
+}
+
+// Producers and consumers of a shared pot on different workers. A
+// consumer retries when the pot is empty. Returns false if the pot is
+// not empty at the end.
+
+bool pot(int workers)
+{
+  const int64_t ITEMS = TRANSFERS / 4;
+  eff::tvar pot(0);
+  std::vector<std::vector<std::function<void()>>> gs(workers);
+  int64_t perThread = ITEMS / THREADS_PER_WORKER;
+  int64_t retries = 0;
+  std::mutex retriesMutex;
+  for (int t = 0; t < THREADS_PER_WORKER; t++) {
+    gs[0].push_back([&, perThread](){
+      for (int64_t i = 0; i < perThread; i++) {
+        eff::atomically([&](const eff::tx& tx) { tx.write(pot, tx.read(pot) + 1); });
+        if (i % 16 == 0) { yield(); }
+      }
+    });
+    gs[t % (workers - 1) + 1].push_back([&, perThread](){
+      for (int64_t i = 0; i < perThread; i++) {
+        eff::atomically([&](const eff::tx& tx) {
+          int64_t n = tx.read(pot);
+          if (n == 0) { tx.retry(); }
+          tx.write(pot, n - 1);
+        });
+      }
+      std::lock_guard<std::mutex> lock(retriesMutex);
+      retries += eff::stm_take_stats().retries;
+    });
+  }
+  std::cout << "  stm with retry: " << std::flush;
+  auto begin = std::chrono::high_resolution_clock::now();
+  runWorkers(gs);
+  auto end = std::chrono::high_resolution_clock::now();
+  auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(end-begin).count();
+  std::cout << ns << "ns" << " \t(" << (int)(ns / ITEMS) << "ns per item, retries: " << retries
+            << (pot.peek() == 0 ? "" : ", WRONG POT") << ")" << std::endl;
+  return pot.peek() == 0;
+}
+
+// ----
+// Main
+// ----
+
+int main()
+{
+  std::cout << "--- stm: bank transfers in transactions vs locks ---" << std::endl;
+
+  bool ok = true;
+  int maxWorkers = std::max(2, std::min(4, (int)std::thread::hardware_concurrency()));
+  for (int workers : {1, maxWorkers}) {
+    for (std::size_t size : {8, 1024}) {
+      std::cout << workers << " workers, " << size << " accounts:" << std::endl;
+      ok = bank(workers, size) && ok;
+    }
+  }
+
+  std::cout << "producers and consumers (" << maxWorkers << " workers):" << std::endl;
+  ok = pot(maxWorkers) && ok;
+  return ok ? 0 : 1;
+}
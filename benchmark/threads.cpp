@@ -0,0 +1,225 @@
+// C++ Effects library
+// Maciej Pirog, Huawei Edinburgh Research Centre, maciej.pirog@huawei.com
+// License: MIT
+
+// Benchmark: The round-robin scheduler from examples/threads.cpp with
+// the queue of resumptions kept in std::list vs resumption_queue, and
+// with a pool of worker threads that run the forked procedures (so that
+// forking does not create a new handler)
+
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <list>
+
+#include "cpp-effects/cpp-effects.h"
+#include "cpp-effects/resumption-queues.h"
+
+namespace eff = cpp_effects;
+
+volatile int64_t SUM = 0;
+
+// ---------------------------------
+// Commands (shared by both variants)
+// ---------------------------------
+
+struct Yield : eff::command<> { };
+
+struct Fork : eff::command<> {
+  std::function<void()> proc;
+};
+
+using Res = eff::resumption<void()>;
+
+namespace ListScheduler {
+
+class Scheduler : public eff::flat_handler<void, Yield, Fork> {
+public:
+  static void Start(std::function<void()> f)
+  {
+    queue.push_back(eff::wrap<Scheduler>(f));
+    while (!queue.empty()) {
+      auto resumption = std::move(queue.front());
+      queue.pop_front();
+      std::move(resumption).resume();
+    }
+  }
+private:
+  static std::list<Res> queue;
+  void handle_command(Yield, Res r) override
+  {
+    queue.push_back(std::move(r));
+  }
+  void handle_command(Fork f, Res r) override
+  {
+    queue.push_back(std::move(r));
+    queue.push_back(eff::wrap<Scheduler>(f.proc));
+  }
+};
+
+std::list<Res> Scheduler::queue;
+
+}
+
+namespace IntrusiveScheduler {
+
+class Scheduler : public eff::flat_handler<void, Yield, Fork> {
+public:
+  static void Start(std::function<void()> f)
+  {
+    queue.push_back(eff::wrap<Scheduler>(f));
+    while (!queue.empty()) {
+      queue.pop_front().resume();
+    }
+  }
+private:
+  static eff::resumption_queue<void()> queue;
+  void handle_command(Yield, Res r) override
+  {
+    queue.push_back(std::move(r));
+  }
+  void handle_command(Fork f, Res r) override
+  {
+    queue.push_back(std::move(r));
+    queue.push_back(eff::wrap<Scheduler>(f.proc));
+  }
+};
+
+eff::resumption_queue<void()> Scheduler::queue;
+
+}
+
+namespace PoolScheduler {
+
+// Forked procedures are queued as tasks, and run by long-lived worker
+// threads. A worker with no tasks parks itself, and is woken up by the
+// next fork (a new worker is created only if there are no parked ones,
+// e.g., when all the workers are blocked in tasks that yield).
+
+struct Park : eff::command<> { };
+
+class Scheduler : public eff::flat_handler<void, Yield, Fork, Park> {
+public:
+  static void Start(std::function<void()> f)
+  {
+    tasks.push_back(f);
+    Wake();
+    while (!queue.empty()) {
+      queue.pop_front().resume();
+    }
+  }
+private:
+  static eff::resumption_queue<void()> queue;
+  static eff::resumption_queue<void()> idle;
+  static std::deque<std::function<void()>> tasks;
+  static int pending;  // Workers woken up that have not started running tasks yet
+
+  static void Wake()
+  {
+    if (pending > 0) { return; }
+    pending++;
+    if (idle.empty()) {
+      queue.push_back(eff::wrap<Scheduler>(Worker));
+    } else {
+      queue.push_back(idle.pop_front());
+    }
+  }
+  static void Worker()
+  {
+    while (true) {
+      pending--;
+      while (!tasks.empty()) {
+        auto task = std::move(tasks.front());
+        tasks.pop_front();
+        if (!tasks.empty()) { Wake(); }  // In case the task blocks
+        task();
+      }
+      eff::invoke_command(Park{});
+    }
+  }
+  void handle_command(Yield, Res r) override
+  {
+    queue.push_back(std::move(r));
+  }
+  void handle_command(Fork f, Res r) override
+  {
+    tasks.push_back(std::move(f.proc));
+    queue.push_back(std::move(r));
+    Wake();
+  }
+  void handle_command(Park, Res r) override
+  {
+    idle.push_back(std::move(r));
+  }
+};
+
+eff::resumption_queue<void()> Scheduler::queue;
+eff::resumption_queue<void()> Scheduler::idle;
+std::deque<std::function<void()>> Scheduler::tasks;
+int Scheduler::pending = 0;
+
+}
+
+// ---------
+// Workloads
+// ---------
+
+// Many threads that yield often: the cost is dominated by parking
+// and unparking resumptions
+
+const int THREADS = 100;
+const int YIELDS = 20000;
+
+void yielder(int k)
+{
+  for (int i = 0; i < YIELDS; i++) {
+    SUM += k;
+    eff::invoke_command(Yield{});
+  }
+}
+
+void yielders()
+{
+  for (int k = 0; k < THREADS; k++) {
+    eff::invoke_command(Fork{{}, std::bind(yielder, k)});
+  }
+}
+
+// Many short-lived threads: the cost is dominated by creating the
+// handlers and their fibers
+
+const int TASKS = 50000;
+
+void tasks()
+{
+  for (int k = 0; k < TASKS; k++) {
+    eff::invoke_command(Fork{{}, [k](){ SUM += k; }});
+  }
+}
+
+template <typename F>
+void measure(const char* name, int64_t iterations, F f)
+{
+  std::cout << name << std::flush;
+  auto begin = std::chrono::high_resolution_clock::now();
+  f();
+  auto end = std::chrono::high_resolution_clock::now();
+  std::cout << std::chrono::duration_cast<std::chrono::nanoseconds>(end-begin).count() << "ns" << " \t(" << (int)(std::chrono::duration_cast<std::chrono::nanoseconds>(end-begin).count() / iterations) << "ns per iteration)" << std::endl;
+}
+
+// ----
+// Main
+// ----
+
+int main()
+{
+  std::cout << "--- threads: std::list vs resumption_queue vs worker pool ---" << std::endl;
+
+  measure("yield-list:      ", THREADS * YIELDS, [](){ ListScheduler::Scheduler::Start(yielders); });
+  measure("yield-intrusive: ", THREADS * YIELDS, [](){ IntrusiveScheduler::Scheduler::Start(yielders); });
+  measure("yield-pool:      ", THREADS * YIELDS, [](){ PoolScheduler::Scheduler::Start(yielders); });
+  measure("fork-list:       ", TASKS, [](){ ListScheduler::Scheduler::Start(tasks); });
+  measure("fork-intrusive:  ", TASKS, [](){ IntrusiveScheduler::Scheduler::Start(tasks); });
+  measure("fork-pool:       ", TASKS, [](){ PoolScheduler::Scheduler::Start(tasks); });
+}
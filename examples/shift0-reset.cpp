@@ -10,6 +10,7 @@
 #include <vector>
 
 #include "cpp-effects/cpp-effects.h"
+#include "cpp-effects/resumption-function.h"
 
 namespace eff = cpp_effects;
 
@@ -42,13 +43,11 @@ Answer reset(std::function<Answer()> f)
 }
 
 template <typename Answer, typename Hole>
-Hole shift0(std::function<Answer(std::function<Answer(Hole)>)> e)
+Hole shift0(std::function<Answer(eff::resumption_function<Answer(Hole)>)> e)
 {
   return eff::invoke_command(Shift0<Answer, Hole>{{},
     [=](eff::resumption<Answer(Hole)> k) -> Answer {
-      return e([k = k.release()](Hole out) -> Answer {
-        return eff::resumption<Answer(Hole)>(k).resume(out);
-      });
+      return e(eff::as_function(std::move(k)));
     }
   });
 }
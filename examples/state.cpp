@@ -32,6 +32,7 @@ to the current reader and Abet.
 
 #include "cpp-effects/cpp-effects.h"
 #include "cpp-effects/clause-modifiers.h"
+#include "cpp-effects/resumption-function.h"
 
 namespace eff = cpp_effects;
 
@@ -118,45 +119,49 @@ void testStateful()
 // 2. State using lambdas
 // ----------------------
 
+// The computation is interpreted as a resumption_function, which holds
+// the resumption (so an unused resumption is destroyed) and does not
+// allocate
+
 template <typename Answer, typename S>
-class HLambda : public eff::handler<std::function<Answer(S)>, Answer, Put<S>, Get<S>> {
-  std::function<Answer(S)> handle_command(Put<S> p,
-    eff::resumption<std::function<Answer(S)>()> r) override
+class HLambda : public eff::handler<eff::resumption_function<Answer(S)>, Answer, Put<S>, Get<S>> {
+  eff::resumption_function<Answer(S)> handle_command(Put<S> p,
+    eff::resumption<eff::resumption_function<Answer(S)>()> r) override
   {
-    return [p, r = r.release()](S) -> Answer {
-      return eff::resumption<std::function<Answer(S)>()>(r).resume()(p.newState);
+    return [p, r = std::move(r)](S) mutable -> Answer {
+      return std::move(r).resume()(p.newState);
     };
   }
-  std::function<Answer(S)> handle_command(Get<S>,
-    eff::resumption<std::function<Answer(S)>(S)> r) override
+  eff::resumption_function<Answer(S)> handle_command(Get<S>,
+    eff::resumption<eff::resumption_function<Answer(S)>(S)> r) override
   {
-    return [r = r.release()](S s) -> Answer {
-      return eff::resumption<std::function<Answer(S)>(S)>(r).resume(s)(s);
+    return [r = std::move(r)](S s) mutable -> Answer {
+      return std::move(r).resume(s)(s);
     };
   }
-  std::function<Answer(S)> handle_return(Answer a) override
+  eff::resumption_function<Answer(S)> handle_return(Answer a) override
   {
     return [a](S){ return a; };
   }
 };
 
 template <typename S>
-class HLambda<void, S> : public eff::handler<std::function<void(S)>, void, Put<S>, Get<S>> {
-  std::function<void(S)> handle_command(Put<S> p,
-    eff::resumption<std::function<void(S)>()> r) override
+class HLambda<void, S> : public eff::handler<eff::resumption_function<void(S)>, void, Put<S>, Get<S>> {
+  eff::resumption_function<void(S)> handle_command(Put<S> p,
+    eff::resumption<eff::resumption_function<void(S)>()> r) override
   {
-    return [r = r.release(), p](S) -> void {
-      eff::resumption<std::function<void(S)>()>(r).resume()(p.newState);
+    return [r = std::move(r), p](S) mutable -> void {
+      std::move(r).resume()(p.newState);
     };
   }
-  std::function<void(S)> handle_command(Get<S>,
-    eff::resumption<std::function<void(S)>(S)> r) override
+  eff::resumption_function<void(S)> handle_command(Get<S>,
+    eff::resumption<eff::resumption_function<void(S)>(S)> r) override
   {
-    return [r = r.release()](S s) -> void {
-      eff::resumption<std::function<void(S)>(S)>(r).resume(s)(s);
+    return [r = std::move(r)](S s) mutable -> void {
+      std::move(r).resume(s)(s);
     };
   }
-  std::function<void(S)> handle_return() override
+  eff::resumption_function<void(S)> handle_return() override
   {
     return [](S){ };
   }
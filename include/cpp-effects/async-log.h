@@ -0,0 +1,284 @@
+// C++ Effects library
+// Maciej Pirog, Huawei Edinburgh Research Centre, maciej.pirog@huawei.com
+// License: MIT
+
+// This file contains asynchronous logging, in which the computation
+// never waits for I/O:
+//
+// - log_ring -- A lock-free ring of bytes with one producer (a system
+//   thread that logs) and one consumer (the flusher).
+//
+// - log_flusher -- A background thread that collects the contents of
+//   its rings into batches, and writes them to a file descriptor.
+//
+// - async_log -- The handler. Logging is a command with a plain
+//   clause, so it is a function call that formats the line into the
+//   ring of the current system thread.
+//
+// - logger -- The interface. It caches the reference to the handler,
+//   so logging does not look up the handler on the metastack.
+
+#ifndef CPP_EFFECTS_ASYNC_LOG_H
+#define CPP_EFFECTS_ASYNC_LOG_H
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include "cpp-effects/cpp-effects.h"
+#include "cpp-effects/clause-modifiers.h"
+
+namespace cpp_effects {
+
+// A line is "<text>\n", or "<text><value>\n"
+
+struct log_line : command<> {
+  std::string_view text;
+  int64_t value;
+  bool with_value;
+};
+
+namespace cpp_effects_internals {
+
+// The maximal length of a formatted line (longer texts are truncated)
+
+inline constexpr std::size_t max_log_line = 256;
+
+// Returns the number of bytes
+
+inline std::size_t format_log_line(char* buffer, const log_line& l)
+{
+  std::size_t len = std::min(l.text.size(), max_log_line - 22);
+  std::memcpy(buffer, l.text.data(), len);
+  char* end = buffer + len;
+  if (l.with_value) { end = std::to_chars(end, buffer + max_log_line - 1, l.value).ptr; }
+  *end++ = '\n';
+  return end - buffer;
+}
+
+} // namespace cpp_effects_internals
+
+// --------
+// log_ring
+// --------
+
+// The producer owns head, the consumer owns tail. Each side caches the
+// last seen position of the other side, so that the shared counters
+// are read only when the cached value is not enough.
+
+class log_ring {
+public:
+  // The capacity is rounded up to a power of two
+  explicit log_ring(std::size_t capacity)
+    : buffer(round_up(std::max(capacity, cpp_effects_internals::max_log_line))),
+      mask(buffer.size() - 1) { }
+  log_ring(const log_ring&) = delete;
+  log_ring& operator=(const log_ring&) = delete;
+
+  // Returns false if there is not enough space (called by the producer)
+  bool try_push(const char* data, std::size_t size)
+  {
+    std::size_t h = head.load(std::memory_order_relaxed);
+    if (h + size - cached_tail > buffer.size()) {
+      cached_tail = tail.load(std::memory_order_acquire);
+      if (h + size - cached_tail > buffer.size()) { return false; }
+    }
+    std::size_t pos = h & mask;
+    std::size_t n = std::min(size, buffer.size() - pos);
+    std::memcpy(&buffer[pos], data, n);
+    std::memcpy(&buffer[0], data + n, size - n);
+    head.store(h + size, std::memory_order_release);
+    return true;
+  }
+
+  // Copies at most size bytes to out, and returns the number of bytes
+  // (called by the consumer)
+  std::size_t pop(char* out, std::size_t size)
+  {
+    std::size_t t = tail.load(std::memory_order_relaxed);
+    std::size_t h = head.load(std::memory_order_acquire);
+    size = std::min(size, h - t);
+    std::size_t pos = t & mask;
+    std::size_t n = std::min(size, buffer.size() - pos);
+    std::memcpy(out, &buffer[pos], n);
+    std::memcpy(out + n, &buffer[0], size - n);
+    tail.store(t + size, std::memory_order_release);
+    return size;
+  }
+
+  // How many times the producer waited for space
+  std::size_t stalls() const { return stall_count; }
+
+private:
+  friend class log_flusher;
+  template <typename> friend class async_log;
+
+  static std::size_t round_up(std::size_t n)
+  {
+    std::size_t p = 1;
+    while (p < n) { p <<= 1; }
+    return p;
+  }
+
+  std::vector<char> buffer;
+  std::size_t mask;
+  std::size_t stall_count = 0;
+  alignas(64) std::atomic<std::size_t> head{0};
+  std::size_t cached_tail = 0;
+  alignas(64) std::atomic<std::size_t> tail{0};
+};
+
+// -----------
+// log_flusher
+// -----------
+
+// Collects the contents of all its rings into a batch, which is
+// written to the file descriptor when it is full, or when there is
+// nothing more to collect. The destructor writes everything that is
+// left, so the producers have to be done by then.
+
+class log_flusher {
+public:
+  log_flusher(int fd, std::size_t batch_size = 1 << 16) : fd(fd), batch(batch_size)
+  {
+    thread = std::thread([this](){ run(); });
+  }
+  log_flusher(const log_flusher&) = delete;
+  log_flusher& operator=(const log_flusher&) = delete;
+
+  ~log_flusher()
+  {
+    running.store(false, std::memory_order_release);
+    thread.join();
+  }
+
+  // A new ring for a producer (owned by the flusher)
+  log_ring* add_ring(std::size_t capacity = 1 << 16)
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    rings.push_back(std::make_unique<log_ring>(capacity));
+    return rings.back().get();
+  }
+
+  // The number of bytes that could not be written (they are dropped)
+  std::size_t dropped() const { return dropped_count.load(); }
+
+private:
+  int fd;
+  std::vector<char> batch;
+  std::size_t filled = 0;
+  std::atomic<bool> running{true};
+  std::atomic<std::size_t> dropped_count{0};
+  std::mutex mutex;
+  std::vector<std::unique_ptr<log_ring>> rings;
+  std::thread thread;
+
+  std::size_t collect()
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::size_t total = 0;
+    for (auto& ring : rings) {
+      std::size_t n;
+      while ((n = ring->pop(&batch[filled], batch.size() - filled)) > 0) {
+        total += n;
+        filled += n;
+        if (filled == batch.size()) { write(); }
+      }
+    }
+    return total;
+  }
+
+  void write()
+  {
+    const char* data = batch.data();
+    std::size_t size = filled;
+    while (size > 0) {
+      auto n = ::write(fd, data, size);
+      if (n < 0 && errno == EINTR) { continue; }
+      if (n <= 0) {
+        dropped_count += size;
+        break;
+      }
+      data += n;
+      size -= n;
+    }
+    filled = 0;
+  }
+
+  void run()
+  {
+    while (true) {
+      bool stop = !running.load(std::memory_order_acquire);
+      if (collect() == 0) {
+        if (filled > 0) { write(); }
+        if (stop) { return; }
+        std::this_thread::sleep_for(std::chrono::microseconds(50));
+      }
+    }
+  }
+};
+
+// ---------
+// async_log
+// ---------
+
+// If the ring is full, the system thread waits for the flusher
+
+template <typename Answer>
+class async_log : public flat_handler<Answer, plain<log_line>> {
+public:
+  explicit async_log(log_ring* ring) : ring(ring) { }
+
+private:
+  log_ring* ring;
+
+  void handle_command(log_line l) final override
+  {
+    char buffer[cpp_effects_internals::max_log_line];
+    std::size_t size = cpp_effects_internals::format_log_line(buffer, l);
+    while (!ring->try_push(buffer, size)) {
+      ring->stall_count++;
+      std::this_thread::yield();
+    }
+  }
+};
+
+// ------
+// logger
+// ------
+
+// Logs to the given handler of log_line (of type H)
+
+template <typename H>
+class logger {
+public:
+  explicit logger(handler_ref href) : href(href) { }
+
+  void operator()(std::string_view text) const
+  {
+    static_invoke_command<H>(href, log_line{{}, text, 0, false});
+  }
+
+  void operator()(std::string_view text, int64_t value) const
+  {
+    static_invoke_command<H>(href, log_line{{}, text, value, true});
+  }
+
+private:
+  handler_ref href;
+};
+
+} // namespace cpp_effects
+
+#endif // CPP_EFFECTS_ASYNC_LOG_H
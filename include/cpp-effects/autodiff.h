@@ -0,0 +1,205 @@
+// C++ Effects library
+// Maciej Pirog, Huawei Edinburgh Research Centre, maciej.pirog@huawei.com
+// License: MIT
+
+// This file contains reverse-mode automatic differentiation, in which
+// arithmetic on variables invokes a command, and the handler records
+// the tape:
+//
+// - ad_var -- A variable: its value and its node in the tape. A
+//   constant is a variable at the node 0, which is never read.
+//
+// - ad_tape -- The handler. The tape is an array of nodes owned by the
+//   handler (reused by subsequent gradient computations), the clause is
+//   plain, so recording never switches contexts, and the backward pass
+//   is a single branch-free loop over the tape.
+//
+// - gradient -- Computes a function of a vector of inputs, and its
+//   gradient.
+//
+// - The arithmetic (+, -, *, /, sin, cos, exp, log, sqrt), and ad_apply
+//   for user-defined operations, which record a node with the partial
+//   derivatives of the result.
+
+#ifndef CPP_EFFECTS_AUTODIFF_H
+#define CPP_EFFECTS_AUTODIFF_H
+
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "cpp-effects/cpp-effects.h"
+#include "cpp-effects/clause-modifiers.h"
+
+namespace cpp_effects {
+
+// ------
+// ad_var
+// ------
+
+struct ad_var {
+  ad_var() : value(0), node(0) { }
+  ad_var(double value) : value(value), node(0) { }  // A constant
+  ad_var(double value, int32_t node) : value(value), node(node) { }
+  double value;
+  int32_t node;
+};
+
+namespace cpp_effects_internals {
+
+// A node of the tape stores the indices of (at most two) arguments and
+// the partial derivatives of the result with respect to them. Unary
+// operations and inputs use the node 0 as the missing argument, with
+// the derivative 0, so that every node is processed in the same way by
+// the backward pass.
+
+struct ad_node {
+  int32_t lhs, rhs;
+  double dlhs, drhs;
+};
+
+// The answer is the index of the new node
+
+struct ad_record : command<int32_t> { ad_node node; };
+
+} // namespace cpp_effects_internals
+
+// -------
+// ad_tape
+// -------
+
+class ad_tape : public handler<double, ad_var, plain<cpp_effects_internals::ad_record>> {
+public:
+  ad_tape() { clear(); }
+
+  // Removes all the nodes (the memory of the tape is kept)
+  void clear()
+  {
+    nodes.clear();
+    nodes.push_back({0, 0, 0, 0});
+  }
+
+  // The number of nodes, and the adjoint of a node after the backward
+  // pass (the inputs of gradient are the nodes 1, 2, ..., n)
+  std::size_t size() const { return nodes.size(); }
+  double adjoint(int32_t node) const { return adjoints[node]; }
+
+  // Records a node. The arithmetic assumes that the tape is the
+  // innermost handler (as the arithmetic is pure), so that the handler
+  // is not searched for, and the clause is called directly.
+  static int32_t record(int32_t lhs, double dlhs, int32_t rhs, double drhs)
+  {
+    return static_invoke_command<ad_tape>(cpp_effects_internals::ad_record{{}, {lhs, rhs, dlhs, drhs}});
+  }
+
+  // A new input variable
+  static ad_var input(double value)
+  {
+    return {value, record(0, 0, 0, 0)};
+  }
+
+private:
+  std::vector<cpp_effects_internals::ad_node> nodes;
+  std::vector<double> adjoints;
+
+  int32_t handle_command(cpp_effects_internals::ad_record r) override
+  {
+    nodes.push_back(r.node);
+    return (int32_t)nodes.size() - 1;
+  }
+
+  // The backward pass. Every node adds to the adjoints of its arguments
+  // (which are earlier in the tape), so the loop is a scatter, and it
+  // cannot be vectorized across nodes.
+  double handle_return(ad_var out) override
+  {
+    adjoints.assign(nodes.size(), 0.0);
+    adjoints[out.node] = 1.0;
+    const cpp_effects_internals::ad_node* n = nodes.data();
+    double* adj = adjoints.data();
+    for (int32_t i = out.node; i > 0; i--) {
+      double a = adj[i];
+      adj[n[i].lhs] += a * n[i].dlhs;
+      adj[n[i].rhs] += a * n[i].drhs;
+    }
+    return out.value;
+  }
+};
+
+// --------
+// gradient
+// --------
+
+// Computes f(x), where f takes a const std::vector<ad_var>& and returns
+// an ad_var, and stores the gradient of f at x in dx. The tape is
+// cleared first.
+
+template <typename F>
+double gradient(const std::shared_ptr<ad_tape>& tape, F f,
+                const std::vector<double>& x, std::vector<double>& dx)
+{
+  tape->clear();
+  double y = handle_with<ad_tape>([&]() -> ad_var {
+    std::vector<ad_var> vars;
+    vars.reserve(x.size());
+    for (double v : x) { vars.push_back(ad_tape::input(v)); }
+    return f(static_cast<const std::vector<ad_var>&>(vars));
+  }, tape);
+  dx.resize(x.size());
+  for (std::size_t i = 0; i < x.size(); i++) { dx[i] = tape->adjoint(i + 1); }
+  return y;
+}
+
+template <typename F>
+double gradient(F f, const std::vector<double>& x, std::vector<double>& dx)
+{
+  return gradient(std::make_shared<ad_tape>(), f, x, dx);
+}
+
+// ----------
+// Arithmetic
+// ----------
+
+// An operation with the given value and the partial derivatives with
+// respect to its arguments
+
+inline ad_var ad_apply(double value, ad_var x, double dx)
+{
+  return {value, ad_tape::record(x.node, dx, 0, 0)};
+}
+
+inline ad_var ad_apply(double value, ad_var x, double dx, ad_var y, double dy)
+{
+  return {value, ad_tape::record(x.node, dx, y.node, dy)};
+}
+
+inline ad_var operator+(ad_var x, ad_var y) { return ad_apply(x.value + y.value, x, 1, y, 1); }
+inline ad_var operator-(ad_var x, ad_var y) { return ad_apply(x.value - y.value, x, 1, y, -1); }
+inline ad_var operator*(ad_var x, ad_var y) { return ad_apply(x.value * y.value, x, y.value, y, x.value); }
+inline ad_var operator-(ad_var x) { return ad_apply(-x.value, x, -1); }
+
+inline ad_var operator/(ad_var x, ad_var y)
+{
+  return ad_apply(x.value / y.value, x, 1 / y.value, y, -x.value / (y.value * y.value));
+}
+
+inline ad_var sin(ad_var x) { return ad_apply(std::sin(x.value), x, std::cos(x.value)); }
+inline ad_var cos(ad_var x) { return ad_apply(std::cos(x.value), x, -std::sin(x.value)); }
+inline ad_var log(ad_var x) { return ad_apply(std::log(x.value), x, 1 / x.value); }
+
+inline ad_var exp(ad_var x)
+{
+  double e = std::exp(x.value);
+  return ad_apply(e, x, e);
+}
+
+inline ad_var sqrt(ad_var x)
+{
+  double s = std::sqrt(x.value);
+  return ad_apply(s, x, 0.5 / s);
+}
+
+} // namespace cpp_effects
+
+#endif // CPP_EFFECTS_AUTODIFF_H
@@ -0,0 +1,136 @@
+// C++ Effects library
+// Maciej Pirog, Huawei Edinburgh Research Centre, maciej.pirog@huawei.com
+// License: MIT
+
+// This file contains dynamic batching across lightweight threads:
+//
+// - batch_loop -- A round-robin scheduler of lightweight threads on one
+//   system thread, which batches the calls to a kernel. A thread that
+//   calls the kernel (with batch_loop::call) is parked. When the batch
+//   is full, the oldest parked thread has waited longer than the
+//   latency bound, or there are no other threads ready to run, the
+//   loop runs the kernel once over all the parked inputs (so that the
+//   kernel can be vectorised), stores the results, and puts the parked
+//   threads back in the queue of ready threads.
+
+#ifndef CPP_EFFECTS_BATCHING_H
+#define CPP_EFFECTS_BATCHING_H
+
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "cpp-effects/cpp-effects.h"
+#include "cpp-effects/clause-modifiers.h"
+#include "cpp-effects/resumption-queues.h"
+
+namespace cpp_effects {
+
+namespace cpp_effects_internals {
+
+template <typename In, typename Out>
+struct batch_call : command<> {
+  In input;
+  Out* output;
+};
+
+} // namespace cpp_effects_internals
+
+// ----------
+// batch_loop
+// ----------
+
+template <typename In, typename Out>
+class batch_loop {
+public:
+  // Computes out[i] from in[i] for i < n
+  using kernel_type = void (*)(const In* in, Out* out, std::size_t n);
+
+  // max_latency -- 0 for no bound
+  batch_loop(kernel_type kernel, std::size_t max_batch,
+             std::chrono::nanoseconds max_latency = std::chrono::nanoseconds(0))
+    : kernel(kernel), max_batch(max_batch), max_latency(max_latency) { }
+  batch_loop(const batch_loop&) = delete;
+  batch_loop& operator=(const batch_loop&) = delete;
+
+  // A new thread (before or during run)
+  void spawn(std::function<void()> f)
+  {
+    ready.push_back(wrap_with<scheduler>(std::move(f), std::make_shared<scheduler>(this)));
+  }
+
+  // Runs the threads until all of them are done
+  void run()
+  {
+    while (!ready.empty() || !inputs.empty()) {
+      if (!ready.empty()) { ready.pop_front().resume(); }
+      if (ready.empty() || inputs.size() >= max_batch ||
+          (max_latency.count() > 0 && !inputs.empty() &&
+           std::chrono::steady_clock::now() - since > max_latency)) {
+        flush();
+      }
+    }
+  }
+
+  // Used in a thread of the loop: the result of the kernel for the
+  // input. It assumes that the loop is the innermost handler, so that
+  // the handler is not searched for.
+  static Out call(In input)
+  {
+    Out output;
+    static_invoke_command<scheduler>(cpp_effects_internals::batch_call<In, Out>{{}, input, &output});
+    return output;
+  }
+
+  // Called with the size of every batch, and the time that its oldest
+  // thread waited
+  std::function<void(std::size_t, std::chrono::nanoseconds)> on_batch;
+
+private:
+  class scheduler : public flat_handler<void, no_manage<cpp_effects_internals::batch_call<In, Out>>> {
+  public:
+    scheduler(batch_loop* loop) : loop(loop) { }
+  private:
+    batch_loop* loop;
+    void handle_command(cpp_effects_internals::batch_call<In, Out> c, resumption<void()> r) override
+    {
+      if (loop->inputs.empty()) { loop->since = std::chrono::steady_clock::now(); }
+      loop->inputs.push_back(c.input);
+      loop->destinations.push_back(c.output);
+      loop->parked.push_back(std::move(r));
+    }
+  };
+
+  kernel_type kernel;
+  std::size_t max_batch;
+  std::chrono::nanoseconds max_latency;
+  resumption_queue<void()> ready;
+
+  // The parked threads, their inputs, and where to store the results
+  std::vector<In> inputs;
+  std::vector<Out> outputs;
+  std::vector<Out*> destinations;
+  std::vector<resumption<void()>> parked;
+  std::chrono::steady_clock::time_point since;
+
+  void flush()
+  {
+    if (inputs.empty()) { return; }
+    if (on_batch) { on_batch(inputs.size(), std::chrono::steady_clock::now() - since); }
+    outputs.resize(inputs.size());
+    kernel(inputs.data(), outputs.data(), inputs.size());
+    for (std::size_t i = 0; i < parked.size(); i++) {
+      *destinations[i] = outputs[i];
+      ready.push_back(std::move(parked[i]));
+    }
+    inputs.clear();
+    destinations.clear();
+    parked.clear();
+  }
+};
+
+} // namespace cpp_effects
+
+#endif // CPP_EFFECTS_BATCHING_H
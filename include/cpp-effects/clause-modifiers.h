@@ -55,22 +55,22 @@ public:
     // (continued from OneShot::InvokeCmd) ...looking for [d]
     std::list<metaframe_ptr> stored_metastack;
     stored_metastack.splice(
-      stored_metastack.begin(), metastack, metastack.begin(), it);
+      stored_metastack.begin(), metastack(), metastack().begin(), it);
     // at this point: metastack = [a][b][c]; stored stack = [d][e][f][g.]
-    std::swap(stored_metastack.front()->fiber, metastack.front()->fiber);
+    std::swap(stored_metastack.front()->fiber, metastack().front()->fiber);
     // at this point: metastack = [a][b][c.]; stored stack = [d][e][f][g]
 
     if constexpr (!std::is_void<typename Cmd::out_type>::value) {
       typename Cmd::out_type a(handle_command(cmd));
-      std::swap(stored_metastack.front()->fiber, metastack.front()->fiber);
+      std::swap(stored_metastack.front()->fiber, metastack().front()->fiber);
       // at this point: metastack = [a][b][c]; stored stack = [d][e][f][g.]
-      metastack.splice(metastack.begin(), stored_metastack);
+      metastack().splice(metastack().begin(), stored_metastack);
       // at this point: metastack = [a][b][c][d][e][f][g.]
       return a;
     } else {
       handle_command(cmd);
-      std::swap(stored_metastack.front()->fiber, metastack.front()->fiber);
-      metastack.splice(metastack.begin(), stored_metastack);
+      std::swap(stored_metastack.front()->fiber, metastack().front()->fiber);
+      metastack().splice(metastack().begin(), stored_metastack);
     }
   }
 };
@@ -101,12 +101,18 @@ public:
     std::list<metaframe_ptr>::iterator it, const Cmd& cmd) final override
   {
     // (continued from OneShot::InvokeCmd) ...looking for [d]
-    metastack.erase(metastack.begin(), it);
+
+    // Keep the handler alive for the duration of the command clause
+    // call (the metastack might hold the only reference to it, e.g.,
+    // when the handler was captured and resumed in another context)
+    metaframe_ptr _(*std::prev(it));
+
+    metastack().erase(metastack().begin(), it);
     // at this point: metastack = [a][b][c]
 
-    std::move(metastack.front()->fiber).resume_with([&](ctx::fiber&& /*prev*/) -> ctx::fiber {
+    std::move(metastack().front()->fiber).resume_with([&](ctx::fiber&& /*prev*/) -> ctx::fiber {
       if constexpr (!std::is_void<Answer>::value) {
-        *(static_cast<std::optional<Answer>*>(metastack.front()->return_buffer)) =
+        *(static_cast<std::optional<Answer>*>(metastack().front()->return_buffer)) =
           this->handle_command(cmd);
       } else {
         this->handle_command(cmd);
@@ -116,9 +122,7 @@ public:
 
     // The current fiber is gone (because prev in the above goes out
     // of scope and is deleted), so this will never be reached.
-    std::cerr << "Malformed no_resume handler" << std::endl;
-    debug_print_metastack();
-    exit(-1);
+    fatal_error("malformed no_resume handler");
   }
 };
 
@@ -161,10 +165,11 @@ public:
     // (continued from OneShot::InvokeCmd) ...looking for [d]
     resumption_data<Out, Answer>& resumption = this->resumptionBuffer;
     resumption.stored_metastack.splice(
-      resumption.stored_metastack.begin(), metastack, metastack.begin(), it);
+      resumption.stored_metastack.begin(), metastack(), metastack().begin(), it);
+    resumption.registry_add();
     // at this point: [a][b][c]; stored stack = [d][e][f][g.] 
 
-    std::move(metastack.front()->fiber).resume_with([&](ctx::fiber&& prev) ->
+    std::move(metastack().front()->fiber).resume_with([&](ctx::fiber&& prev) ->
         ctx::fiber {
       // at this point: [a][b][c.]; stored stack = [d][e][f][g.]
       resumption.stored_metastack.front()->fiber = std::move(prev);
@@ -174,7 +179,7 @@ public:
       // (compare command_clause<Answer, Cmd>::InvokeCmd)
 
       if constexpr (!std::is_void<Answer>::value) {
-        *(static_cast<std::optional<Answer>*>(metastack.front()->return_buffer)) =
+        *(static_cast<std::optional<Answer>*>(metastack().front()->return_buffer)) =
           this->handle_command(cmd, ::cpp_effects::resumption<typename Cmd::template resumption_type<Answer>>(resumption));
       } else {
         this->handle_command(cmd, ::cpp_effects::resumption<typename Cmd::template resumption_type<Answer>>(resumption));
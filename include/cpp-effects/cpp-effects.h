@@ -3,6 +3,13 @@
 // License: MIT
 
 // Main header file for the library
+//
+// The header contains only the templates and the declarations of the
+// runtime. The non-template part of the runtime (label allocation,
+// debug printing, error reporting) is compiled separately
+// (see src/cpp-effects.cpp), so that including the header does not
+// pull in <iostream> and the runtime is not duplicated in every
+// translation unit.
 
 #ifndef CPP_EFFECTS_CPP_EFFECTS_H
 #define CPP_EFFECTS_CPP_EFFECTS_H
@@ -16,15 +23,21 @@
 
 #include <boost/context/fiber.hpp>
 
-// For different stack use policies, e.g.,
-// #include <boost/context/protected_fixedsize_stack.hpp>
+// For different stack use policies, see stack_allocator_of below and
+// cpp-effects/growable-stack.h
 
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
 #include <functional>
-#include <iostream>
+#include <initializer_list>
 #include <list>
+#include <memory>
+#include <mutex>
 #include <optional>
 #include <typeinfo>
 #include <tuple>
+#include <type_traits>
 
 namespace cpp_effects {
 
@@ -61,6 +74,28 @@ class resumption_data;
 template <typename T>
 class resumption;
 
+// Intrusive containers of resumptions (see resumption-queues.h)
+
+template <typename T>
+class resumption_queue;
+
+template <typename T>
+class resumption_stack;
+
+template <typename T>
+class resumption_heap;
+
+// Delimited control (see prompts.h)
+
+template <typename A>
+class prompt;
+
+template <typename A, typename F>
+A push_prompt(const prompt<A>& p, F body);
+
+template <typename B, typename A, typename F>
+B take_subcont(const prompt<A>& p, F f);
+
 // Handlers
 
 template <typename Answer, typename Body, typename... Cmds>
@@ -75,12 +110,17 @@ namespace cpp_effects_internals {
 
   class metaframe;
 
-  class init_metastack;
-
   using metaframe_ptr = std::shared_ptr<metaframe>;
 
 }
 
+// A handler reference is an iterator to the frame of the handler. When
+// a computation is captured, its frames are spliced from the metastack
+// to the resumption, and spliced back when it is resumed. Splicing
+// does not invalidate iterators, so a reference stays valid for as
+// long as the handler is alive, also when the handler is captured in
+// a resumption (or resumed in a different context).
+
 using handler_ref = std::list<cpp_effects_internals::metaframe_ptr>::iterator;
 
 // ---------------
@@ -93,6 +133,24 @@ int64_t fresh_label();
 
 void debug_print_metastack();
 
+int64_t allocated_stacks();
+
+// Registry of suspended computations (disabled by default)
+
+struct suspended_computation {
+  const std::type_info* handler;  // The handler that captured the computation
+  int64_t label;                  // The label of this handler
+  int64_t age;                    // Nanoseconds since the computation was captured
+  std::size_t frames;             // The number of captured frames
+  std::size_t stack_size;         // The total size of their stacks
+};
+
+void enable_suspended_registry(bool enable = true);
+
+void for_each_suspended(const std::function<void(const suspended_computation&)>& f);
+
+void print_suspended_report();
+
 // Handling
 
 template <typename H, typename... Args>
@@ -128,7 +186,8 @@ template <typename H>
 typename H::answer_type handle_with_ref(
     std::function<typename H::body_type(handler_ref)> body, std::shared_ptr<H> handler);
 
-// Lifting a function to a resumption by wrapping it in a handler
+// Lifting a function to a resumption by wrapping it in a handler (the
+// fiber of the lifted function uses the stack allocator of H)
 
 template <typename H, typename... Args>
 resumption<typename H::answer_type()> wrap(
@@ -213,6 +272,44 @@ struct tangible<void> {
   tangible(const std::function<void()>& f) { f(); }
 };
 
+// -------------------------------------
+// Internals - stack allocation policies
+// -------------------------------------
+
+// A handler can choose the allocator of the stacks of the fibers that
+// run the computations it handles by declaring the member type
+// stack_allocator (a Boost.Context stack allocator). Otherwise, the
+// stacks are allocated by Boost's default fixedsize_stack. The
+// allocator is default-constructed, unless the handler gives the
+// instance by the member function stack_allocator_instance (e.g., the
+// handlers of resumptions lifted with a given allocator).
+
+template <typename H, typename = void>
+struct has_stack_allocator_instance : std::false_type { };
+
+template <typename H>
+struct has_stack_allocator_instance<H,
+    std::void_t<decltype(std::declval<const H&>().stack_allocator_instance())>> : std::true_type { };
+
+template <typename H, typename = void>
+struct stack_allocator_of {
+  using type = ctx::fixedsize_stack;
+  static type make(const H&) { return type(); }
+};
+
+template <typename H>
+struct stack_allocator_of<H, std::void_t<typename H::stack_allocator>> {
+  using type = typename H::stack_allocator;
+  static type make(const H& handler)
+  {
+    if constexpr (has_stack_allocator_instance<H>::value) {
+      return handler.stack_allocator_instance();
+    } else {
+      return type();
+    }
+  }
+};
+
 // ----------------------
 // Internals - metaframes
 // ----------------------
@@ -225,14 +322,42 @@ struct tangible<void> {
 class metaframe {
 public:
   virtual ~metaframe() { }
-  virtual void debug_print() const
-  {
-    std::cout << label << ":" << typeid(*this).name() << std::endl;
-  }
+  virtual void debug_print() const;
   metaframe() : label(0) { }
   int64_t label;
   ctx::fiber fiber;
   void* return_buffer;
+  std::size_t stack_size = 0;  // The size of the stack of the fiber of the frame
+};
+
+// The number of stacks allocated for fibers by the current thread (see
+// allocated_stacks)
+
+inline thread_local int64_t stack_count = 0;
+
+// A stack allocator that records the size of the allocated stack in a
+// metaframe (for the registry of suspended computations), and counts
+// the stacks. Without a metaframe, it only counts the stacks.
+
+template <typename Alloc>
+class recording_stack {
+public:
+  recording_stack(Alloc alloc, metaframe& frame) : alloc(alloc), frame(&frame) { }
+  explicit recording_stack(Alloc alloc) : alloc(alloc), frame(nullptr) { }
+  ctx::stack_context allocate()
+  {
+    ctx::stack_context sctx = alloc.allocate();
+    if (frame) { frame->stack_size = sctx.size; }
+    stack_count++;
+    return sctx;
+  }
+  void deallocate(ctx::stack_context& sctx) noexcept
+  {
+    alloc.deallocate(sctx);
+  }
+private:
+  Alloc alloc;
+  metaframe* frame;
 };
 
 // When invoking a command in the client code, we know the type of the
@@ -276,19 +401,45 @@ private:
 
 // Invariant: There is always at least one frame on the metastack.
 
-inline std::list<metaframe_ptr> metastack;
+// Every thread has its own metastack, so handlers can be used in
+// different threads independently (but a resumption should be resumed
+// in the thread in which it was captured).
+
+// The metastack of a thread is created on first use, also when it is
+// used to initialise global variables. The pointer to it is
+// constant-initialised, so accessing the metastack is only a check
+// (rather than a call to the initialisation wrapper of a thread-local
+// variable with a constructor).
+
+inline thread_local std::list<metaframe_ptr>* current_metastack = nullptr;
 
-class init_metastack
+inline std::list<metaframe_ptr>& init_metastack()
 {
-public:
-  init_metastack()
-  {
-    if (metastack.empty()) {
-      auto initmetaframe = std::make_shared<metaframe>();
-      metastack.push_front(initmetaframe);
-    }
-  }  
-} inline init_metastack_v;
+  thread_local std::list<metaframe_ptr> ms;
+  ms.push_front(std::make_shared<metaframe>());
+  current_metastack = &ms;
+  return ms;
+}
+
+inline std::list<metaframe_ptr>& metastack()
+{
+  if (current_metastack) { return *current_metastack; }
+  return init_metastack();
+}
+
+// ------------------------------
+// Internals - printing and errors
+// ------------------------------
+
+// Print a frame in the format of debug_print_metastack
+
+void print_frame(int64_t label, const char* name, std::initializer_list<const char*> cmds);
+
+// Print the message (and the metastack) to stderr and exit
+
+[[noreturn]] void fatal_error(const char* msg, const char* typeName = nullptr);
+
+[[noreturn]] void fatal_error(int64_t label, const char* typeName);
 
 // ------------------------------------------------------------
 // Internals - implementation of command_clause::invoke_command
@@ -303,10 +454,11 @@ typename Cmd::out_type command_clause<Answer, Cmd>::invoke_command(
 
   // (continued from invoke_command) ...looking for [d]
   resumption_data<Out, Answer>& rd = this->resumptionBuffer;
-  rd.stored_metastack.splice(rd.stored_metastack.begin(), metastack, metastack.begin(), it);
+  rd.stored_metastack.splice(rd.stored_metastack.begin(), metastack(), metastack().begin(), it);
+  rd.registry_add();
   // at this point: [a][b][c]; stored stack = [d][e][f][g.] 
 
-  std::move(metastack.front()->fiber).resume_with([&](ctx::fiber&& prev) -> ctx::fiber {
+  std::move(metastack().front()->fiber).resume_with([&](ctx::fiber&& prev) -> ctx::fiber {
     // at this point: [a][b][c.]; stored stack = [d][e][f][g.]
     rd.stored_metastack.front()->fiber = std::move(prev);
     // at this point: [a][b][c.]; stored stack = [d][e][f][g]
@@ -315,7 +467,7 @@ typename Cmd::out_type command_clause<Answer, Cmd>::invoke_command(
     cpp_effects_internals::metaframe_ptr _(rd.stored_metastack.back());
 
     if constexpr (!std::is_void<Answer>::value) {
-      *(static_cast<std::optional<Answer>*>(metastack.front()->return_buffer)) =
+      *(static_cast<std::optional<Answer>*>(metastack().front()->return_buffer)) =
         this->handle_command(
             cmd, resumption<typename Cmd::template resumption_type<Answer>>(rd));
     } else {
@@ -344,7 +496,39 @@ typename Cmd::out_type command_clause<Answer, Cmd>::invoke_command(
 // As there is no real forced TCO in C++, we need a separate mechanism
 // for tail-resumptive handlers that will not build up call frames.
 
-std::optional<resumption_base*> inline tail_resumption = {};
+// Constant-initialised, so that accessing it does not go through the
+// initialisation wrapper of a thread-local variable.
+
+inline thread_local std::optional<resumption_base*> tail_resumption = {};
+
+// ----------------------------------------------
+// Internals - registry of suspended computations
+// ----------------------------------------------
+
+// Every thread has its own registry: an intrusive list of the
+// currently suspended computations captured in the thread. A
+// computation is added when it is captured, and removed when it is
+// resumed or destroyed. This can happen in another thread (e.g., a
+// scheduler that sends a resumption to another thread), so every
+// computation keeps the list to which it was added, and the list is
+// guarded by a mutex, which is taken only when the registry is enabled.
+// The list outlives its thread as long as it is not empty. When the
+// registry is disabled, capturing a computation costs one relaxed
+// load.
+
+struct suspended_list {
+  std::mutex mutex;
+  resumption_base* head = nullptr;
+};
+
+inline std::atomic<bool> suspended_registry_enabled{false};
+
+inline thread_local std::shared_ptr<suspended_list> suspended_registry =
+  std::make_shared<suspended_list>();
+
+// Nanoseconds of a monotonic clock (defined in the runtime)
+
+int64_t registry_clock();
 
 // ----------------
 // End of internals
@@ -362,10 +546,56 @@ class resumption_base {
     int64_t label, std::function<typename H::body_type()> body, std::shared_ptr<H> handler);
   template <typename> friend class resumption;
   template <typename, typename> friend class resumption_data;
+  template <typename> friend class resumption_queue;
+  template <typename> friend class resumption_stack;
+  template <typename> friend class resumption_heap;
+  template <typename A, typename F> friend A push_prompt(const prompt<A>& p, F body);
+  template <typename B, typename A, typename F> friend B take_subcont(const prompt<A>& p, F f);
+  template <typename, typename> friend class cpp_effects_internals::command_clause;
+  friend void for_each_suspended(const std::function<void(const suspended_computation&)>& f);
 public:
   virtual ~resumption_base() { }
 private:
   virtual void tail_resume() = 0;
+  virtual const std::list<cpp_effects_internals::metaframe_ptr>& captured_frames() const = 0;
+
+  // Links of the registry of suspended computations, and the registry
+  // (of the thread that captured the computation) to which they belong
+  std::shared_ptr<cpp_effects_internals::suspended_list> registry_owner;
+  resumption_base** registry_prev = nullptr;
+  resumption_base* registry_next = nullptr;
+  int64_t registry_since = 0;
+  void registry_add()
+  {
+    using namespace cpp_effects_internals;
+
+    if (!suspended_registry_enabled.load(std::memory_order_relaxed)) { return; }
+    registry_since = registry_clock();
+    registry_owner = suspended_registry;
+    std::lock_guard<std::mutex> guard(registry_owner->mutex);
+    registry_next = registry_owner->head;
+    if (registry_next) { registry_next->registry_prev = &registry_next; }
+    registry_owner->head = this;
+    registry_prev = &registry_owner->head;
+  }
+  void registry_remove()
+  {
+    if (!registry_owner) { return; }
+    // Released after the guard, as it may be the last owner of the mutex
+    auto owner = std::move(registry_owner);
+    std::lock_guard<std::mutex> guard(owner->mutex);
+    *registry_prev = registry_next;
+    if (registry_next) { registry_next->registry_prev = registry_prev; }
+    registry_prev = nullptr;
+  }
+
+  // Links used by the intrusive containers of resumptions. A
+  // suspended computation is in at most one container at a time, so
+  // a single set of links suffices, and parking a resumption in a
+  // container never allocates.
+  resumption_base* next_link = nullptr;
+  resumption_base* child_link = nullptr;
+  int64_t key_link = 0;
 };
 
 template <typename Out, typename Answer>
@@ -375,11 +605,16 @@ class resumption_data final : public resumption_base {
       int64_t label, std::function<typename H::body_type()> body, std::shared_ptr<H> handler);
   template <typename, typename> friend class cpp_effects_internals::command_clause;
   template <typename> friend class resumption;
+  template <typename B, typename A, typename F> friend B take_subcont(const prompt<A>& p, F f);
 private:
   std::optional<cpp_effects_internals::tangible<Out>> command_result_buffer;
   Answer resume();
   std::list<cpp_effects_internals::metaframe_ptr> stored_metastack;
   virtual void tail_resume() override;
+  virtual const std::list<cpp_effects_internals::metaframe_ptr>& captured_frames() const override
+  {
+    return stored_metastack;
+  }
 };
 
 template <typename Out, typename Answer>
@@ -389,14 +624,16 @@ public:
   resumption(resumption_data<Out, Answer>* data) : data(data) { }
   resumption(resumption_data<Out, Answer>& data) : data(&data) { }
   resumption(std::function<Answer(Out)>);
+  template <typename StackAllocator>
+  resumption(std::allocator_arg_t, StackAllocator alloc, std::function<Answer(Out)>);
   resumption(const resumption<Answer(Out)>&) = delete;
-  resumption(resumption<Answer(Out)>&& other)
+  resumption(resumption<Answer(Out)>&& other) noexcept
   {
     data = other.data;
     other.data = nullptr;
   }
   resumption& operator=(const resumption<Answer(Out)>&) = delete;
-  resumption& operator=(resumption<Answer(Out)>&& other)
+  resumption& operator=(resumption<Answer(Out)>&& other) noexcept
   {
     if (this != &other) {
       data = other.data;
@@ -407,6 +644,7 @@ public:
   ~resumption()
   {
     if (data) {
+      data->registry_remove();
       data->command_result_buffer = {};
 
       // We move the resumption buffer out of the metaframe to break
@@ -445,14 +683,16 @@ public:
   resumption(resumption_data<void, Answer>* data) : data(data) { }
   resumption(resumption_data<void, Answer>& data) : data(&data) { }
   resumption(std::function<Answer()>);
+  template <typename StackAllocator>
+  resumption(std::allocator_arg_t, StackAllocator alloc, std::function<Answer()>);
   resumption(const resumption<Answer()>&) = delete;
-  resumption(resumption<Answer()>&& other)
+  resumption(resumption<Answer()>&& other) noexcept
   {
     data = other.data;
     other.data = nullptr;
   }
   resumption& operator=(const resumption<Answer()>&) = delete;
-  resumption& operator=(resumption<Answer()>&& other)
+  resumption& operator=(resumption<Answer()>&& other) noexcept
   {
     if (this != &other) {
       data = other.data;
@@ -463,6 +703,7 @@ public:
   ~resumption()
   {
     if (data) {
+      data->registry_remove();
       data->command_result_buffer = {};
 
       // We move the resumption buffer out of the metaframe to break
@@ -493,8 +734,16 @@ private:
   resumption_data<void, Answer>* data = nullptr;
 };
 
+// The stack of the fiber that runs the lifted function is allocated by
+// (a copy of) alloc, which the handler of the argument keeps
+
+template <typename Out, typename Answer>
+resumption<Answer(Out)>::resumption(std::function<Answer(Out)> func) :
+  resumption(std::allocator_arg, ctx::fixedsize_stack(), std::move(func)) { }
+
 template <typename Out, typename Answer>
-resumption<Answer(Out)>::resumption(std::function<Answer(Out)> func)
+template <typename StackAllocator>
+resumption<Answer(Out)>::resumption(std::allocator_arg_t, StackAllocator alloc, std::function<Answer(Out)> func)
 {
   resumption<Answer(Out)> r;
 
@@ -505,24 +754,38 @@ resumption<Answer(Out)>::resumption(std::function<Answer(Out)> func)
 
   struct Arg : command<Out> { resumption<Answer(Out)>& res; };
   class HArg : public flat_handler<Answer, Arg> {
+  public:
+    using stack_allocator [[maybe_unused]] = StackAllocator;  // (used by handle)
+    HArg(StackAllocator alloc) : alloc(alloc) { }
+    StackAllocator stack_allocator_instance() const { return alloc; }
+  private:
+    StackAllocator alloc;
     Answer handle_command(Arg a, resumption<Answer(Out)> r) override
     { 
       a.res = std::move(r);
       invoke_command(Abort{});
+
+      // Unreachable: the handler of Abort discards this computation
+      cpp_effects_internals::fatal_error("impossible!");
     }
   };
 
-  handle<HAbort>([&r, func](){
+  handle<HAbort>([&r, &alloc, func](){
     handle<HArg>([&r, func](){
       return func(invoke_command(Arg{{}, r}));
-    });
+    }, alloc);
   });
 
   data = r.release();
 }
 
 template <typename Answer>
-resumption<Answer()>::resumption(std::function<Answer()> func)
+resumption<Answer()>::resumption(std::function<Answer()> func) :
+  resumption(std::allocator_arg, ctx::fixedsize_stack(), std::move(func)) { }
+
+template <typename Answer>
+template <typename StackAllocator>
+resumption<Answer()>::resumption(std::allocator_arg_t, StackAllocator alloc, std::function<Answer()> func)
 {
   resumption<Answer()> r;
 
@@ -533,18 +796,27 @@ resumption<Answer()>::resumption(std::function<Answer()> func)
 
   struct Arg : command<> { resumption<Answer()>& res; };
   class HArg : public flat_handler<Answer, Arg> {
+  public:
+    using stack_allocator [[maybe_unused]] = StackAllocator;  // (used by handle)
+    HArg(StackAllocator alloc) : alloc(alloc) { }
+    StackAllocator stack_allocator_instance() const { return alloc; }
+  private:
+    StackAllocator alloc;
     Answer handle_command(Arg a, resumption<Answer()> r) override
     {
       a.res = std::move(r);
       invoke_command(Abort{});
+
+      // Unreachable: the handler of Abort discards this computation
+      cpp_effects_internals::fatal_error("impossible!");
     }
   };
 
-  handle<HAbort>([&r, func](){
+  handle<HAbort>([&r, &alloc, func](){
     handle<HArg>([&r, func](){
       invoke_command(Arg{{}, r});
       return func();
-    });
+    }, alloc);
   });
 
   data = r.release();
@@ -555,15 +827,17 @@ Answer resumption_data<Out, Answer>::resume()
 {
   using namespace cpp_effects_internals;
 
+  this->registry_remove();
+
   if constexpr (!std::is_void<Answer>::value) {
     std::optional<Answer> answer;
-    void* prevBuffer = metastack.front()->return_buffer;
-    metastack.front()->return_buffer = &answer;
+    void* prevBuffer = metastack().front()->return_buffer;
+    metastack().front()->return_buffer = &answer;
 
     std::move(this->stored_metastack.front()->fiber).resume_with(
         [&](ctx::fiber&& prev) -> ctx::fiber {
-      metastack.front()->fiber = std::move(prev);
-      metastack.splice(metastack.begin(), this->stored_metastack);
+      metastack().front()->fiber = std::move(prev);
+      metastack().splice(metastack().begin(), this->stored_metastack);
       return ctx::fiber();
     });
 
@@ -574,13 +848,13 @@ Answer resumption_data<Out, Answer>::resume()
       temp->tail_resume();
     }
 
-    metastack.front()->return_buffer = prevBuffer;
+    metastack().front()->return_buffer = prevBuffer;
     return std::move(*answer);
   } else {
     std::move(this->stored_metastack.front()->fiber).resume_with(
         [&](ctx::fiber&& prev) -> ctx::fiber {
-      metastack.front()->fiber = std::move(prev);
-      metastack.splice(metastack.begin(), this->stored_metastack);
+      metastack().front()->fiber = std::move(prev);
+      metastack().splice(metastack().begin(), this->stored_metastack);
       return ctx::fiber();
     });
 
@@ -598,10 +872,12 @@ void resumption_data<Out, Answer>::tail_resume()
 {
   using namespace cpp_effects_internals;
 
+  this->registry_remove();
+
   std::move(this->stored_metastack.front()->fiber).resume_with(
       [&](ctx::fiber&& prev) -> ctx::fiber {
-    metastack.front()->fiber = std::move(prev);
-    metastack.splice(metastack.begin(), this->stored_metastack);
+    metastack().front()->fiber = std::move(prev);
+    metastack().splice(metastack().begin(), this->stored_metastack);
     return ctx::fiber();
   });
 }
@@ -659,9 +935,8 @@ public:
   using body_type = Body;
   virtual void debug_print() const override
   {
-    std::cout << cpp_effects_internals::metaframe::label << ":" << typeid(*this).name();
-    ((std::cout << "[" << typeid(Cmds).name() << "]"), ...);
-    std::cout << std::endl;
+    cpp_effects_internals::print_frame(
+      cpp_effects_internals::metaframe::label, typeid(*this).name(), {typeid(Cmds).name()...});
   }
 protected:
   virtual Answer handle_return(Body b) = 0;
@@ -697,9 +972,8 @@ public:
   using body_type = void;
   virtual void debug_print() const override
   {
-    std::cout << cpp_effects_internals::metaframe::label << ":" << typeid(*this).name();
-    ((std::cout << "[" << typeid(Cmds).name() << "]"), ...);
-    std::cout << std::endl;
+    cpp_effects_internals::print_frame(
+      cpp_effects_internals::metaframe::label, typeid(*this).name(), {typeid(Cmds).name()...});
   }
 protected:
   virtual Answer handle_return() = 0;
@@ -723,20 +997,8 @@ class flat_handler<void, Cmds...> : public handler<void, void, Cmds...> {
 // API - implementation of functions
 // ---------------------------------
 
-// Misc
-
-int64_t fresh_label()
-{
-  static int64_t freshCounter = -1;
-  return --freshCounter;
-}
-
-void debug_print_metastack()
-{
-  using namespace cpp_effects_internals;
-
-  for (auto frame : metastack) { frame->debug_print(); }
-}
+// Misc (fresh_label and debug_print_metastack are defined in the
+// runtime)
 
 // Handling
 
@@ -769,22 +1031,26 @@ typename H::answer_type handle_with(
   using Answer = typename H::answer_type;
   using Body = typename H::body_type;
 
-  // E.g. for different stack use policy
-  // ctx::protected_fixedsize_stack pf(10000000);
-  ctx::fiber bodyFiber{/*std::alocator_arg, std::move(pf),*/
-      [&](ctx::fiber&& prev) -> ctx::fiber&& {
-    metastack.front()->fiber = std::move(prev);
+  // The body is moved into the fiber, as the frame of the caller of
+  // handle_with might be gone before the body finishes (e.g., in the
+  // case of resumptions lifted from functions, see wrap).
+
+  using StackAllocator = typename stack_allocator_of<H>::type;
+  ctx::fiber bodyFiber{std::allocator_arg,
+      recording_stack<StackAllocator>(stack_allocator_of<H>::make(*handler), *handler),
+      [&, body = std::move(body)](ctx::fiber&& prev) -> ctx::fiber&& {
+    metastack().front()->fiber = std::move(prev);
     handler->label = label;
-    metastack.push_front(handler);
+    metastack().push_front(handler);
 
     cpp_effects_internals::tangible<Body> b(body);
 
-    cpp_effects_internals::metaframe_ptr returnFrame(std::move(metastack.front()));
-    metastack.pop_front();
+    cpp_effects_internals::metaframe_ptr returnFrame(std::move(metastack().front()));
+    metastack().pop_front();
 
-    std::move(metastack.front()->fiber).resume_with([&](ctx::fiber&&) -> ctx::fiber {
+    std::move(metastack().front()->fiber).resume_with([&](ctx::fiber&&) -> ctx::fiber {
       if constexpr (!std::is_void<Answer>::value) {
-        *(static_cast<std::optional<Answer>*>(metastack.front()->return_buffer)) =
+        *(static_cast<std::optional<Answer>*>(metastack().front()->return_buffer)) =
           std::static_pointer_cast<H>(returnFrame)->run_return(std::move(b));
       } else {
         std::static_pointer_cast<H>(returnFrame)->run_return(std::move(b));
@@ -793,14 +1059,13 @@ typename H::answer_type handle_with(
     });
       
     // Unreachable: this fiber is now destroyed
-    std::cerr << "error: impssible!\n";
-    exit(-1);
+    cpp_effects_internals::fatal_error("impossible!");
   }};
 
   if constexpr (!std::is_void<Answer>::value) {
     std::optional<Answer> answer;
-    void* prevBuffer = metastack.front()->return_buffer;
-    metastack.front()->return_buffer = &answer;
+    void* prevBuffer = metastack().front()->return_buffer;
+    metastack().front()->return_buffer = &answer;
     std::move(bodyFiber).resume();
 
     // Trampoline tail-resumes
@@ -810,7 +1075,7 @@ typename H::answer_type handle_with(
       temp->tail_resume();
     }
 
-    metastack.front()->return_buffer = prevBuffer;
+    metastack().front()->return_buffer = prevBuffer;
     return std::move(*answer);
   } else {
     std::move(bodyFiber).resume();
@@ -863,8 +1128,11 @@ typename H::answer_type handle_with_ref(
     std::function<typename H::body_type(handler_ref)> body,
     std::shared_ptr<H> handler)
 {
-  return handle_with(label, [&](){
-    auto href = find_handler(label);
+  // When the body starts, the handler is the top frame of the
+  // metastack, so there is no need to look it up. As in handle_with,
+  // the body is moved, since the computation can outlive the caller.
+  return handle_with(label, [body = std::move(body)](){
+    handler_ref href = cpp_effects_internals::metastack().begin();
     return body(href);
   }, std::move(handler));
 }
@@ -880,13 +1148,15 @@ typename H::answer_type handle_with_ref(
   }
 }
 
-// Lifting a function to a resumption by wrapping it in a handler
+// Lifting a function to a resumption by wrapping it in a handler (the
+// fiber of the lifted function uses the stack allocator of H)
 
 template <typename H, typename... Args>
 resumption<typename H::answer_type()> wrap(
     int64_t label, std::function<typename H::body_type()> body, Args&&... args)
 {
-  return resumption<typename H::answer_type()>([=](){
+  return resumption<typename H::answer_type()>(
+      std::allocator_arg, typename cpp_effects_internals::stack_allocator_of<H>::type(), [=](){
     return handle<H>(label, body, std::forward<Args>(args)...);
   });
 }
@@ -904,7 +1174,8 @@ template <typename H, typename... Args>
 resumption<typename H::answer_type()> wrap(
     std::function<typename H::body_type()> body, Args&&... args)
 {
-  return resumption<typename H::answer_type()>([=](){
+  return resumption<typename H::answer_type()>(
+      std::allocator_arg, typename cpp_effects_internals::stack_allocator_of<H>::type(), [=](){
     return handle<H>(body, std::forward<Args>(args)...);
   });
 }
@@ -922,7 +1193,8 @@ template <typename H>
 resumption<typename H::answer_type()> wrap_with(
     int64_t label, std::function<typename H::body_type()> body, std::shared_ptr<H> handler)
 {
-  return resumption<typename H::answer_type()>([=](){
+  return resumption<typename H::answer_type()>(
+      std::allocator_arg, cpp_effects_internals::stack_allocator_of<H>::make(*handler), [=](){
     return handle_with<H>(label, body, handler);
   });
 }
@@ -940,7 +1212,8 @@ template <typename H>
 resumption<typename H::answer_type()> wrap_with(
     std::function<typename H::body_type()> body, std::shared_ptr<H> handler)
 {
-  return resumption<typename H::answer_type()>([=](){
+  return resumption<typename H::answer_type()>(
+      std::allocator_arg, cpp_effects_internals::stack_allocator_of<H>::make(*handler), [=](){
     return handle_with<H>(body, handler);
   });
 }
@@ -960,6 +1233,11 @@ resumption<typename H::answer_type()> wrap_with(
 // metaframe, as at this point we cannot know what answer_type and
 // body_type are.
 //
+// Note that we cast the raw pointer rather than the shared pointer:
+// a copy of the shared pointer would live on the stack of the
+// suspended computation, and so the handler captured in a resumption
+// that is never resumed would keep itself alive.
+//
 // E.g. looking for d in [a][b][c][d][e][f][g.]
 // ===>
 // Run d.cmd in [a][b][c.] with r.stack = [d][e][f][g],
@@ -974,14 +1252,11 @@ typename Cmd::out_type invoke_command(int64_t goto_handler, const Cmd& cmd)
   auto cond = [&](const cpp_effects_internals::metaframe_ptr& mf) {
     return mf->label == goto_handler;
   };
-  auto it = std::find_if(metastack.begin(), metastack.end(), cond);
-  if (auto canInvoke = std::dynamic_pointer_cast<can_invoke_command<Cmd>>(*it)) {
+  auto it = std::find_if(metastack().begin(), metastack().end(), cond);
+  if (auto canInvoke = dynamic_cast<can_invoke_command<Cmd>*>(it->get())) {
     return canInvoke->invoke_command(std::next(it), cmd);
   }
-  std::cerr << "error: handler with id " << goto_handler
-            << " does not handle " << typeid(Cmd).name() << std::endl;
-  debug_print_metastack();
-  exit(-1);
+  fatal_error(goto_handler, typeid(Cmd).name());
 }
 
 template <typename Cmd>
@@ -990,13 +1265,12 @@ typename Cmd::out_type invoke_command(const Cmd& cmd)
   using namespace cpp_effects_internals;
 
   // Looking for handler based on the type of the command
-  for (auto it = metastack.begin(); it != metastack.end(); ++it) {
-    if (auto canInvoke = std::dynamic_pointer_cast<can_invoke_command<Cmd>>(*it)) {
+  for (auto it = metastack().begin(); it != metastack().end(); ++it) {
+    if (auto canInvoke = dynamic_cast<can_invoke_command<Cmd>*>(it->get())) {
       return canInvoke->invoke_command(std::next(it), cmd);
     }
   }
-  debug_print_metastack();
-  exit(-1);
+  fatal_error("no handler handles ", typeid(Cmd).name());
 }
 
 template <typename Cmd>
@@ -1004,12 +1278,10 @@ typename Cmd::out_type invoke_command(handler_ref it, const Cmd& cmd)
 {
   using namespace cpp_effects_internals;
 
-  if (auto canInvoke = std::dynamic_pointer_cast<can_invoke_command<Cmd>>(*it)) {
+  if (auto canInvoke = dynamic_cast<can_invoke_command<Cmd>*>(it->get())) {
     return canInvoke->invoke_command(std::next(it), cmd);
   }
-  std::cerr << "error: selected handler does not handle " << typeid(Cmd).name() << std::endl;
-  debug_print_metastack();
-  exit(-1);
+  fatal_error("selected handler does not handle ", typeid(Cmd).name());
 }
 
 template <typename H, typename Cmd>
@@ -1020,14 +1292,11 @@ typename Cmd::out_type static_invoke_command(int64_t goto_handler, const Cmd& cm
   auto cond = [&](const cpp_effects_internals::metaframe_ptr& mf) {
     return mf->label == goto_handler;
   };
-  auto it = std::find_if(metastack.begin(), metastack.end(), cond);
-  if (it != metastack.end()) {
+  auto it = std::find_if(metastack().begin(), metastack().end(), cond);
+  if (it != metastack().end()) {
     return (static_cast<H*>(it->get()))->H::invoke_command(std::next(it), cmd);
   }
-  std::cerr << "error: handler with id " << goto_handler
-            << " does not handle " << typeid(Cmd).name() << std::endl;
-  debug_print_metastack();
-  exit(-1);
+  fatal_error(goto_handler, typeid(Cmd).name());
 }
 
 template <typename H, typename Cmd>
@@ -1035,7 +1304,7 @@ typename Cmd::out_type static_invoke_command(const Cmd& cmd)
 {
   using namespace cpp_effects_internals;
 
-  auto it = metastack.begin();
+  auto it = metastack().begin();
   return (static_cast<H*>(it->get()))->H::invoke_command(std::next(it), cmd);
 }
 
@@ -1053,31 +1322,16 @@ handler_ref find_handler()
   using namespace cpp_effects_internals;
 
   // Looking for handler based on the type of the command
-  for (auto it = metastack.begin(); it != metastack.end(); ++it) {
-    if (std::dynamic_pointer_cast<can_invoke_command<Cmd>>(*it)) {
+  for (auto it = metastack().begin(); it != metastack().end(); ++it) {
+    if (dynamic_cast<can_invoke_command<Cmd>*>(it->get())) {
       return it;
     }
   }
 
-  std::cerr << "error: cpp_effects::find_handler did not find a handler" << std::endl;
-  debug_print_metastack();
-  exit(-1);
+  fatal_error("cpp_effects::find_handler did not find a handler");
 }
 
-handler_ref find_handler(int64_t goto_handler)
-{
-  using namespace cpp_effects_internals;
-
-  auto const cond = [&](const cpp_effects_internals::metaframe_ptr& mf) {
-    return mf->label == goto_handler;
-  };
-  auto it = std::find_if(metastack.begin(), metastack.end(), cond);
-  if (it != metastack.end()) { return it; }
-
-  std::cerr << "error: cpp_effects::find_handler did not find a handler" << std::endl;
-  debug_print_metastack();
-  exit(-1);
-}
+// find_handler(int64_t) is defined in the runtime
 
 } // namespace cpp_effects
 
@@ -0,0 +1,231 @@
+// C++ Effects library
+// Maciej Pirog, Huawei Edinburgh Research Centre, maciej.pirog@huawei.com
+// License: MIT
+
+// This file contains epoch-based memory reclamation with quiescent
+// states (QSBR) for lock-free data structures shared by lightweight
+// threads on many system threads:
+//
+// - epoch_domain -- The global epoch, and the epochs seen by the
+//   system threads that take part in reclamation.
+//
+// - epoch_participant -- A system thread that takes part in
+//   reclamation (online from construction to destruction). It retires
+//   the nodes that it unlinks, and announces quiescent states, that is,
+//   the points at which it holds no pointers to the nodes of shared
+//   structures.
+//
+// If a lightweight thread does not keep pointers to the nodes across
+// commands that suspend it, the system thread is quiescent whenever
+// its scheduler is between resumptions. So, the scheduler announces
+// the quiescent states in its loop, and the operations on the
+// structures need no fences (unlike hazard pointers, which publish and
+// validate every pointer before it is dereferenced). A retired node is
+// freed when every online participant has passed a quiescent state
+// since the node was retired.
+
+#ifndef CPP_EFFECTS_EPOCH_RECLAMATION_H
+#define CPP_EFFECTS_EPOCH_RECLAMATION_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+namespace cpp_effects {
+
+namespace cpp_effects_internals {
+
+// A retired node with its deleter, and the epoch of retiring
+
+struct retired_node {
+  void* ptr;
+  void (*deleter)(void*);
+  uint64_t epoch;
+};
+
+// Frees the nodes retired before the epoch, and keeps the rest
+
+inline void free_retired(std::vector<retired_node>& nodes, uint64_t before)
+{
+  auto kept = std::partition(nodes.begin(), nodes.end(), [&](const retired_node& r) {
+    return r.epoch >= before;
+  });
+  for (auto it = kept; it != nodes.end(); ++it) { it->deleter(it->ptr); }
+  nodes.erase(kept, nodes.end());
+}
+
+} // namespace cpp_effects_internals
+
+class epoch_participant;
+
+// ------------
+// epoch_domain
+// ------------
+
+// Every participant announces the global epoch that it has seen at its
+// last quiescent state (0 when it is offline). When every participant
+// has seen the current epoch, the epoch advances. A node retired in
+// the epoch e is freed when every participant has seen an epoch
+// greater than e, as the global epoch became greater than e after the
+// node was unlinked.
+
+class epoch_domain {
+  friend class epoch_participant;
+public:
+  // max_participants -- online at the same time
+  // reclaim_every -- quiescent states of a participant between its
+  //   attempts to free its retired nodes
+  explicit epoch_domain(std::size_t max_participants = 64, int reclaim_every = 64)
+    : max(max_participants), slots(new slot[max_participants]), reclaim_every(reclaim_every) { }
+  epoch_domain(const epoch_domain&) = delete;
+  epoch_domain& operator=(const epoch_domain&) = delete;
+
+  // Frees all the retired nodes (no participant can be online)
+  ~epoch_domain() { drain(); }
+
+  uint64_t epoch() const { return global.load(); }
+
+  // Frees the nodes retired by the participants that are offline (no
+  // participant can be online)
+  void drain()
+  {
+    std::lock_guard<std::mutex> lock(orphans_mutex);
+    cpp_effects_internals::free_retired(orphans, UINT64_MAX);
+    orphan_count = 0;
+  }
+
+  // The number of the nodes retired by the participants that are
+  // offline, which are not freed yet
+  std::size_t orphaned() const { return orphan_count.load(); }
+
+private:
+  struct alignas(64) slot {
+    std::atomic<uint64_t> epoch{0};
+    std::atomic<bool> used{false};
+  };
+
+  std::atomic<uint64_t> global{1};
+  std::size_t max;
+  std::unique_ptr<slot[]> slots;
+  std::atomic<std::size_t> high{0};  // The slots in use are below high
+  int reclaim_every;
+
+  std::mutex orphans_mutex;
+  std::vector<cpp_effects_internals::retired_node> orphans;
+  std::atomic<std::size_t> orphan_count{0};
+
+  std::size_t claim()
+  {
+    for (std::size_t i = 0; i < max; i++) {
+      bool expected = false;
+      if (!slots[i].used.load() && slots[i].used.compare_exchange_strong(expected, true)) {
+        std::size_t h = high.load();
+        while (h < i + 1 && !high.compare_exchange_weak(h, i + 1)) { }
+        return i;
+      }
+    }
+    throw std::length_error("epoch_domain: too many participants");
+  }
+
+  // The least epoch seen by the online participants (the global epoch
+  // advances if all of them have seen it)
+  uint64_t seen()
+  {
+    uint64_t g = global.load();
+    uint64_t least = g;
+    for (std::size_t i = 0, h = high.load(); i < h; i++) {
+      uint64_t e = slots[i].epoch.load(std::memory_order_acquire);
+      if (e != 0) { least = std::min(least, e); }
+    }
+    if (least == g) { global.compare_exchange_strong(g, g + 1); }
+    return least;
+  }
+
+  void adopt(std::vector<cpp_effects_internals::retired_node>& nodes)
+  {
+    if (nodes.empty()) { return; }
+    std::lock_guard<std::mutex> lock(orphans_mutex);
+    orphans.insert(orphans.end(), nodes.begin(), nodes.end());
+    orphan_count = orphans.size();
+    nodes.clear();
+  }
+
+  void free_orphans(uint64_t before)
+  {
+    std::lock_guard<std::mutex> lock(orphans_mutex);
+    cpp_effects_internals::free_retired(orphans, before);
+    orphan_count = orphans.size();
+  }
+};
+
+// -----------------
+// epoch_participant
+// -----------------
+
+// Used by a single system thread. Throws std::length_error if there
+// are too many participants online.
+
+class epoch_participant {
+public:
+  explicit epoch_participant(epoch_domain& domain) : domain(domain), me(domain.claim())
+  {
+    domain.slots[me].epoch.store(domain.global.load());
+  }
+  epoch_participant(const epoch_participant&) = delete;
+  epoch_participant& operator=(const epoch_participant&) = delete;
+
+  // Goes offline. The nodes that are not freed yet are handed over to
+  // the domain, and freed by the other participants.
+  ~epoch_participant()
+  {
+    domain.slots[me].epoch.store(0);
+    domain.adopt(retired);
+    domain.slots[me].used.store(false);
+  }
+
+  // The participant holds no pointers to the nodes of shared structures
+  void quiescent()
+  {
+    domain.slots[me].epoch.store(domain.global.load(std::memory_order_acquire), std::memory_order_release);
+    if (++since_reclaim >= domain.reclaim_every) {
+      since_reclaim = 0;
+      reclaim();
+    }
+  }
+
+  // Frees p (with delete) when every participant has passed a
+  // quiescent state. The node must be unlinked from the structure.
+  template <typename T>
+  void retire(T* p)
+  {
+    retired.push_back({p, [](void* q) { delete static_cast<T*>(q); }, domain.global.load()});
+  }
+
+  // Tries to advance the epoch, and frees the nodes that are safe to
+  // free (called by quiescent every reclaim_every times)
+  void reclaim()
+  {
+    uint64_t before = domain.seen();
+    cpp_effects_internals::free_retired(retired, before);
+    if (domain.orphan_count.load(std::memory_order_relaxed) > 0) { domain.free_orphans(before); }
+  }
+
+  // The number of the nodes retired by this participant that are not
+  // freed yet
+  std::size_t pending() const { return retired.size(); }
+
+private:
+  epoch_domain& domain;
+  std::size_t me;
+  int since_reclaim = 0;
+  std::vector<cpp_effects_internals::retired_node> retired;
+};
+
+} // namespace cpp_effects
+
+#endif // CPP_EFFECTS_EPOCH_RECLAMATION_H
@@ -0,0 +1,243 @@
+// C++ Effects library
+// Maciej Pirog, Huawei Edinburgh Research Centre, maciej.pirog@huawei.com
+// License: MIT
+
+// This file contains generators and their k-way merge:
+//
+// - generator -- A generator as in examples/generators.cpp, but the
+//   body does not suspend on every yield. Instead, yielded values are
+//   stored in a batch owned by the generator, and the body suspends
+//   only when the batch is full, which amortises the cost of context
+//   switching. With the batch size 1, the body suspends on every
+//   value.
+//
+// - loser_tree -- Tournament tree that selects the least value among k
+//   sorted sources. After the least value is consumed, only the path
+//   from its source to the root is replayed (log k comparisons).
+//
+// - merge -- The merge of sorted generators, which is a generator
+//   itself (e.g., the merge phase of an external sort).
+
+#ifndef CPP_EFFECTS_GENERATOR_H
+#define CPP_EFFECTS_GENERATOR_H
+
+#include <functional>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "cpp-effects/cpp-effects.h"
+#include "cpp-effects/clause-modifiers.h"
+
+namespace cpp_effects {
+
+template <typename T>
+class generator;
+
+namespace cpp_effects_internals {
+
+struct refill : command<> { };
+
+template <typename T>
+struct generator_state {
+  std::vector<T> batch;
+  std::size_t count = 0;  // Number of values in the batch
+  std::size_t pos = 0;    // Position of the consumer in the batch
+  bool done = false;
+  resumption<void()> body;
+};
+
+template <typename T>
+class generator_handler : public flat_handler<void, no_manage<refill>> {
+public:
+  generator_handler(generator_state<T>* state) : state(state) { }
+private:
+  generator_state<T>* state;
+  void handle_command(refill, resumption<void()> r) final override
+  {
+    state->body = std::move(r);
+  }
+};
+
+} // namespace cpp_effects_internals
+
+// ---------------
+// generator_yield
+// ---------------
+
+// Given to the body of a generator, yields the next value
+
+template <typename T>
+class generator_yield {
+  template <typename> friend class generator;
+public:
+  void operator()(const T& x) const
+  {
+    if (state->count == state->batch.size()) {
+      static_invoke_command<cpp_effects_internals::generator_handler<T>>(
+        label, cpp_effects_internals::refill{});
+      state->count = 0;
+    }
+    state->batch[state->count++] = x;
+  }
+private:
+  generator_yield(int64_t label, cpp_effects_internals::generator_state<T>* state)
+    : label(label), state(state) { }
+  int64_t label;
+  cpp_effects_internals::generator_state<T>* state;
+};
+
+// ---------
+// generator
+// ---------
+
+// T must be default constructible (the batch is a vector of values)
+
+template <typename T>
+class generator {
+public:
+  generator(std::function<void(generator_yield<T>)> f, std::size_t batch_size = 256)
+    : state(std::make_unique<cpp_effects_internals::generator_state<T>>())
+  {
+    state->batch.resize(batch_size > 0 ? batch_size : 1);
+    auto label = fresh_label();
+    auto st = state.get();
+    state->body = wrap_with(label, [f = std::move(f), label, st](){
+      f(generator_yield<T>(label, st));
+      st->done = true;
+    }, std::make_shared<cpp_effects_internals::generator_handler<T>>(st));
+    fill();
+  }
+  generator(const generator&) = delete;
+  generator(generator&&) = default;
+  generator& operator=(const generator&) = delete;
+  generator& operator=(generator&&) = default;
+
+  // The current value (the generator must not be exhausted)
+  const T& value() const
+  {
+    return state->batch[state->pos];
+  }
+
+  // Moves to the next value, false if the generator is exhausted
+  bool next()
+  {
+    if (++state->pos == state->count) { fill(); }
+    return (bool)*this;
+  }
+
+  explicit operator bool() const
+  {
+    return state->pos < state->count;
+  }
+
+private:
+  std::unique_ptr<cpp_effects_internals::generator_state<T>> state;
+  void fill()
+  {
+    state->pos = 0;
+    state->count = 0;
+    if (!state->done) {
+      std::move(state->body).resume();
+    }
+  }
+};
+
+// ----------
+// loser_tree
+// ----------
+
+// A source is anything with value(), next(), and explicit operator
+// bool (true if there is a current value), e.g., generator.
+//
+// The internal nodes 1..k-1 of the tree hold the losers of the
+// matches, the node 0 holds the overall winner. The leaves are the
+// sources k..2k-1 (implicit).
+
+template <typename Source>
+class loser_tree {
+public:
+  loser_tree(std::vector<Source>& sources) : sources(sources), k(sources.size()), tree(k)
+  {
+    if (k > 0) { tree[0] = build(1); }
+  }
+
+  // True if all sources are exhausted
+  bool empty() const { return k == 0 || !sources[tree[0]]; }
+
+  // The source with the least current value
+  Source& top() { return sources[tree[0]]; }
+
+  // Selects the new top after the current value of top has changed
+  // (e.g., top().next() was called)
+  void replay()
+  {
+    std::size_t s = tree[0];
+    for (std::size_t t = (s + k) / 2; t > 0; t /= 2) {
+      if (less(tree[t], s)) { std::swap(tree[t], s); }
+    }
+    tree[0] = s;
+  }
+
+private:
+  std::vector<Source>& sources;
+  std::size_t k;
+  std::vector<std::size_t> tree;
+  bool less(std::size_t a, std::size_t b) const
+  {
+    if (!sources[a]) { return false; }
+    if (!sources[b]) { return true; }
+    const auto& va = sources[a].value();
+    const auto& vb = sources[b].value();
+    return va < vb || (!(vb < va) && a < b);
+  }
+  std::size_t build(std::size_t node)
+  {
+    if (node >= k) { return node - k; }
+    std::size_t l = build(2 * node);
+    std::size_t r = build(2 * node + 1);
+    if (less(l, r)) {
+      tree[node] = r;
+      return l;
+    }
+    tree[node] = l;
+    return r;
+  }
+};
+
+// -----
+// merge
+// -----
+
+// The merge of sorted generators (values that compare equal are given
+// in the order of the inputs)
+
+template <typename T>
+generator<T> merge(std::vector<generator<T>> inputs, std::size_t batch_size = 256)
+{
+  auto in = std::make_shared<std::vector<generator<T>>>(std::move(inputs));
+  return generator<T>([in](generator_yield<T> yield) {
+    loser_tree<generator<T>> tree(*in);
+    while (!tree.empty()) {
+      yield(tree.top().value());
+      tree.top().next();
+      tree.replay();
+    }
+  }, batch_size);
+}
+
+template <typename T, typename... Ts>
+generator<T> merge(generator<T> first, generator<Ts>... rest)
+{
+  static_assert((std::is_same<T, Ts>::value && ...), "merge: generators of different types");
+  std::vector<generator<T>> inputs;
+  inputs.reserve(1 + sizeof...(rest));
+  inputs.push_back(std::move(first));
+  (inputs.push_back(std::move(rest)), ...);
+  return merge(std::move(inputs));
+}
+
+} // namespace cpp_effects
+
+#endif // CPP_EFFECTS_GENERATOR_H
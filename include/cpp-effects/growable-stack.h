@@ -0,0 +1,53 @@
+// C++ Effects library
+// Maciej Pirog, Huawei Edinburgh Research Centre, maciej.pirog@huawei.com
+// License: MIT
+
+// This file contains a stack allocator for fibers whose stacks grow on
+// demand. A handler selects it by declaring
+//
+//   using stack_allocator = cpp_effects::growable_stack;
+//
+// Each stack is a large reservation of virtual memory (with a guard
+// page at the bottom) of which only the pages actually touched by the
+// computation are backed by physical memory. So, a shallow generator
+// costs a few pages, while a deeply recursive body can still use
+// megabytes of stack. When a fiber finishes, its stack goes back to a
+// per-thread pool, and the pages below the retained size are given
+// back to the system, so that one deep computation does not make the
+// stacks of all future fibers large.
+//
+// (Boost's segmented_stack would be an alternative, but it requires
+// Boost and all the code run on the stack to be compiled with
+// split-stack support.)
+
+#ifndef CPP_EFFECTS_GROWABLE_STACK_H
+#define CPP_EFFECTS_GROWABLE_STACK_H
+
+#include <cstddef>
+
+#include "cpp-effects/cpp-effects.h"
+
+namespace cpp_effects {
+
+class growable_stack {
+public:
+  // maxSize -- size of the reservation (the maximal size of the stack)
+  // keepSize -- memory retained by a stack returned to the pool
+  growable_stack(std::size_t maxSize = 8 * 1024 * 1024, std::size_t keepSize = 16 * 1024);
+  ctx::stack_context allocate();
+  void deallocate(ctx::stack_context& sctx) noexcept;
+
+  // The number of stacks mapped (i.e., not taken from the pool) by the
+  // current thread
+  static std::size_t mapped_stacks();
+
+  // Maximal number of free stacks kept in the pool of each thread
+  static const std::size_t pool_size = 64;
+private:
+  std::size_t maxSize;
+  std::size_t keepSize;
+};
+
+} // namespace cpp_effects
+
+#endif // CPP_EFFECTS_GROWABLE_STACK_H
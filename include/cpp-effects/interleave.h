@@ -0,0 +1,164 @@
+// C++ Effects library
+// Maciej Pirog, Huawei Edinburgh Research Centre, maciej.pirog@huawei.com
+// License: MIT
+
+// This file contains a light suspend/resume path for interleaving many
+// tiny computations, e.g., lookups in a data structure that does not
+// fit in the cache, which prefetch the next node and yield, so that
+// the misses of different lookups overlap:
+//
+// - interleave(n, width, f) -- Runs f(0), ..., f(n-1) in a group of
+//   width lightweight computations (the members of the group), each of
+//   which takes the next index when it is done with the previous one.
+//
+// - interleave_yield() -- Switches to the next member of the group.
+//
+// A yield is a single switch of fibers from a member directly to the
+// next one in a ring, with no handler, no resumption object, and no
+// scheduler in between, so it costs a few nanoseconds (as opposed to
+// a command with a no_manage clause and a resumption_queue, which goes
+// through the metastack). The price is that the members are not
+// handled computations: a member can invoke only commands with plain
+// clauses (which never capture the computation), and a handler
+// installed by a member must not be active when it yields.
+
+#ifndef CPP_EFFECTS_INTERLEAVE_H
+#define CPP_EFFECTS_INTERLEAVE_H
+
+#include <algorithm>
+#include <cstddef>
+#include <exception>
+#include <vector>
+
+#include <boost/version.hpp>
+
+#include "cpp-effects/cpp-effects.h"
+
+namespace cpp_effects {
+
+namespace cpp_effects_internals {
+
+// A fiber that is destroyed before it is finished is unwound by
+// throwing an exception of type forced_unwind, which a member must not
+// catch. Boost.Context does not expose it publicly, so this is the only
+// place that refers to its internal namespace. It has been there (for
+// every implementation of fibers) since fibers were introduced in
+// Boost 1.69; check it when moving to a new version of Boost.
+
+#if BOOST_VERSION < 106900
+#error "cpp-effects/interleave.h requires Boost 1.69 or later"
+#endif
+
+using fiber_unwind = ctx::detail::forced_unwind;
+
+// The members are 0..width-1, and the fiber of the driver (the caller
+// of interleave) is stored at the index width
+
+class interleave_state {
+public:
+  interleave_state(std::size_t width, std::size_t items)
+    : fibers(width + 1), next(width), prev(width), items(items)
+  {
+    for (std::size_t k = 0; k < width; k++) {
+      next[k] = (k + 1) % width;
+      prev[k] = (k + width - 1) % width;
+    }
+  }
+
+  std::vector<ctx::fiber> fibers;  // The suspended members and driver
+  std::vector<std::size_t> next;   // The ring of the members that are not done
+  std::vector<std::size_t> prev;
+  std::size_t current = 0;         // The running member
+  std::size_t from = 0;            // The member (or driver) that switched to current
+  std::size_t items;
+  std::size_t item = 0;            // The next index to take
+  std::exception_ptr error;
+
+  void yield()
+  {
+    std::size_t k = current;
+    if (next[k] == k) { return; }
+    from = k;
+    current = next[k];
+    ctx::fiber f = std::move(fibers[current]).resume();
+    fibers[from] = std::move(f);
+  }
+
+  // Removes a member that is done from the ring, and gives the fiber to
+  // switch to (the driver if it was the last member)
+  ctx::fiber finish(std::size_t k)
+  {
+    std::size_t n = next[k];
+    if (n == k) {
+      n = next.size();
+    } else {
+      next[prev[k]] = next[k];
+      prev[next[k]] = prev[k];
+    }
+    from = k;
+    current = n;
+    return std::move(fibers[n]);
+  }
+};
+
+inline thread_local interleave_state* current_interleave = nullptr;
+
+} // namespace cpp_effects_internals
+
+// ----------
+// interleave
+// ----------
+
+// If a call to f throws, no more indices are taken, and the exception
+// is rethrown when the other members are done with their current
+// indices. Calls to interleave can be nested in a member.
+
+template <typename F, typename StackAllocator = ctx::fixedsize_stack>
+void interleave(std::size_t n, std::size_t width, F f, StackAllocator alloc = StackAllocator())
+{
+  using namespace cpp_effects_internals;
+
+  std::size_t w = std::min(n, std::max(width, std::size_t(1)));
+  if (w == 0) { return; }
+  interleave_state state(w, n);
+  for (std::size_t k = 0; k < w; k++) {
+    state.fibers[k] = ctx::fiber{std::allocator_arg, recording_stack<StackAllocator>(alloc),
+        [&state, &f, k](ctx::fiber&& caller) -> ctx::fiber {
+      state.fibers[state.from] = std::move(caller);
+      while (!state.error && state.item < state.items) {
+        std::size_t i = state.item++;
+        try {
+          f(i);
+        } catch (const fiber_unwind&) {
+          throw;
+        } catch (...) {
+          if (!state.error) { state.error = std::current_exception(); }
+        }
+      }
+      return state.finish(k);
+    }};
+  }
+
+  interleave_state* outer = current_interleave;
+  current_interleave = &state;
+  state.from = w;
+  state.current = 0;
+  std::move(state.fibers[0]).resume();
+  current_interleave = outer;
+
+  if (state.error) { std::rethrow_exception(state.error); }
+}
+
+// Outside of a group, interleave_yield does nothing (so the same code
+// can run sequentially)
+
+inline void interleave_yield()
+{
+  if (cpp_effects_internals::current_interleave) {
+    cpp_effects_internals::current_interleave->yield();
+  }
+}
+
+} // namespace cpp_effects
+
+#endif // CPP_EFFECTS_INTERLEAVE_H
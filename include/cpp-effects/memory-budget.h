@@ -0,0 +1,127 @@
+// C++ Effects library
+// Maciej Pirog, Huawei Edinburgh Research Centre, maciej.pirog@huawei.com
+// License: MIT
+
+// This file contains the accounting of the memory committed to
+// suspended computations against a budget, which is useful for
+// admission control in schedulers: instead of creating new lightweight
+// threads until the system runs out of memory for their stacks, a
+// scheduler suspends the thread that spawns (backpressure) while the
+// budget is exceeded.
+//
+// - memory_budget -- The counter of committed bytes and the limit.
+//   The counter is atomic, so a budget can be shared by schedulers
+//   running in different threads.
+//
+// - budgeted_stack -- A stack allocator (see stack_allocator_of in
+//   cpp-effects.h) that charges the size of every stack to a budget
+//   for as long as the stack is allocated. A handler selects it by
+//   declaring
+//
+//     using stack_allocator = cpp_effects::budgeted_stack<>;
+//
+// The allocator only does the accounting (allocation never fails
+// because of the budget), while the decision whether to create a
+// computation belongs to the scheduler, which knows which computation
+// to suspend. A scheduler can also charge the memory of its own data
+// (e.g., the handler objects, which hold the runtime data of
+// resumptions) to the same budget.
+
+#ifndef CPP_EFFECTS_MEMORY_BUDGET_H
+#define CPP_EFFECTS_MEMORY_BUDGET_H
+
+#include <atomic>
+#include <cstddef>
+#include <limits>
+
+#include "cpp-effects/cpp-effects.h"
+
+namespace cpp_effects {
+
+// -------------
+// memory_budget
+// -------------
+
+class memory_budget {
+public:
+  memory_budget(std::size_t limit = std::numeric_limits<std::size_t>::max()) : limitBytes(limit) { }
+  memory_budget(const memory_budget&) = delete;
+  memory_budget& operator=(const memory_budget&) = delete;
+
+  void charge(std::size_t bytes)
+  {
+    std::size_t now = committedBytes.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+    std::size_t peak = peakBytes.load(std::memory_order_relaxed);
+    while (now > peak && !peakBytes.compare_exchange_weak(peak, now, std::memory_order_relaxed)) { }
+  }
+
+  // Charges the bytes only if they fit the limit
+  bool try_charge(std::size_t bytes)
+  {
+    std::size_t now = committedBytes.load(std::memory_order_relaxed);
+    do {
+      if (now + bytes > limit()) { return false; }
+    } while (!committedBytes.compare_exchange_weak(now, now + bytes, std::memory_order_relaxed));
+    std::size_t peak = peakBytes.load(std::memory_order_relaxed);
+    while (now + bytes > peak && !peakBytes.compare_exchange_weak(peak, now + bytes, std::memory_order_relaxed)) { }
+    return true;
+  }
+
+  void release(std::size_t bytes)
+  {
+    committedBytes.fetch_sub(bytes, std::memory_order_relaxed);
+  }
+
+  std::size_t committed() const { return committedBytes.load(std::memory_order_relaxed); }
+  std::size_t limit() const { return limitBytes.load(std::memory_order_relaxed); }
+  void set_limit(std::size_t limit) { limitBytes.store(limit, std::memory_order_relaxed); }
+  bool exceeded() const { return committed() >= limit(); }
+
+  // The highest committed memory since the last reset_peak
+  std::size_t peak() const { return peakBytes.load(std::memory_order_relaxed); }
+  void reset_peak() { peakBytes.store(committed(), std::memory_order_relaxed); }
+
+private:
+  std::atomic<std::size_t> committedBytes{0};
+  std::atomic<std::size_t> limitBytes;
+  std::atomic<std::size_t> peakBytes{0};
+};
+
+// The budget of budgeted_stack unless given otherwise (unlimited until
+// set_limit is called)
+
+inline memory_budget& default_memory_budget()
+{
+  static memory_budget budget;
+  return budget;
+}
+
+// --------------
+// budgeted_stack
+// --------------
+
+// Alloc -- the underlying (default-constructible) stack allocator
+// Budget -- the function that gives the budget to charge
+
+template <typename Alloc = ctx::fixedsize_stack, memory_budget& (*Budget)() = default_memory_budget>
+class budgeted_stack {
+public:
+  ctx::stack_context allocate()
+  {
+    ctx::stack_context sctx = alloc.allocate();
+    Budget().charge(sctx.size);
+    return sctx;
+  }
+  void deallocate(ctx::stack_context& sctx) noexcept
+  {
+    std::size_t size = sctx.size;
+    alloc.deallocate(sctx);
+    Budget().release(size);
+  }
+private:
+  Alloc alloc;
+};
+
+} // namespace cpp_effects
+
+#endif // CPP_EFFECTS_MEMORY_BUDGET_H
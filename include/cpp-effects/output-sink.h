@@ -0,0 +1,175 @@
+// C++ Effects library
+// Maciej Pirog, Huawei Edinburgh Research Centre, maciej.pirog@huawei.com
+// License: MIT
+
+// This file contains an output effect for streaming serialisation, in
+// which the producer fills chunks of memory owned by the handler, and
+// the handler hands them over to a sink, so the memory is bounded by
+// the size of a chunk, and no bytes are copied between the producer
+// and the sink:
+//
+// - output_sink -- Consumes the filled parts of chunks (e.g., fd_sink
+//   writes them to a file descriptor).
+//
+// - output -- The handler, which owns a chunk. When the producer has
+//   filled the chunk, it invokes output_flush, and the handler hands
+//   the filled part to the sink, and returns the chunk to be filled
+//   again. The clause is plain, so there is no context switching.
+//
+// - output_writer -- The producer's interface. It caches the reference
+//   to the handler and the current chunk, so writing a byte is only a
+//   bounds check in the common case.
+
+#ifndef CPP_EFFECTS_OUTPUT_SINK_H
+#define CPP_EFFECTS_OUTPUT_SINK_H
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+#include <unistd.h>
+
+#include "cpp-effects/cpp-effects.h"
+#include "cpp-effects/clause-modifiers.h"
+
+namespace cpp_effects {
+
+// ------------
+// output_chunk
+// ------------
+
+struct output_chunk {
+  char* begin;
+  char* end;
+};
+
+// Hands over the filled part of the current chunk, and gives the next
+// chunk (the first chunk is obtained by flushing an empty one)
+
+struct output_flush : command<output_chunk> {
+  output_chunk filled;
+};
+
+// -----------
+// output_sink
+// -----------
+
+// When consume returns, the memory can be reused for the next chunk
+
+class output_sink {
+public:
+  virtual ~output_sink() { }
+  virtual void consume(const char* data, std::size_t size) = 0;
+};
+
+// Writes to a file descriptor (which is not closed). Throws
+// std::system_error if a write fails.
+
+class fd_sink : public output_sink {
+public:
+  explicit fd_sink(int fd) : fd(fd) { }
+
+  // The number of bytes written so far
+  std::size_t written() const { return total; }
+
+  void consume(const char* data, std::size_t size) override
+  {
+    total += size;
+    while (size > 0) {
+      auto n = ::write(fd, data, size);
+      if (n < 0) {
+        if (errno == EINTR) { continue; }
+        throw std::system_error(errno, std::generic_category(), "fd_sink");
+      }
+      data += n;
+      size -= n;
+    }
+  }
+
+private:
+  int fd;
+  std::size_t total = 0;
+};
+
+// ------
+// output
+// ------
+
+template <typename Answer>
+class output : public flat_handler<Answer, plain<output_flush>> {
+public:
+  output(output_sink* sink, std::size_t chunk_size) : sink(sink), buffer(chunk_size) { }
+
+private:
+  output_sink* sink;
+  std::vector<char> buffer;
+
+  output_chunk handle_command(output_flush f) final override
+  {
+    if (f.filled.begin != f.filled.end) {
+      sink->consume(f.filled.begin, f.filled.end - f.filled.begin);
+    }
+    return {buffer.data(), buffer.data() + buffer.size()};
+  }
+};
+
+// -------------
+// output_writer
+// -------------
+
+// Writes to the given output handler. The rest of the current chunk is
+// handed over when the writer is destroyed.
+
+template <typename Answer>
+class output_writer {
+public:
+  explicit output_writer(handler_ref href) : href(href)
+  {
+    chunk = static_invoke_command<output<Answer>>(href, output_flush{{}, {nullptr, nullptr}});
+    pos = chunk.begin;
+  }
+  output_writer(const output_writer&) = delete;
+  output_writer& operator=(const output_writer&) = delete;
+  ~output_writer() { flush(); }
+
+  void put(char c)
+  {
+    if (pos == chunk.end) { next(); }
+    *pos++ = c;
+  }
+
+  void write(const char* data, std::size_t size)
+  {
+    while (size > 0) {
+      if (pos == chunk.end) { next(); }
+      std::size_t n = std::min<std::size_t>(size, chunk.end - pos);
+      std::memcpy(pos, data, n);
+      pos += n;
+      data += n;
+      size -= n;
+    }
+  }
+
+  void write(std::string_view s) { write(s.data(), s.size()); }
+
+  // Hands over the filled part of the chunk
+  void flush() { next(); }
+
+private:
+  handler_ref href;
+  output_chunk chunk;
+  char* pos;
+
+  void next()
+  {
+    chunk = static_invoke_command<output<Answer>>(href, output_flush{{}, {chunk.begin, pos}});
+    pos = chunk.begin;
+  }
+};
+
+} // namespace cpp_effects
+
+#endif // CPP_EFFECTS_OUTPUT_SINK_H
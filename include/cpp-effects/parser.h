@@ -0,0 +1,395 @@
+// C++ Effects library
+// Maciej Pirog, Huawei Edinburgh Research Centre, maciej.pirog@huawei.com
+// License: MIT
+
+// This file contains parser combinators, in which the primitive
+// operations (peek at the rest of the input, advance, fail, and
+// save/restore the position) are commands handled by a parser handler
+// that owns the input:
+//
+// - parser -- The handler, and the primitive operations and
+//   combinators as its static members. The clauses are plain, so
+//   parsing never switches contexts, and lexical rules scan the input
+//   directly, so that there is a command per token rather than per
+//   character. Failure is sticky: it makes the rest of the alternative
+//   see the end of the input, until the nearest choice point
+//   backtracks to the saved position (so no resumption is ever copied
+//   or discarded). Packrat memoization is opt-in per rule (memo).
+//
+// - parser_input -- The command invoked by the parser when a rule
+//   needs more input than there is in the buffer (incremental input).
+//   The grammar does not know where the input comes from, e.g., the
+//   handler of parser_input can read a file, or suspend the parser
+//   until more data arrives (push_parser).
+//
+// - push_parser -- A parser that is fed the input in chunks.
+
+#ifndef CPP_EFFECTS_PARSER_H
+#define CPP_EFFECTS_PARSER_H
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include "cpp-effects/cpp-effects.h"
+#include "cpp-effects/clause-modifiers.h"
+
+namespace cpp_effects {
+
+// The next chunk of the input (valid until the next parser_input), or
+// an empty string at the end of the input
+
+struct parser_input : command<std::string_view> { };
+
+namespace cpp_effects_internals {
+
+// The rest of the buffer, and whether there can be more input
+
+struct parser_buffer {
+  std::string_view rest;
+  bool final;
+};
+
+struct parser_rest : command<parser_buffer> { };
+struct parser_advance : command<> { std::size_t n; };
+struct parser_fail : command<> { };
+struct parser_failed : command<bool> { };
+struct parser_mark : command<std::size_t> { };
+struct parser_seek : command<> { std::size_t pos; };
+struct parser_more : command<bool> { };
+struct parser_cut : command<> { };
+
+} // namespace cpp_effects_internals
+
+// ------
+// parser
+// ------
+
+// Positions are offsets from the beginning of the entire input (so they
+// are not affected by cut)
+
+class parser : public handler<bool, void,
+    plain<cpp_effects_internals::parser_rest>, plain<cpp_effects_internals::parser_advance>,
+    plain<cpp_effects_internals::parser_fail>, plain<cpp_effects_internals::parser_failed>,
+    plain<cpp_effects_internals::parser_mark>, plain<cpp_effects_internals::parser_seek>,
+    plain<cpp_effects_internals::parser_more>, plain<cpp_effects_internals::parser_cut>> {
+public:
+  // complete -- if false, more input is requested with parser_input
+  parser(std::string_view input, bool complete = true) : input(input), complete(complete) { }
+
+  // Parses the entire input (the answer is true if the body succeeds
+  // and consumes the entire input)
+  template <typename F>
+  static bool parse(std::string_view input, F body)
+  {
+    return handle<parser>([&](){ body(); end_of_input(); }, input);
+  }
+
+  // Parses the input given in chunks by the handler of parser_input
+  template <typename F>
+  static bool parse_incremental(F body)
+  {
+    return handle<parser>([&](){ body(); end_of_input(); }, std::string_view(), false);
+  }
+
+  // The primitive operations assume that the parser is the innermost
+  // handler, so that the handler is not searched for, and the clauses
+  // are called directly
+
+  // The input in the buffer from the current position (empty after a
+  // failure)
+  static std::string_view rest()
+  {
+    return static_invoke_command<parser>(cpp_effects_internals::parser_rest{}).rest;
+  }
+
+  // Requests the next chunk of the input, false at the end of the input
+  // (or after a failure). The views given by rest are invalidated.
+  static bool more()
+  {
+    return static_invoke_command<parser>(cpp_effects_internals::parser_more{});
+  }
+
+  // At least n characters of the input from the current position (fewer
+  // only at the end of the input)
+  static std::string_view rest(std::size_t n)
+  {
+    auto b = static_invoke_command<parser>(cpp_effects_internals::parser_rest{});
+    while (b.rest.size() < n && !b.final && more()) {
+      b = static_invoke_command<parser>(cpp_effects_internals::parser_rest{});
+    }
+    return b.rest;
+  }
+
+  static void advance(std::size_t n = 1)
+  {
+    static_invoke_command<parser>(cpp_effects_internals::parser_advance{{}, n});
+  }
+  static void fail()
+  {
+    static_invoke_command<parser>(cpp_effects_internals::parser_fail{});
+  }
+  static bool failed()
+  {
+    return static_invoke_command<parser>(cpp_effects_internals::parser_failed{});
+  }
+  static std::size_t mark()
+  {
+    return static_invoke_command<parser>(cpp_effects_internals::parser_mark{});
+  }
+
+  // Goes back to a position (that is not before the last cut), and
+  // clears the failure
+  static void seek(std::size_t pos)
+  {
+    static_invoke_command<parser>(cpp_effects_internals::parser_seek{{}, pos});
+  }
+
+  // Drops the input before the current position from the buffer, which
+  // is useful for long streams (the grammar must not go back before it)
+  static void cut()
+  {
+    static_invoke_command<parser>(cpp_effects_internals::parser_cut{});
+  }
+
+  // The rest of the input for lexical rules, which requests more input
+  // when a rule looks past the end of the buffer:
+  //
+  //   parser::lookahead r;
+  //   std::size_t n = 0;
+  //   while (r[n] >= '0' && r[n] <= '9') { n++; }
+  //   parser::advance(n);
+  class lookahead {
+  public:
+    lookahead() : b(static_invoke_command<parser>(cpp_effects_internals::parser_rest{})) { }
+    // The character at the offset i, or -1 at the end of the input
+    int operator[](std::size_t i)
+    {
+      while (i >= b.rest.size()) {
+        if (b.final || !more()) { return -1; }
+        b = static_invoke_command<parser>(cpp_effects_internals::parser_rest{});
+      }
+      return (unsigned char)b.rest[i];
+    }
+  private:
+    cpp_effects_internals::parser_buffer b;
+  };
+
+  // -----------
+  // Combinators
+  // -----------
+
+  // The next character, or -1 at the end of the input (or after a failure)
+  static int peek()
+  {
+    std::string_view r = rest(1);
+    return r.empty() ? -1 : (unsigned char)r[0];
+  }
+
+  static void ch(char c)
+  {
+    if (peek() == (unsigned char)c) { advance(); } else { fail(); }
+  }
+
+  static void keyword(std::string_view s)
+  {
+    if (rest(s.size()).substr(0, s.size()) == s) { advance(s.size()); } else { fail(); }
+  }
+
+  static void spaces()
+  {
+    lookahead r;
+    std::size_t n = 0;
+    for (int c = r[0]; c == ' ' || c == '\n' || c == '\t' || c == '\r'; c = r[++n]) { }
+    advance(n);
+  }
+
+  // Fails unless at the end of the input
+  static void end_of_input()
+  {
+    if (!rest(1).empty()) { fail(); }
+  }
+
+  // The combinators that backtrack (alt, many, and memo) do nothing
+  // but run the rule after a failure, so that backtracking never clears
+  // a failure that happened before the combinator
+
+  // Ordered choice: if an alternative fails, backtrack and try the
+  // next one
+  template <typename P>
+  static auto alt(P p)
+  {
+    return p();
+  }
+  template <typename P, typename... Ps>
+  static auto alt(P p, Ps... ps)
+  {
+    if (failed()) { return p(); }
+    std::size_t start = mark();
+    auto x = p();
+    if (!failed()) { return x; }
+    seek(start);
+    return alt(ps...);
+  }
+
+  // Runs p as long as it succeeds, and passes the results to f
+  template <typename P, typename F>
+  static void many(P p, F f)
+  {
+    if (failed()) { return; }
+    while (true) {
+      std::size_t start = mark();
+      auto x = p();
+      if (failed()) { seek(start); return; }
+      f(x);
+    }
+  }
+
+  // Packrat memoization of a rule: the result (and the end position) of
+  // the rule at each position is computed at most once
+  template <typename T>
+  class memo {
+  public:
+    void clear() { table.clear(); }
+    template <typename P>
+    T operator()(P p)
+    {
+      if (failed()) { return p(); }
+      std::size_t start = mark();
+      auto it = table.find(start);
+      if (it != table.end()) {
+        if (it->second.failed) { fail(); } else { seek(it->second.end); }
+        return it->second.value;
+      }
+      T x = p();
+      bool f = failed();
+      table[start] = {f, f ? start : mark(), x};
+      return x;
+    }
+  private:
+    struct entry {
+      bool failed;
+      std::size_t end;
+      T value;
+    };
+    std::unordered_map<std::size_t, entry> table;
+  };
+
+private:
+  std::string_view input;  // The buffer (a view of the entire input, or of buffer)
+  std::string buffer;      // The chunks of incremental input
+  std::size_t base = 0;    // The position of input[0]
+  std::size_t pos = 0;
+  bool failed_ = false;
+  bool complete;
+
+  cpp_effects_internals::parser_buffer handle_command(cpp_effects_internals::parser_rest) override
+  {
+    if (failed_) { return {std::string_view(), true}; }
+    return {input.substr(pos - base), complete};
+  }
+  void handle_command(cpp_effects_internals::parser_advance a) override
+  {
+    if (!failed_) { pos += a.n; }
+  }
+  void handle_command(cpp_effects_internals::parser_fail) override
+  {
+    failed_ = true;
+  }
+  bool handle_command(cpp_effects_internals::parser_failed) override
+  {
+    return failed_;
+  }
+  std::size_t handle_command(cpp_effects_internals::parser_mark) override
+  {
+    return pos;
+  }
+  void handle_command(cpp_effects_internals::parser_seek s) override
+  {
+    pos = s.pos;
+    failed_ = false;
+  }
+  bool handle_command(cpp_effects_internals::parser_more) override
+  {
+    if (failed_ || complete) { return false; }
+    std::string_view chunk = cpp_effects::invoke_command(parser_input{});
+    if (chunk.empty()) {
+      complete = true;
+      return false;
+    }
+    buffer.append(chunk);
+    input = buffer;
+    return true;
+  }
+  void handle_command(cpp_effects_internals::parser_cut) override
+  {
+    if (buffer.empty()) { return; }  // Not incremental, or no input yet
+    buffer.erase(0, pos - base);
+    input = buffer;
+    base = pos;
+  }
+  bool handle_return() override
+  {
+    return !failed_;
+  }
+};
+
+// -----------
+// push_parser
+// -----------
+
+// The parser runs until it needs more input than has been fed, and
+// then it is suspended until the next chunk
+
+class push_parser {
+public:
+  template <typename F>
+  push_parser(F body)
+  {
+    handle<feeder>([this, body](){
+      result = parser::parse_incremental(body);
+      finished = true;
+    }, this);
+  }
+  push_parser(const push_parser&) = delete;
+  push_parser& operator=(const push_parser&) = delete;
+
+  // Gives the next (non-empty) chunk of the input, which is parsed as
+  // far as possible
+  void feed(std::string_view chunk)
+  {
+    if (!finished && !chunk.empty()) { std::move(waiting).resume(chunk); }
+  }
+
+  // Ends the input, and gives the result of the parser
+  bool finish()
+  {
+    while (!finished) { std::move(waiting).resume(std::string_view()); }
+    return result;
+  }
+
+  // True if the parser does not need more input (e.g., it has failed)
+  bool done() const { return finished; }
+
+private:
+  resumption<void(std::string_view)> waiting;
+  bool finished = false;
+  bool result = false;
+
+  class feeder : public flat_handler<void, parser_input> {
+  public:
+    feeder(push_parser* p) : p(p) { }
+  private:
+    push_parser* p;
+    void handle_command(parser_input, resumption<void(std::string_view)> r) override
+    {
+      p->waiting = std::move(r);
+    }
+  };
+};
+
+} // namespace cpp_effects
+
+#endif // CPP_EFFECTS_PARSER_H
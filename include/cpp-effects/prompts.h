@@ -0,0 +1,243 @@
+// C++ Effects library
+// Maciej Pirog, Huawei Edinburgh Research Centre, maciej.pirog@huawei.com
+// License: MIT
+
+// This file contains typed delimited control operators in the style of
+// Dybvig, Peyton Jones, and Sabry, implemented directly on the
+// metastack:
+//
+// - new_prompt<A>() -- creates a fresh prompt for delimited
+//   computations with the answer type A,
+//
+// - push_prompt(p, body) -- runs body delimited by the prompt p,
+//
+// - take_subcont<B>(p, f) -- captures the subcontinuation up to (and
+//   including) the innermost p, and passes it to f, whose result
+//   becomes the result of the corresponding push_prompt,
+//
+// - push_subcont(k, b) -- resumes a captured subcontinuation.
+//
+// So, take_subcont behaves like shift0/control0 (the prompt is removed
+// while f runs, but is a part of the subcontinuation). The same can be
+// encoded with a handler of a command that carries the function (see
+// examples/shift0-reset.cpp), but the prompts are cheaper: a prompt
+// remembers its position on the metastack, so taking a subcontinuation
+// does not search for the handler, and the function given to
+// take_subcont is a template argument, so it is never wrapped in a
+// std::function. A subcontinuation is an ordinary resumption, whose
+// data lives on the stack of the captured computation.
+//
+// A prompt can be pushed many times, also nested, in which case
+// take_subcont refers to the innermost push on the current metastack.
+// The position of a prompt is known as long as it has only one frame
+// (pushed, or captured in a subcontinuation), which is the common case
+// of a fresh prompt per delimited computation. Otherwise, take_subcont
+// falls back to a search of the metastack (as for handlers), and the
+// position is remembered again when the prompt has one frame left.
+// Taking a subcontinuation for a prompt that is pushed, but captured
+// rather than on the current metastack, is undefined behaviour.
+
+#ifndef CPP_EFFECTS_PROMPTS_H
+#define CPP_EFFECTS_PROMPTS_H
+
+#include "cpp-effects/cpp-effects.h"
+
+namespace cpp_effects {
+
+namespace cpp_effects_internals {
+
+// The state shared by all the pushes of a prompt
+
+struct prompt_state {
+  int64_t label;
+  int64_t frames = 0;    // Number of frames alive (pushed or captured)
+  bool known = false;    // Is position the only frame?
+  handler_ref position{};
+};
+
+// The frame pushed on the metastack by push_prompt
+
+class prompt_frame : public metaframe {
+public:
+  prompt_frame(std::shared_ptr<prompt_state> state) : state(std::move(state))
+  {
+    label = this->state->label;
+    this->state->frames++;
+  }
+  virtual ~prompt_frame()
+  {
+    if (--state->frames == 0) { state->known = false; }
+  }
+  virtual void debug_print() const override
+  {
+    print_frame(label, "prompt", {});
+  }
+private:
+  std::shared_ptr<prompt_state> state;
+};
+
+// The type of subcontinuations (with B = void, they take no argument)
+
+template <typename A, typename B>
+struct subcont_type {
+  using type = resumption<A(B)>;
+};
+
+template <typename A>
+struct subcont_type<A, void> {
+  using type = resumption<A()>;
+};
+
+} // namespace cpp_effects_internals
+
+// -------
+// Prompts
+// -------
+
+template <typename A>
+class prompt {
+  template <typename T> friend prompt<T> new_prompt();
+  template <typename T, typename F> friend T push_prompt(const prompt<T>& p, F body);
+  template <typename B, typename T, typename F> friend B take_subcont(const prompt<T>& p, F f);
+public:
+  using answer_type = A;
+  prompt() { }
+private:
+  std::shared_ptr<cpp_effects_internals::prompt_state> state;
+};
+
+template <typename A>
+prompt<A> new_prompt()
+{
+  prompt<A> p;
+  p.state = std::make_shared<cpp_effects_internals::prompt_state>();
+  p.state->label = fresh_label();
+  return p;
+}
+
+// ------------
+// Pushing body
+// ------------
+
+template <typename A, typename F>
+A push_prompt(const prompt<A>& p, F body)
+{
+  using namespace cpp_effects_internals;
+
+  // As in handle_with, the body is moved into the fiber, and the stack
+  // is recorded in the frame
+
+  auto frame = std::make_shared<prompt_frame>(p.state);
+  ctx::fiber bodyFiber{std::allocator_arg, recording_stack<ctx::fixedsize_stack>(ctx::fixedsize_stack(), *frame),
+      [&state = p.state, frame = std::move(frame), body = std::move(body)](ctx::fiber&& prev) mutable -> ctx::fiber&& {
+    metastack().front()->fiber = std::move(prev);
+    metastack().push_front(std::move(frame));
+    state->known = (state->frames == 1);
+    state->position = metastack().begin();
+
+    if constexpr (!std::is_void<A>::value) {
+      A a = body();
+      metastack().pop_front();
+      std::move(metastack().front()->fiber).resume_with([&](ctx::fiber&&) -> ctx::fiber {
+        *(static_cast<std::optional<A>*>(metastack().front()->return_buffer)) = std::move(a);
+        return ctx::fiber();
+      });
+    } else {
+      body();
+      metastack().pop_front();
+      std::move(metastack().front()->fiber).resume_with([&](ctx::fiber&&) -> ctx::fiber {
+        return ctx::fiber();
+      });
+    }
+
+    // Unreachable: this fiber is now destroyed
+    fatal_error("impossible!");
+  }};
+
+  if constexpr (!std::is_void<A>::value) {
+    std::optional<A> answer;
+    void* prevBuffer = metastack().front()->return_buffer;
+    metastack().front()->return_buffer = &answer;
+    std::move(bodyFiber).resume();
+
+    // Trampoline tail-resumes
+    while (tail_resumption.has_value()) {
+      resumption_base* temp = *tail_resumption;
+      tail_resumption = {};
+      temp->tail_resume();
+    }
+
+    metastack().front()->return_buffer = prevBuffer;
+    return std::move(*answer);
+  } else {
+    std::move(bodyFiber).resume();
+
+    // Trampoline tail-resumes
+    while (tail_resumption.has_value()) {
+      resumption_base* temp = *tail_resumption;
+      tail_resumption = {};
+      temp->tail_resume();
+    }
+  }
+}
+
+// -----------------------------------
+// Taking and pushing subcontinuations
+// -----------------------------------
+
+template <typename B, typename A, typename F>
+B take_subcont(const prompt<A>& p, F f)
+{
+  using namespace cpp_effects_internals;
+  using Subcont = typename subcont_type<A, B>::type;
+
+  prompt_state& state = *p.state;
+  if (!state.known) {
+    state.position = find_handler(state.label);
+    state.known = (state.frames == 1);
+  }
+
+  // The data of the subcontinuation lives on the stack of the captured
+  // computation, which is alive for as long as the subcontinuation
+  resumption_data<B, A> rd;
+  rd.stored_metastack.splice(
+      rd.stored_metastack.begin(), metastack(), metastack().begin(), std::next(state.position));
+  rd.registry_add();
+
+  std::move(metastack().front()->fiber).resume_with([&](ctx::fiber&& prev) -> ctx::fiber {
+    rd.stored_metastack.front()->fiber = std::move(prev);
+
+    // The function is moved to the current stack, as f can discard the
+    // subcontinuation (and so the stack on which f is stored)
+    F g(std::move(f));
+    if constexpr (!std::is_void<A>::value) {
+      *(static_cast<std::optional<A>*>(metastack().front()->return_buffer)) = g(Subcont(rd));
+    } else {
+      g(Subcont(rd));
+    }
+    return ctx::fiber();
+  });
+
+  // If the control reaches here, the subcontinuation is being resumed
+  if constexpr (!std::is_void<B>::value) {
+    B result = std::move(rd.command_result_buffer->value);
+    rd.command_result_buffer = {};
+    return result;
+  }
+}
+
+template <typename A, typename B, typename V>
+A push_subcont(resumption<A(B)> k, V&& value)
+{
+  return std::move(k).resume(B(std::forward<V>(value)));
+}
+
+template <typename A>
+A push_subcont(resumption<A()> k)
+{
+  return std::move(k).resume();
+}
+
+} // namespace cpp_effects
+
+#endif // CPP_EFFECTS_PROMPTS_H
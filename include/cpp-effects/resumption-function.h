@@ -0,0 +1,137 @@
+// C++ Effects library
+// Maciej Pirog, Huawei Edinburgh Research Centre, maciej.pirog@huawei.com
+// License: MIT
+
+// This file contains resumption_function, a move-only callable that
+// can hold a resumption, which is useful when a handler interprets a
+// computation as a function (e.g., state as a function from the
+// initial state, or shift0 that gives the continuation as a
+// function). Unlike std::function, it does not require the callable to
+// be copyable (so it can capture a resumption instead of the released
+// resumption_data, which is destroyed when the function is dropped),
+// and it stores the callable in a fixed buffer inside the object, so
+// it never allocates. A callable that does not fit the buffer is a
+// compile-time error.
+
+#ifndef CPP_EFFECTS_RESUMPTION_FUNCTION_H
+#define CPP_EFFECTS_RESUMPTION_FUNCTION_H
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include "cpp-effects/cpp-effects.h"
+
+namespace cpp_effects {
+
+template <typename T, std::size_t Size = 4 * sizeof(void*)>
+class resumption_function;
+
+template <typename Answer, typename... Args, std::size_t Size>
+class resumption_function<Answer(Args...), Size> {
+public:
+  resumption_function() { }
+  template <typename F, typename = std::enable_if_t<
+    !std::is_same<std::decay_t<F>, resumption_function>::value>>
+  resumption_function(F&& f)
+  {
+    using T = std::decay_t<F>;
+    static_assert(sizeof(T) <= Size,
+      "resumption_function: the callable does not fit the buffer");
+    static_assert(alignof(T) <= alignof(std::max_align_t),
+      "resumption_function: the callable is over-aligned");
+    static_assert(std::is_nothrow_move_constructible<T>::value,
+      "resumption_function: the callable must be nothrow move constructible");
+    new (buffer) T(std::forward<F>(f));
+    ops = &operations<T>;
+  }
+  resumption_function(const resumption_function&) = delete;
+  resumption_function(resumption_function&& other) noexcept
+  {
+    if (other.ops) {
+      other.ops->move(other.buffer, buffer);
+      ops = other.ops;
+      other.ops = nullptr;
+    }
+  }
+  resumption_function& operator=(const resumption_function&) = delete;
+  resumption_function& operator=(resumption_function&& other) noexcept
+  {
+    if (this != &other) {
+      reset();
+      if (other.ops) {
+        other.ops->move(other.buffer, buffer);
+        ops = other.ops;
+        other.ops = nullptr;
+      }
+    }
+    return *this;
+  }
+  ~resumption_function()
+  {
+    reset();
+  }
+  explicit operator bool() const
+  {
+    return ops != nullptr;
+  }
+  Answer operator()(Args... args)
+  {
+    return ops->invoke(buffer, std::forward<Args>(args)...);
+  }
+private:
+  struct operations_table {
+    Answer (*invoke)(void*, Args&&...);
+    void (*move)(void*, void*);  // Moves to uninitialised memory and destroys the source
+    void (*destroy)(void*);
+  };
+
+  template <typename T>
+  static constexpr operations_table operations = {
+    [](void* f, Args&&... args) -> Answer {
+      return (*static_cast<T*>(f))(std::forward<Args>(args)...);
+    },
+    [](void* from, void* to) {
+      new (to) T(std::move(*static_cast<T*>(from)));
+      static_cast<T*>(from)->~T();
+    },
+    [](void* f) {
+      static_cast<T*>(f)->~T();
+    }
+  };
+
+  void reset()
+  {
+    if (ops) {
+      ops->destroy(buffer);
+      ops = nullptr;
+    }
+  }
+
+  alignas(std::max_align_t) unsigned char buffer[Size];
+  const operations_table* ops = nullptr;
+};
+
+// The resumption as a function that can be called once (the
+// resumption is destroyed if the function is dropped without a call)
+
+template <typename Out, typename Answer>
+resumption_function<Answer(Out)> as_function(resumption<Answer(Out)> r)
+{
+  return [r = std::move(r)](Out x) mutable -> Answer {
+    return std::move(r).resume(std::move(x));
+  };
+}
+
+template <typename Answer>
+resumption_function<Answer()> as_function(resumption<Answer()> r)
+{
+  return [r = std::move(r)]() mutable -> Answer {
+    return std::move(r).resume();
+  };
+}
+
+} // namespace cpp_effects
+
+#endif // CPP_EFFECTS_RESUMPTION_FUNCTION_H
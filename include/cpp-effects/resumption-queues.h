@@ -0,0 +1,335 @@
+// C++ Effects library
+// Maciej Pirog, Huawei Edinburgh Research Centre, maciej.pirog@huawei.com
+// License: MIT
+
+// This file contains intrusive containers of resumptions, which are
+// useful for implementing schedulers. The links of the containers
+// live inside the resumption's own runtime data (resumption_base),
+// so parking and unparking a suspended computation never allocates:
+//
+// - resumption_queue -- FIFO queue (e.g., round-robin schedulers),
+//
+// - resumption_stack -- LIFO stack (e.g., work-stealing "most recent
+//   first" policies),
+//
+// - resumption_heap -- Min-heap ordered by an int64_t key given on
+//   push (e.g., priorities or wake-up deadlines),
+//
+// - resumption_run_queue -- FIFO queue with a "run next" slot for the
+//   most recently woken resumption (e.g., the receiver of a message),
+//   which runs before the rest of the queue while its stack and the
+//   message are still in the cache.
+//
+// The containers own the resumptions that they store: when a
+// container is destroyed, the remaining resumptions are destroyed
+// too. A resumption can be stored in at most one container at a
+// time (which is natural, as resumptions are one-shot).
+
+#ifndef CPP_EFFECTS_RESUMPTION_QUEUES_H
+#define CPP_EFFECTS_RESUMPTION_QUEUES_H
+
+#include "cpp-effects/cpp-effects.h"
+
+namespace cpp_effects {
+
+namespace cpp_effects_internals {
+
+// The type of the pointer released by resumption<T>
+
+template <typename T>
+using resumption_data_ptr = decltype(std::declval<resumption<T>&>().release());
+
+} // namespace cpp_effects_internals
+
+// ----------------
+// resumption_queue
+// ----------------
+
+template <typename T>
+class resumption_queue {
+public:
+  resumption_queue() { }
+  resumption_queue(const resumption_queue&) = delete;
+  resumption_queue(resumption_queue&& other) : head(other.head), tail(other.tail), count(other.count)
+  {
+    other.head = other.tail = nullptr;
+    other.count = 0;
+  }
+  resumption_queue& operator=(const resumption_queue&) = delete;
+  resumption_queue& operator=(resumption_queue&& other)
+  {
+    if (this != &other) {
+      clear();
+      head = other.head; tail = other.tail; count = other.count;
+      other.head = other.tail = nullptr;
+      other.count = 0;
+    }
+    return *this;
+  }
+  ~resumption_queue() { clear(); }
+  bool empty() const { return head == nullptr; }
+  std::size_t size() const { return count; }
+  void push_back(resumption<T> r)
+  {
+    resumption_base* d = r.release();
+    d->next_link = nullptr;
+    if (tail) { tail->next_link = d; } else { head = d; }
+    tail = d;
+    count++;
+  }
+  void push_front(resumption<T> r)
+  {
+    resumption_base* d = r.release();
+    d->next_link = head;
+    head = d;
+    if (!tail) { tail = d; }
+    count++;
+  }
+  resumption<T> pop_front()
+  {
+    resumption_base* d = head;
+    head = d->next_link;
+    if (!head) { tail = nullptr; }
+    d->next_link = nullptr;
+    count--;
+    return resumption<T>(static_cast<cpp_effects_internals::resumption_data_ptr<T>>(d));
+  }
+  void clear()
+  {
+    while (head) { pop_front(); }
+  }
+private:
+  resumption_base* head = nullptr;
+  resumption_base* tail = nullptr;
+  std::size_t count = 0;
+};
+
+// ----------------
+// resumption_stack
+// ----------------
+
+template <typename T>
+class resumption_stack {
+public:
+  resumption_stack() { }
+  resumption_stack(const resumption_stack&) = delete;
+  resumption_stack(resumption_stack&& other) : top(other.top), count(other.count)
+  {
+    other.top = nullptr;
+    other.count = 0;
+  }
+  resumption_stack& operator=(const resumption_stack&) = delete;
+  resumption_stack& operator=(resumption_stack&& other)
+  {
+    if (this != &other) {
+      clear();
+      top = other.top; count = other.count;
+      other.top = nullptr;
+      other.count = 0;
+    }
+    return *this;
+  }
+  ~resumption_stack() { clear(); }
+  bool empty() const { return top == nullptr; }
+  std::size_t size() const { return count; }
+  void push(resumption<T> r)
+  {
+    resumption_base* d = r.release();
+    d->next_link = top;
+    top = d;
+    count++;
+  }
+  resumption<T> pop()
+  {
+    resumption_base* d = top;
+    top = d->next_link;
+    d->next_link = nullptr;
+    count--;
+    return resumption<T>(static_cast<cpp_effects_internals::resumption_data_ptr<T>>(d));
+  }
+  void clear()
+  {
+    while (top) { pop(); }
+  }
+private:
+  resumption_base* top = nullptr;
+  std::size_t count = 0;
+};
+
+// ---------------
+// resumption_heap
+// ---------------
+
+// A pairing heap: push is O(1), pop is amortised O(log n). The
+// resumption with the smallest key is popped first, ties are broken
+// in favour of the resumption pushed earlier when possible, but the
+// order of equal keys is not guaranteed.
+
+template <typename T>
+class resumption_heap {
+public:
+  resumption_heap() { }
+  resumption_heap(const resumption_heap&) = delete;
+  resumption_heap(resumption_heap&& other) : root(other.root), count(other.count)
+  {
+    other.root = nullptr;
+    other.count = 0;
+  }
+  resumption_heap& operator=(const resumption_heap&) = delete;
+  resumption_heap& operator=(resumption_heap&& other)
+  {
+    if (this != &other) {
+      clear();
+      root = other.root; count = other.count;
+      other.root = nullptr;
+      other.count = 0;
+    }
+    return *this;
+  }
+  ~resumption_heap() { clear(); }
+  bool empty() const { return root == nullptr; }
+  std::size_t size() const { return count; }
+  int64_t top_key() const { return root->key_link; }
+  void push(resumption<T> r, int64_t key)
+  {
+    resumption_base* d = r.release();
+    d->next_link = nullptr;
+    d->child_link = nullptr;
+    d->key_link = key;
+    root = meld(root, d);
+    count++;
+  }
+  resumption<T> pop()
+  {
+    resumption_base* d = root;
+    root = merge_pairs(d->child_link);
+    d->child_link = nullptr;
+    count--;
+    return resumption<T>(static_cast<cpp_effects_internals::resumption_data_ptr<T>>(d));
+  }
+  void clear()
+  {
+    while (root) { pop(); }
+  }
+private:
+  resumption_base* root = nullptr;
+  std::size_t count = 0;
+
+  // Both arguments are roots of heaps without siblings
+  static resumption_base* meld(resumption_base* a, resumption_base* b)
+  {
+    if (!a) { return b; }
+    if (!b) { return a; }
+    if (b->key_link < a->key_link) { std::swap(a, b); }
+    b->next_link = a->child_link;
+    a->child_link = b;
+    return a;
+  }
+
+  // The standard two-pass merge: meld the siblings in pairs left to
+  // right, then meld the pairs right to left (we keep the pairs on a
+  // reversed list, so that both passes are iterative).
+  static resumption_base* merge_pairs(resumption_base* first)
+  {
+    resumption_base* pairs = nullptr;
+    while (first) {
+      resumption_base* a = first;
+      resumption_base* b = a->next_link;
+      if (!b) {
+        a->next_link = pairs;
+        pairs = a;
+        break;
+      }
+      first = b->next_link;
+      a->next_link = nullptr;
+      b->next_link = nullptr;
+      resumption_base* m = meld(a, b);
+      m->next_link = pairs;
+      pairs = m;
+    }
+    resumption_base* result = nullptr;
+    while (pairs) {
+      resumption_base* next = pairs->next_link;
+      pairs->next_link = nullptr;
+      result = meld(pairs, result);
+      pairs = next;
+    }
+    return result;
+  }
+};
+
+// --------------------
+// resumption_run_queue
+// --------------------
+
+// A FIFO queue with a slot that is popped first. Pushing to an occupied
+// slot moves its previous occupant to the back of the queue. To keep
+// the queue fair (e.g., when two threads keep waking up each other),
+// at most "limit" resumptions in a row are popped from the slot while
+// the queue is not empty.
+
+template <typename T>
+class resumption_run_queue {
+public:
+  resumption_run_queue(std::size_t limit = 8) : limit(limit) { }
+  resumption_run_queue(const resumption_run_queue&) = delete;
+  resumption_run_queue(resumption_run_queue&& other) :
+    queue(std::move(other.queue)), slot(other.slot), limit(other.limit), streak(other.streak)
+  {
+    other.slot = nullptr;
+    other.streak = 0;
+  }
+  resumption_run_queue& operator=(const resumption_run_queue&) = delete;
+  resumption_run_queue& operator=(resumption_run_queue&& other)
+  {
+    if (this != &other) {
+      clear();
+      queue = std::move(other.queue);
+      slot = other.slot; limit = other.limit; streak = other.streak;
+      other.slot = nullptr;
+      other.streak = 0;
+    }
+    return *this;
+  }
+  ~resumption_run_queue() { clear(); }
+  bool empty() const { return slot == nullptr && queue.empty(); }
+  std::size_t size() const { return queue.size() + (slot ? 1 : 0); }
+  void push_back(resumption<T> r)
+  {
+    queue.push_back(std::move(r));
+  }
+  void push_next(resumption<T> r)
+  {
+    if (slot) { queue.push_back(take_slot()); }
+    slot = r.release();
+  }
+  resumption<T> pop_front()
+  {
+    if (slot) {
+      if (queue.empty()) { streak = 0; return take_slot(); }
+      if (streak < limit) { streak++; return take_slot(); }
+    }
+    streak = 0;
+    return queue.pop_front();
+  }
+  void clear()
+  {
+    if (slot) { take_slot(); }
+    queue.clear();
+  }
+private:
+  resumption_queue<T> queue;
+  cpp_effects_internals::resumption_data_ptr<T> slot = nullptr;
+  std::size_t limit;
+  std::size_t streak = 0;
+  resumption<T> take_slot()
+  {
+    auto d = slot;
+    slot = nullptr;
+    return resumption<T>(d);
+  }
+};
+
+} // namespace cpp_effects
+
+#endif // CPP_EFFECTS_RESUMPTION_QUEUES_H
@@ -0,0 +1,283 @@
+// C++ Effects library
+// Maciej Pirog, Huawei Edinburgh Research Centre, maciej.pirog@huawei.com
+// License: MIT
+
+// This file contains an adapter between lightweight threads and
+// senders in the style of P2300 (std::execution). A sender is connected
+// to a receiver, which gives an operation state, which is started, and
+// eventually calls set_value or set_error of the receiver:
+//
+// - sender_loop -- A run loop of tasks on one system thread, which is
+//   also a scheduler of lightweight threads, and a P2300-style
+//   scheduler: schedule() gives a sender that completes on the loop.
+//
+// - await_sender(s) -- Used in a lightweight thread of the loop: parks
+//   the thread, starts the operation of s with a receiver that resumes
+//   the thread, and gives the value of s (or rethrows its error). The
+//   operation state and the result live on the stack of the thread, so
+//   awaiting does not allocate. It assumes that the loop is the
+//   innermost handler, so that the handler is not searched for.
+//
+// - just and then -- Basic senders.
+//
+// A sender S has the member type value_type (possibly void), and the
+// member function connect(R), which gives an operation state with the
+// member function start(). A receiver has the member functions
+// set_value (with an argument of type value_type, or none if it is
+// void) and set_error(std::exception_ptr).
+
+#ifndef CPP_EFFECTS_SENDERS_H
+#define CPP_EFFECTS_SENDERS_H
+
+#include <exception>
+#include <functional>
+#include <optional>
+#include <type_traits>
+#include <utility>
+
+#include "cpp-effects/cpp-effects.h"
+#include "cpp-effects/clause-modifiers.h"
+
+namespace cpp_effects {
+
+// -----------
+// sender_task
+// -----------
+
+// Tasks are intrusive, so the operation states of senders can post
+// themselves without allocation
+
+struct sender_task {
+  sender_task* next = nullptr;
+  void (*run)(sender_task*) = nullptr;
+};
+
+namespace cpp_effects_internals {
+
+// A parked thread waits in a slot on its own stack, which is posted to
+// the loop when the operation completes
+
+struct sender_waiter : sender_task {
+  resumption<void()> parked;
+  void (*start)(void*);
+  void* op;
+  std::exception_ptr error;
+  sender_waiter() : sender_task{nullptr, [](sender_task* t) {
+    std::move(static_cast<sender_waiter*>(t)->parked).resume();
+  }} { }
+};
+
+template <typename T>
+struct sender_slot : sender_waiter {
+  std::optional<T> value;
+};
+
+template <>
+struct sender_slot<void> : sender_waiter { };
+
+// The operation is started after the thread is parked, so it can
+// complete at any time (even before start returns)
+
+struct park_command : command<> {
+  sender_waiter* waiter;
+};
+
+} // namespace cpp_effects_internals
+
+// -----------
+// sender_loop
+// -----------
+
+class sender_loop : public flat_handler<void, no_manage<cpp_effects_internals::park_command>> {
+public:
+  static void post(sender_task* t)
+  {
+    t->next = nullptr;
+    if (tail) { tail->next = t; } else { head = t; }
+    tail = t;
+  }
+
+  // A new lightweight thread (before or during run)
+  static void spawn(std::function<void()> f)
+  {
+    // The only allocation of a thread apart from its handler
+    struct start : sender_task {
+      resumption<void()> r;
+    };
+    start* s = new start;
+    s->r = wrap<sender_loop>(std::move(f));
+    s->run = [](sender_task* t) {
+      start* s = static_cast<start*>(t);
+      auto r = std::move(s->r);
+      delete s;
+      std::move(r).resume();
+    };
+    post(s);
+  }
+
+  // Runs the tasks (and the threads) until there are none
+  static void run()
+  {
+    while (head) {
+      sender_task* t = head;
+      head = t->next;
+      if (!head) { tail = nullptr; }
+      t->run(t);
+    }
+  }
+
+  // The sender that completes (with no value) on the loop
+  struct schedule_sender {
+    using value_type = void;
+    template <typename R>
+    struct op : sender_task {
+      R receiver;
+      op(R r) : sender_task{nullptr, [](sender_task* t) { static_cast<op*>(t)->receiver.set_value(); }},
+                receiver(std::move(r)) { }
+      void start() { post(this); }
+    };
+    template <typename R>
+    op<R> connect(R r) { return op<R>(std::move(r)); }
+  };
+
+  static schedule_sender schedule() { return {}; }
+
+private:
+  inline static thread_local sender_task* head = nullptr;
+  inline static thread_local sender_task* tail = nullptr;
+
+  void handle_command(cpp_effects_internals::park_command p, resumption<void()> r) override
+  {
+    p.waiter->parked = std::move(r);
+    p.waiter->start(p.waiter->op);
+  }
+};
+
+// ------------
+// await_sender
+// ------------
+
+namespace cpp_effects_internals {
+
+template <typename T>
+struct await_receiver {
+  sender_slot<T>* slot;
+  void set_value(T value)
+  {
+    slot->value.emplace(std::move(value));
+    sender_loop::post(slot);
+  }
+  void set_error(std::exception_ptr e)
+  {
+    slot->error = e;
+    sender_loop::post(slot);
+  }
+};
+
+template <>
+struct await_receiver<void> {
+  sender_slot<void>* slot;
+  void set_value() { sender_loop::post(slot); }
+  void set_error(std::exception_ptr e)
+  {
+    slot->error = e;
+    sender_loop::post(slot);
+  }
+};
+
+} // namespace cpp_effects_internals
+
+template <typename S>
+typename S::value_type await_sender(S s)
+{
+  using namespace cpp_effects_internals;
+  using T = typename S::value_type;
+  sender_slot<T> slot;
+  auto op = s.connect(await_receiver<T>{&slot});
+  using op_type = decltype(op);
+  slot.start = [](void* o) { static_cast<op_type*>(o)->start(); };
+  slot.op = &op;
+  static_invoke_command<sender_loop>(park_command{{}, &slot});
+  if (slot.error) { std::rethrow_exception(slot.error); }
+  if constexpr (!std::is_void<T>::value) { return std::move(*slot.value); }
+}
+
+// -------
+// Senders
+// -------
+
+// Completes immediately with a value
+
+template <typename T>
+struct just_sender {
+  using value_type = T;
+  T value;
+  template <typename R>
+  struct op {
+    T value;
+    R receiver;
+    void start() { receiver.set_value(std::move(value)); }
+  };
+  template <typename R>
+  op<R> connect(R r) { return {std::move(value), std::move(r)}; }
+};
+
+template <typename T>
+just_sender<T> just(T value) { return {std::move(value)}; }
+
+// Applies a function to the value of a sender. An exception thrown by
+// the function is passed to set_error.
+
+namespace cpp_effects_internals {
+
+template <typename F, typename T>
+struct result_of_then { using type = std::invoke_result_t<F, T>; };
+
+template <typename F>
+struct result_of_then<F, void> { using type = std::invoke_result_t<F>; };
+
+} // namespace cpp_effects_internals
+
+template <typename S, typename F>
+struct then_sender {
+  using value_type = typename cpp_effects_internals::result_of_then<F, typename S::value_type>::type;
+  S sender;
+  F f;
+  template <typename R>
+  struct receiver {
+    F f;
+    R next;
+    template <typename... Args>
+    void set_value(Args&&... args)
+    {
+      if constexpr (std::is_void<value_type>::value) {
+        try {
+          f(std::forward<Args>(args)...);
+        } catch (...) {
+          next.set_error(std::current_exception());
+          return;
+        }
+        next.set_value();
+      } else {
+        std::optional<value_type> result;
+        try {
+          result.emplace(f(std::forward<Args>(args)...));
+        } catch (...) {
+          next.set_error(std::current_exception());
+          return;
+        }
+        next.set_value(std::move(*result));
+      }
+    }
+    void set_error(std::exception_ptr e) { next.set_error(e); }
+  };
+  template <typename R>
+  auto connect(R r) { return sender.connect(receiver<R>{std::move(f), std::move(r)}); }
+};
+
+template <typename S, typename F>
+then_sender<S, F> then(S s, F f) { return {std::move(s), std::move(f)}; }
+
+} // namespace cpp_effects
+
+#endif // CPP_EFFECTS_SENDERS_H
@@ -0,0 +1,463 @@
+// C++ Effects library
+// Maciej Pirog, Huawei Edinburgh Research Centre, maciej.pirog@huawei.com
+// License: MIT
+
+// This file contains software transactional memory for lightweight
+// threads running on a number of system threads. Transactional reads
+// and writes are commands handled by a transaction handler (in the
+// style of TL2: a global version clock, versioned locks, and read and
+// write sets in memory reused by all the transactions of a system
+// thread):
+//
+// - tvar -- A transactional variable.
+//
+// - tx -- A running transaction, which reads and writes variables, or
+//   retries.
+//
+// - atomically(body) -- Runs body as a transaction. A conflict aborts
+//   the transaction by discarding its resumption, and the transaction
+//   is run again.
+//
+// - stm_await and stm_on_change -- The interface for schedulers. A
+//   transaction that retries is aborted, and its thread invokes
+//   stm_await. The scheduler suspends the thread, and calls
+//   stm_on_change to be notified when one of the variables that the
+//   transaction has read changes.
+
+#ifndef CPP_EFFECTS_STM_H
+#define CPP_EFFECTS_STM_H
+
+#include <atomic>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+#include "cpp-effects/cpp-effects.h"
+#include "cpp-effects/clause-modifiers.h"
+#include "cpp-effects/growable-stack.h"
+
+namespace cpp_effects {
+
+class tx;
+
+namespace cpp_effects_internals {
+
+// A thread suspended by retry is registered in all the variables that
+// the transaction has read, and the first commit that writes to one of
+// them wakes it up
+
+struct stm_waiter {
+  virtual ~stm_waiter() { }
+  virtual void fire() = 0;
+  void wake()
+  {
+    if (!woken.exchange(true)) { fire(); }
+  }
+  std::atomic<bool> woken{false};
+};
+
+template <typename F>
+struct stm_waiter_of : stm_waiter {
+  stm_waiter_of(F&& f) : f(std::move(f)) { }
+  void fire() override { f(); }
+  F f;
+};
+
+class stm_transaction;
+struct stm_log;
+
+inline std::atomic<uint64_t> stm_clock{0};
+
+} // namespace cpp_effects_internals
+
+// ----
+// tvar
+// ----
+
+// The lowest bit of lock says if the variable is locked by a committing
+// transaction, the remaining bits are the version (i.e., the value of
+// the global clock at the commit that last wrote to the variable)
+
+class tvar {
+  friend class cpp_effects_internals::stm_transaction;
+  friend struct cpp_effects_internals::stm_log;
+public:
+  tvar(int64_t value = 0) : value(value) { }
+  tvar(const tvar&) = delete;
+  tvar& operator=(const tvar&) = delete;
+
+  // The value outside of transactions
+  int64_t peek() const { return value.load(); }
+
+private:
+  std::atomic<uint64_t> lock{0};
+  std::atomic<int64_t> value;
+  std::atomic<bool> has_waiters{false};
+  std::mutex waiters_mutex;
+  std::vector<std::shared_ptr<cpp_effects_internals::stm_waiter>> waiters;
+};
+
+namespace cpp_effects_internals {
+
+struct stm_read_entry {
+  tvar* var;
+  uint64_t version;
+};
+
+struct stm_write_entry {
+  tvar* var;
+  int64_t value;
+};
+
+enum class stm_outcome { committed, conflict, retry, thrown };
+
+// The read and write sets of a transaction. Every system thread has
+// one log, which is reused by all the transactions run by the thread,
+// so that (after warm-up) transactions do not allocate.
+//
+// The log also keeps the runner: the suspended computation that runs
+// the bodies of transactions in a loop. Creating a fiber for every
+// transaction would cost more than the transaction itself, so the
+// runner is created anew only when a transaction is aborted (which
+// discards the runner).
+
+struct stm_log {
+  uint64_t read_version;
+  std::vector<stm_read_entry> reads;
+  std::vector<stm_write_entry> writes;
+  int64_t aborts = 0;
+  int64_t retries = 0;
+  void (*call)(void*, const tx&);  // The body of the current transaction
+  void* body;
+  std::exception_ptr error;        // Thrown by the body
+  bool has_runner = false;
+  resumption<stm_outcome()> runner;
+
+  void begin()
+  {
+    read_version = stm_clock.load(std::memory_order_acquire);
+    reads.clear();
+    writes.clear();
+  }
+
+  void wait(const std::shared_ptr<stm_waiter>& waiter)
+  {
+    for (auto& e : reads) {
+      std::lock_guard<std::mutex> lock(e.var->waiters_mutex);
+      e.var->waiters.push_back(waiter);
+      e.var->has_waiters.store(true);
+    }
+
+    // A commit could have happened before the waiter was registered
+    // (and if nothing was read, nothing will change)
+    if (reads.empty()) { waiter->wake(); }
+    for (auto& e : reads) {
+      if (e.var->lock.load() != e.version << 1) {
+        waiter->wake();
+        break;
+      }
+    }
+  }
+};
+
+inline thread_local stm_log current_stm_log;
+
+// Commands
+
+struct stm_read : command<std::optional<int64_t>> { tvar* var; };
+
+struct stm_write : command<> {
+  tvar* var;
+  int64_t value;
+};
+
+struct stm_abort : command<> { };
+
+struct stm_retry : command<> { };
+
+struct stm_throw : command<> { };
+
+struct stm_commit : command<> { };
+
+// Reads and writes are plain clauses (there is no context switching),
+// while aborting (because of a conflict or retry) discards the
+// resumption. The commit is performed when the runner finishes the
+// body of a transaction, and the runner is kept for the next one.
+
+class stm_transaction : public flat_handler<stm_outcome,
+    plain<stm_read>, plain<stm_write>, no_resume<stm_abort>, no_resume<stm_retry>,
+    no_resume<stm_throw>, stm_commit> {
+public:
+  using stack_allocator = growable_stack;
+  stm_transaction(stm_log* log) : log(log) { }
+
+private:
+  stm_log* log;
+
+  std::optional<int64_t> handle_command(stm_read r) override
+  {
+    for (auto& w : log->writes) {
+      if (w.var == r.var) { return w.value; }
+    }
+    uint64_t before = r.var->lock.load(std::memory_order_acquire);
+    int64_t value = r.var->value.load(std::memory_order_acquire);
+    uint64_t after = r.var->lock.load(std::memory_order_acquire);
+    if (before != after || (before & 1) || (before >> 1) > log->read_version) { return {}; }
+    log->reads.push_back({r.var, before >> 1});
+    return value;
+  }
+
+  void handle_command(stm_write w) override
+  {
+    for (auto& e : log->writes) {
+      if (e.var == w.var) { e.value = w.value; return; }
+    }
+    log->writes.push_back({w.var, w.value});
+  }
+
+  stm_outcome handle_command(stm_abort) override
+  {
+    return stm_outcome::conflict;
+  }
+
+  stm_outcome handle_command(stm_retry) override
+  {
+    return stm_outcome::retry;
+  }
+
+  stm_outcome handle_command(stm_throw) override
+  {
+    return stm_outcome::thrown;
+  }
+
+  stm_outcome handle_command(stm_commit, resumption<stm_outcome()> r) override
+  {
+    log->runner = std::move(r);
+    log->has_runner = true;
+    return commit() ? stm_outcome::committed : stm_outcome::conflict;
+  }
+
+  bool written(tvar* var) const
+  {
+    for (auto& w : log->writes) {
+      if (w.var == var) { return true; }
+    }
+    return false;
+  }
+
+  void unlock(std::size_t n)
+  {
+    for (std::size_t i = 0; i < n; i++) {
+      log->writes[i].var->lock.fetch_and(~(uint64_t)1, std::memory_order_release);
+    }
+  }
+
+  bool commit()
+  {
+    if (log->writes.empty()) { return true; }
+
+    // Lock the write set
+    for (std::size_t i = 0; i < log->writes.size(); i++) {
+      tvar* var = log->writes[i].var;
+      uint64_t l = var->lock.load(std::memory_order_acquire);
+      if ((l & 1) || (l >> 1) > log->read_version ||
+          !var->lock.compare_exchange_strong(l, l | 1, std::memory_order_acquire)) {
+        unlock(i);
+        return false;
+      }
+    }
+
+    // Validate the read set (unless no one committed in the meantime)
+    uint64_t write_version = stm_clock.fetch_add(1, std::memory_order_acq_rel) + 1;
+    if (write_version != log->read_version + 1) {
+      for (auto& r : log->reads) {
+        uint64_t l = r.var->lock.load(std::memory_order_acquire);
+        if (((l & 1) && !written(r.var)) || (l >> 1) != r.version) {
+          unlock(log->writes.size());
+          return false;
+        }
+      }
+    }
+
+    // Write and release the locks with the new version
+    for (auto& w : log->writes) {
+      w.var->value.store(w.value, std::memory_order_relaxed);
+      w.var->lock.store(write_version << 1);
+    }
+
+    // Wake up the threads waiting for the written variables
+    for (auto& w : log->writes) {
+      if (!w.var->has_waiters.load()) { continue; }
+      std::vector<std::shared_ptr<stm_waiter>> waiters;
+      {
+        std::lock_guard<std::mutex> lock(w.var->waiters_mutex);
+        std::swap(waiters, w.var->waiters);
+        w.var->has_waiters.store(false);
+      }
+      for (auto& waiter : waiters) { waiter->wake(); }
+    }
+    return true;
+  }
+};
+
+} // namespace cpp_effects_internals
+
+// --
+// tx
+// --
+
+// A running transaction (created by atomically). Reading a variable
+// that was written by a transaction committed after this one started
+// aborts this one.
+
+class tx {
+public:
+  explicit tx(handler_ref it) : it(it) { }
+
+  int64_t read(tvar& var) const
+  {
+    using namespace cpp_effects_internals;
+    auto value = static_invoke_command<stm_transaction>(it, stm_read{{}, &var});
+    if (!value) { static_invoke_command<stm_transaction>(it, stm_abort{}); }
+    return *value;
+  }
+
+  void write(tvar& var, int64_t value) const
+  {
+    using namespace cpp_effects_internals;
+    static_invoke_command<stm_transaction>(it, stm_write{{}, &var, value});
+  }
+
+  // Aborts the transaction, and runs it again when one of the
+  // variables that it has read changes
+  [[noreturn]] void retry() const
+  {
+    using namespace cpp_effects_internals;
+    static_invoke_command<stm_transaction>(it, stm_retry{});
+    __builtin_unreachable();
+  }
+
+private:
+  handler_ref it;
+};
+
+// ---------------------------
+// stm_await and stm_on_change
+// ---------------------------
+
+// Invoked by atomically when the transaction retries. The handler
+// (usually the scheduler) suspends the thread, and calls stm_on_change
+// before the clause returns.
+
+struct stm_await : command<> { };
+
+// Calls wake once (possibly in another system thread) when one of the
+// variables read by the transaction that has just retried in this
+// system thread changes. If it already has, wake is called immediately.
+
+template <typename F>
+void stm_on_change(F wake)
+{
+  using namespace cpp_effects_internals;
+  current_stm_log.wait(std::make_shared<stm_waiter_of<F>>(std::move(wake)));
+}
+
+// ----------
+// atomically
+// ----------
+
+// Runs body(const tx&) as a transaction. A transaction can be aborted
+// and run again, so its body should have no effects other than reading
+// and writing variables. Transactions cannot be nested, and a body must
+// not suspend the thread (the log is shared by all the threads of the
+// system thread). If the body throws an exception derived from
+// std::exception, the transaction is aborted, and the exception is
+// rethrown.
+
+template <typename F>
+void atomically(F body)
+{
+  using namespace cpp_effects_internals;
+  stm_log& log = current_stm_log;
+  while (true) {
+    // Other threads run transactions when this one waits for a change,
+    // so the body is set every time
+    log.call = [](void* f, const tx& t) { (*static_cast<F*>(f))(t); };
+    log.body = &body;
+    log.begin();
+    stm_outcome outcome;
+    if (log.has_runner) {
+      log.has_runner = false;
+      outcome = std::move(log.runner).resume();
+    } else {
+      outcome = handle_ref<stm_transaction>([](handler_ref it) -> stm_outcome {
+        while (true) {
+          stm_log& log = current_stm_log;
+          bool thrown = false;
+          try {
+            log.call(log.body, tx(it));
+          } catch (const std::exception&) {
+            // The unwinding of a discarded runner is not a std::exception,
+            // so it is not caught
+            log.error = std::current_exception();
+            thrown = true;
+          }
+          if (thrown) { static_invoke_command<stm_transaction>(it, stm_throw{}); }
+          static_invoke_command<stm_transaction>(it, stm_commit{});
+        }
+      }, &log);
+    }
+    if (outcome == stm_outcome::committed) { return; }
+    if (outcome == stm_outcome::thrown) {
+      std::exception_ptr error = std::move(log.error);
+      log.error = nullptr;
+      std::rethrow_exception(error);
+    }
+    if (outcome == stm_outcome::conflict) {
+      log.aborts++;
+    } else {
+      log.retries++;
+      invoke_command(stm_await{});
+    }
+  }
+}
+
+// ---------
+// stm_stats
+// ---------
+
+// The numbers of aborted and retried transactions in this system thread
+// since the last call
+
+struct stm_stats {
+  int64_t aborts;
+  int64_t retries;
+};
+
+inline stm_stats stm_take_stats()
+{
+  cpp_effects_internals::stm_log& log = cpp_effects_internals::current_stm_log;
+  stm_stats s{log.aborts, log.retries};
+  log.aborts = 0;
+  log.retries = 0;
+  return s;
+}
+
+// Frees the runner of transactions of this system thread (it has to be
+// called before the thread ends if it ran transactions)
+
+inline void stm_release_thread()
+{
+  cpp_effects_internals::stm_log& log = cpp_effects_internals::current_stm_log;
+  if (log.has_runner) {
+    log.has_runner = false;
+    auto _ = std::move(log.runner);
+  }
+}
+
+} // namespace cpp_effects
+
+#endif // CPP_EFFECTS_STM_H
@@ -0,0 +1,326 @@
+// C++ Effects library
+// Maciej Pirog, Huawei Edinburgh Research Centre, maciej.pirog@huawei.com
+// License: MIT
+
+// This file contains a small framework for servers over Unix domain
+// sockets (Linux), in which every connection is a lightweight
+// thread, so request handlers are straight-line code:
+//
+// - io_loop -- Handler of lightweight threads on one system thread.
+//   Ready threads run in the round-robin fashion, and the loop blocks
+//   in poll when there are no ready threads. A thread can spawn new
+//   threads (spawn) and wait until a file descriptor is ready
+//   (await_fd).
+//
+// - connection -- The input and output of a connection. The reader
+//   does not know where the input comes from: when the buffered input
+//   is not enough, it invokes the command need_input. Responses are
+//   buffered, and flushed when the reader needs more input.
+//
+// - unix_server -- The socket of the server, and the accept loops (one
+//   io_loop per system thread) that run a request handler for every
+//   connection in a new lightweight thread.
+
+#ifndef CPP_EFFECTS_UNIX_SERVER_H
+#define CPP_EFFECTS_UNIX_SERVER_H
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <functional>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "cpp-effects/cpp-effects.h"
+#include "cpp-effects/clause-modifiers.h"
+#include "cpp-effects/resumption-queues.h"
+
+namespace cpp_effects {
+
+namespace cpp_effects_internals {
+
+struct spawn_command : command<> {
+  std::function<void()> proc;
+};
+
+struct await_fd_command : command<> {
+  int fd;
+  short events;
+};
+
+} // namespace cpp_effects_internals
+
+// -------
+// io_loop
+// -------
+
+class io_loop : public flat_handler<void,
+  cpp_effects_internals::spawn_command, cpp_effects_internals::await_fd_command> {
+public:
+  // Runs f and all the threads spawned by it in the current system
+  // thread (every system thread has its own loop)
+  static void run(std::function<void()> f)
+  {
+    ready.push_back(wrap<io_loop>(f));
+    while (!ready.empty() || !fds.empty()) {
+      for (std::size_t n = ready.size(); n > 0; n--) { ready.pop_front().resume(); }
+      if (!fds.empty()) { poll(); }
+    }
+  }
+private:
+  inline static thread_local resumption_queue<void()> ready;
+  inline static thread_local std::vector<pollfd> fds;
+  inline static thread_local std::vector<resumption<void()>> awaiting;  // awaiting[i] waits for fds[i]
+
+  static void poll()
+  {
+    if (::poll(fds.data(), fds.size(), ready.empty() ? -1 : 0) <= 0) { return; }
+    for (std::size_t i = 0; i < fds.size(); ) {
+      if (fds[i].revents != 0) {
+        ready.push_back(std::move(awaiting[i]));
+        fds[i] = fds.back();
+        fds.pop_back();
+        awaiting[i] = std::move(awaiting.back());
+        awaiting.pop_back();
+      } else {
+        i++;
+      }
+    }
+  }
+  void handle_command(cpp_effects_internals::spawn_command s, resumption<void()> r) override
+  {
+    ready.push_back(std::move(r));
+    ready.push_back(wrap<io_loop>(std::move(s.proc)));
+  }
+  void handle_command(cpp_effects_internals::await_fd_command a, resumption<void()> r) override
+  {
+    fds.push_back(pollfd{a.fd, a.events, 0});
+    awaiting.push_back(std::move(r));
+  }
+};
+
+// Used in a thread of an io_loop
+
+inline void spawn(std::function<void()> proc)
+{
+  invoke_command(cpp_effects_internals::spawn_command{{}, std::move(proc)});
+}
+
+inline void await_fd(int fd, short events)
+{
+  invoke_command(cpp_effects_internals::await_fd_command{{}, fd, events});
+}
+
+// ----------
+// connection
+// ----------
+
+// The answer is false at the end of the input
+
+struct need_input : command<bool> { };
+
+class connection {
+public:
+  // fd -- a non-blocking socket, owned by the caller
+  connection(int fd) : fd(fd) { }
+  connection(const connection&) = delete;
+  connection& operator=(const connection&) = delete;
+
+  // The next line (without '\n'), valid until the next call to
+  // read_line, or nothing at the end of the input
+  std::optional<std::string_view> read_line()
+  {
+    std::size_t scanned = pos;
+    while (true) {
+      std::size_t nl = input.find('\n', scanned);
+      if (nl != std::string::npos) {
+        std::string_view line(input.data() + pos, nl - pos);
+        pos = nl + 1;
+        return line;
+      }
+      scanned = input.size();
+      if (!invoke_command(need_input{})) { return {}; }
+      scanned -= std::min(scanned, compacted);
+      compacted = 0;
+    }
+  }
+
+  void write(std::string_view s)
+  {
+    output.append(s);
+    if (output.size() >= 64 * 1024) { flush(); }
+  }
+
+  // Writes the buffered output (waiting if the socket is full). If the
+  // client has disconnected, the output is dropped (send does not raise
+  // SIGPIPE, which would kill the server).
+  void flush()
+  {
+    std::size_t written = 0;
+    while (written < output.size()) {
+      ssize_t n = ::send(fd, output.data() + written, output.size() - written, MSG_NOSIGNAL);
+      if (n > 0) {
+        written += n;
+      } else if (n < 0 && errno == EAGAIN) {
+        await_fd(fd, POLLOUT);
+      } else if (n < 0 && errno == EINTR) {
+        continue;
+      } else {
+        break;
+      }
+    }
+    output.clear();
+  }
+
+  // Flushes the output, drops the consumed input, and reads more from
+  // the socket (waiting if needed). False at the end of the input.
+  bool refill()
+  {
+    flush();
+    input.erase(0, pos);
+    compacted = pos;
+    pos = 0;
+    char buffer[16 * 1024];
+    while (true) {
+      ssize_t n = ::read(fd, buffer, sizeof(buffer));
+      if (n > 0) {
+        input.append(buffer, n);
+        return true;
+      } else if (n < 0 && errno == EAGAIN) {
+        await_fd(fd, POLLIN);
+      } else if (n < 0 && errno == EINTR) {
+        continue;
+      } else {
+        return false;
+      }
+    }
+  }
+
+  int socket() const { return fd; }
+
+private:
+  int fd;
+  std::string input;
+  std::size_t pos = 0;
+  std::size_t compacted = 0;  // Bytes removed from input by the last refill
+  std::string output;
+};
+
+// The input of a connection comes from its socket. The clause resumes
+// the reader before it returns, so it does not need to keep the
+// handler alive (see no_manage).
+
+class socket_input : public flat_handler<void, no_manage<need_input>> {
+public:
+  socket_input(connection* conn) : conn(conn) { }
+private:
+  connection* conn;
+  void handle_command(need_input, resumption<void(bool)> r) override
+  {
+    std::move(r).tail_resume(conn->refill());
+  }
+};
+
+// -----------
+// unix_server
+// -----------
+
+class unix_server {
+public:
+  // Listens on a new socket at path (replacing an existing file).
+  // Throws std::system_error if the socket cannot be created, or if the
+  // path does not fit in a socket address.
+  unix_server(const std::string& path) : path(path)
+  {
+    if (path.size() >= sizeof(sockaddr_un::sun_path)) {
+      throw std::system_error(ENAMETOOLONG, std::generic_category(), "unix_server " + path);
+    }
+    fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    sockaddr_un addr = address();
+    ::unlink(path.c_str());
+    if (fd < 0 || ::bind(fd, (sockaddr*)&addr, sizeof(addr)) != 0 || ::listen(fd, 1024) != 0) {
+      int error = errno;
+      if (fd >= 0) { ::close(fd); }
+      throw std::system_error(error, std::generic_category(), "unix_server " + path);
+    }
+  }
+  unix_server(const unix_server&) = delete;
+  unix_server& operator=(const unix_server&) = delete;
+  ~unix_server()
+  {
+    ::close(fd);
+    ::unlink(path.c_str());
+  }
+
+  // Runs the accept loops in the given number of system threads (every
+  // loop accepts connections from the same socket), and calls handler
+  // for every connection in a new lightweight thread. The input of the
+  // connection is handled by socket_input, and the output is flushed
+  // when the handler returns. Returns when the server is stopped and
+  // all the connections are closed.
+  void serve(int loops, std::function<void(connection&)> handler)
+  {
+    std::vector<std::thread> threads;
+    for (int i = 0; i < loops; i++) {
+      threads.emplace_back([this, handler](){
+        io_loop::run([this, handler](){
+          while (true) {
+            await_fd(fd, POLLIN);
+            if (stopping()) { return; }
+            int conn = ::accept4(fd, nullptr, nullptr, SOCK_NONBLOCK);
+            if (conn < 0) { continue; }  // Another loop took the connection
+            spawn([conn, handler](){
+              connection c(conn);
+              handle<socket_input>([&](){ handler(c); c.flush(); }, &c);
+              ::close(conn);
+            });
+          }
+        });
+      });
+    }
+    for (auto& t : threads) { t.join(); }
+  }
+
+  // Stops accepting connections (can be called from any thread). The
+  // accept loops are woken up by a connection that is never accepted.
+  void stop()
+  {
+    stopped = true;
+    int wake = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un addr = address();
+    ::connect(wake, (sockaddr*)&addr, sizeof(addr));
+    ::close(wake);
+  }
+
+  bool stopping() const { return stopped; }
+
+  // The listening socket (e.g., for a server with a different loop)
+  int socket() const { return fd; }
+
+private:
+  std::string path;
+  int fd;
+  std::atomic<bool> stopped{false};
+
+  sockaddr_un address() const
+  {
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);  // The size is checked
+    return addr;
+  }
+};
+
+} // namespace cpp_effects
+
+#endif // CPP_EFFECTS_UNIX_SERVER_H
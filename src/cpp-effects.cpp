@@ -0,0 +1,178 @@
+// C++ Effects library
+// Maciej Pirog, Huawei Edinburgh Research Centre, maciej.pirog@huawei.com
+// License: MIT
+
+// Runtime: The non-template part of the library (label allocation, debug
+// printing, error reporting, reports of suspended computations)
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <ctime>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "cpp-effects/cpp-effects.h"
+
+namespace cpp_effects {
+
+namespace cpp_effects_internals {
+
+// -------------------------------
+// Internals - printing and errors
+// -------------------------------
+
+void metaframe::debug_print() const
+{
+  std::cout << label << ":" << typeid(*this).name() << std::endl;
+}
+
+void print_frame(int64_t label, const char* name, std::initializer_list<const char*> cmds)
+{
+  std::cout << label << ":" << name;
+  for (auto cmd : cmds) { std::cout << "[" << cmd << "]"; }
+  std::cout << std::endl;
+}
+
+void fatal_error(const char* msg, const char* typeName)
+{
+  std::cerr << "error: " << msg << (typeName ? typeName : "") << std::endl;
+  debug_print_metastack();
+  exit(-1);
+}
+
+void fatal_error(int64_t label, const char* typeName)
+{
+  std::cerr << "error: handler with id " << label
+            << " does not handle " << typeName << std::endl;
+  debug_print_metastack();
+  exit(-1);
+}
+
+// ----------------------------------------------
+// Internals - registry of suspended computations
+// ----------------------------------------------
+
+// The clock is read on every capture, so we use the coarse clock where
+// available (a few times cheaper than steady_clock, and a resolution of
+// a few milliseconds is enough to tell old computations from new ones)
+
+int64_t registry_clock()
+{
+#ifdef CLOCK_MONOTONIC_COARSE
+  timespec t;
+  clock_gettime(CLOCK_MONOTONIC_COARSE, &t);
+  return (int64_t)t.tv_sec * 1000000000 + t.tv_nsec;
+#else
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+} // namespace cpp_effects_internals
+
+// ---------------------------------
+// API - implementation of functions
+// ---------------------------------
+
+int64_t fresh_label()
+{
+  static std::atomic<int64_t> freshCounter(-1);
+  return --freshCounter;
+}
+
+void debug_print_metastack()
+{
+  using namespace cpp_effects_internals;
+
+  for (auto frame : metastack()) { frame->debug_print(); }
+}
+
+int64_t allocated_stacks()
+{
+  return cpp_effects_internals::stack_count;
+}
+
+void enable_suspended_registry(bool enable)
+{
+  cpp_effects_internals::suspended_registry_enabled.store(enable, std::memory_order_relaxed);
+}
+
+void for_each_suspended(const std::function<void(const suspended_computation&)>& f)
+{
+  using namespace cpp_effects_internals;
+
+  // The computations are collected under the lock, and reported after
+  // it is released, so f can resume or destroy resumptions
+  std::vector<suspended_computation> computations;
+  {
+    std::lock_guard<std::mutex> guard(suspended_registry->mutex);
+    int64_t now = registry_clock();
+    for (resumption_base* r = suspended_registry->head; r; r = r->registry_next) {
+      const auto& frames = r->captured_frames();
+      suspended_computation s;
+      s.handler = &typeid(*frames.back());
+      s.label = frames.back()->label;
+      s.age = now - r->registry_since;
+      s.frames = frames.size();
+      s.stack_size = 0;
+      for (auto& frame : frames) { s.stack_size += frame->stack_size; }
+      computations.push_back(s);
+    }
+  }
+  for (auto& s : computations) { f(s); }
+}
+
+void print_suspended_report()
+{
+  // Group by the handler, and then by the order of magnitude of age
+  // (below 1ms, 1s, 1min, and older)
+  struct Group {
+    std::size_t count = 0;
+    std::size_t stackSize = 0;
+    std::size_t ages[4] = {0, 0, 0, 0};
+    int64_t oldest = 0;
+  };
+  std::map<std::string, Group> groups;
+  Group total;
+  for_each_suspended([&](const suspended_computation& s) {
+    const int64_t limits[3] = {1000000, 1000000000, 60000000000};
+    std::size_t bucket = 0;
+    while (bucket < 3 && s.age >= limits[bucket]) { bucket++; }
+    for (Group* g : {&groups[s.handler->name()], &total}) {
+      g->count++;
+      g->stackSize += s.stack_size;
+      g->ages[bucket]++;
+      g->oldest = std::max(g->oldest, s.age);
+    }
+  });
+  auto print = [](const Group& g) {
+    std::cout << g.count << " (stacks: " << g.stackSize / 1024 << " KiB, age <1ms: " << g.ages[0]
+              << ", <1s: " << g.ages[1] << ", <1min: " << g.ages[2] << ", older: " << g.ages[3]
+              << ", oldest: " << g.oldest / 1000000 << "ms)" << std::endl;
+  };
+  std::cout << "suspended computations: ";
+  print(total);
+  for (auto& [name, g] : groups) {
+    std::cout << "  " << name << ": ";
+    print(g);
+  }
+}
+
+handler_ref find_handler(int64_t goto_handler)
+{
+  using namespace cpp_effects_internals;
+
+  auto const cond = [&](const cpp_effects_internals::metaframe_ptr& mf) {
+    return mf->label == goto_handler;
+  };
+  auto it = std::find_if(metastack().begin(), metastack().end(), cond);
+  if (it != metastack().end()) { return it; }
+
+  fatal_error("cpp_effects::find_handler did not find a handler");
+}
+
+} // namespace cpp_effects
@@ -0,0 +1,121 @@
+// C++ Effects library
+// Maciej Pirog, Huawei Edinburgh Research Centre, maciej.pirog@huawei.com
+// License: MIT
+
+// Runtime: Growable stacks (see cpp-effects/growable-stack.h)
+
+#include <algorithm>
+#include <cstdint>
+#include <new>
+#include <vector>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "cpp-effects/growable-stack.h"
+
+namespace cpp_effects {
+
+namespace {
+
+std::size_t pageSize()
+{
+  static const std::size_t size = ::sysconf(_SC_PAGESIZE);
+  return size;
+}
+
+std::size_t roundUp(std::size_t size)
+{
+  return (size + pageSize() - 1) / pageSize() * pageSize();
+}
+
+bool used(const char* page)
+{
+  const uint64_t* words = reinterpret_cast<const uint64_t*>(page);
+  for (std::size_t i = 0; i < pageSize() / sizeof(uint64_t); i++) {
+    if (words[i] != 0) { return true; }
+  }
+  return false;
+}
+
+// Free stacks of the current thread. The stacks in the pool keep only
+// their top pages resident.
+
+class StackPool {
+public:
+  ~StackPool()
+  {
+    for (auto& sctx : stacks) { unmap(sctx); }
+  }
+  std::vector<ctx::stack_context> stacks;
+  std::size_t mapped = 0;
+  static void unmap(ctx::stack_context& sctx)
+  {
+    void* base = static_cast<char*>(sctx.sp) - sctx.size;
+    ::munmap(base, sctx.size);
+  }
+};
+
+thread_local StackPool pool;
+
+}
+
+growable_stack::growable_stack(std::size_t maxSize, std::size_t keepSize) :
+  maxSize(roundUp(maxSize)), keepSize(roundUp(keepSize)) { }
+
+ctx::stack_context growable_stack::allocate()
+{
+  // Reuse a free stack of the same size
+  for (auto it = pool.stacks.rbegin(); it != pool.stacks.rend(); ++it) {
+    if (it->size == maxSize + pageSize()) {
+      ctx::stack_context sctx = *it;
+      pool.stacks.erase(std::next(it).base());
+      return sctx;
+    }
+  }
+
+  // Reserve the memory, which is backed by physical pages only when
+  // touched, and protect the bottom page as a guard
+  std::size_t size = maxSize + pageSize();
+  int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE;
+#if defined(MAP_STACK)
+  flags |= MAP_STACK;
+#endif
+  void* base = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, flags, -1, 0);
+  if (base == MAP_FAILED) { throw std::bad_alloc(); }
+  ::mprotect(base, pageSize(), PROT_NONE);
+  pool.mapped++;
+
+  ctx::stack_context sctx;
+  sctx.size = size;
+  sctx.sp = static_cast<char*>(base) + size;
+  return sctx;
+}
+
+void growable_stack::deallocate(ctx::stack_context& sctx) noexcept
+{
+  if (pool.stacks.size() >= pool_size) {
+    StackPool::unmap(sctx);
+    return;
+  }
+
+  // Give back the pages below the retained top of the stack. The
+  // pages are zero-filled again on the next touch. To avoid the system
+  // call when the stack did not grow, we look at the highest page that
+  // is given back: it is all zeros if it was not used (or, unlikely for
+  // a stack with return addresses, if it was used to store only zeros,
+  // in which case the stack just keeps more memory than it should).
+  char* base = static_cast<char*>(sctx.sp) - sctx.size;
+  std::size_t release = sctx.size - pageSize() - std::min(keepSize, sctx.size - pageSize());
+  if (release > 0 && used(base + pageSize() + release - pageSize())) {
+    ::madvise(base + pageSize(), release, MADV_DONTNEED);
+  }
+  pool.stacks.push_back(sctx);
+}
+
+std::size_t growable_stack::mapped_stacks()
+{
+  return pool.mapped;
+}
+
+} // namespace cpp_effects
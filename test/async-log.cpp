@@ -0,0 +1,137 @@
+// C++ Effects library
+// Maciej Pirog, Huawei Edinburgh Research Centre, maciej.pirog@huawei.com
+// License: MIT
+
+// Test: Asynchronous logging with per-thread rings and a flusher
+
+#include <cstdio>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "cpp-effects/cpp-effects.h"
+#include "cpp-effects/async-log.h"
+
+namespace eff = cpp_effects;
+
+using Logger = eff::logger<eff::async_log<void>>;
+
+// The lines written to a temporary file
+
+std::vector<std::string> readLines(std::FILE* file)
+{
+  std::fflush(file);
+  std::rewind(file);
+  std::vector<std::string> lines;
+  std::string line;
+  int c;
+  while ((c = std::fgetc(file)) != EOF) {
+    if (c == '\n') {
+      lines.push_back(line);
+      line.clear();
+    } else {
+      line.push_back(c);
+    }
+  }
+  return lines;
+}
+
+void testLines()
+{
+  std::FILE* file = std::tmpfile();
+  {
+    eff::log_flusher flusher(fileno(file));
+    eff::log_ring* ring = flusher.add_ring();
+    eff::handle_ref<eff::async_log<void>>([](eff::handler_ref href) {
+      Logger log(href);
+      log("hello");
+      log("value: ", 42);
+      log("negative: ", -7);
+      log(std::string(1000, 'x'));  // Truncated
+    }, ring);
+  }
+  for (auto& line : readLines(file)) {
+    std::cout << (line.size() > 20 ? std::to_string(line.size()) + " bytes" : line) << std::endl;
+  }
+  std::fclose(file);
+
+  // Output:
+  // hello
+  // value: 42
+  // negative: -7
+  // 234 bytes
+}
+
+// A small ring fills up, and the producer waits for the flusher, but
+// no line is lost
+
+void testFullRing()
+{
+  std::FILE* file = std::tmpfile();
+  std::size_t stalls;
+  {
+    eff::log_flusher flusher(fileno(file), 64);
+    eff::log_ring* ring = flusher.add_ring(16);
+    eff::handle_ref<eff::async_log<void>>([](eff::handler_ref href) {
+      Logger log(href);
+      for (int i = 0; i < 10000; i++) { log("", i); }
+    }, ring);
+    stalls = ring->stalls();
+  }
+  auto lines = readLines(file);
+  bool ordered = lines.size() == 10000;
+  for (std::size_t i = 0; ordered && i < lines.size(); i++) { ordered = lines[i] == std::to_string(i); }
+  std::cout << lines.size() << " " << ordered << " " << (stalls > 0) << std::endl;
+  std::fclose(file);
+
+  // Output:
+  // 10000 1 1
+}
+
+// Every system thread has its own ring, so the lines of a thread are
+// in order
+
+void testThreads()
+{
+  const int THREADS = 4, LINES = 5000;
+  std::FILE* file = std::tmpfile();
+  {
+    eff::log_flusher flusher(fileno(file), 1024);
+    std::vector<eff::log_ring*> rings;
+    for (int t = 0; t < THREADS; t++) { rings.push_back(flusher.add_ring(1024)); }
+    std::vector<std::thread> threads;
+    for (int t = 0; t < THREADS; t++) {
+      threads.emplace_back([&, t](){
+        eff::handle_ref<eff::async_log<void>>([&](eff::handler_ref href) {
+          Logger log(href);
+          for (int i = 0; i < LINES; i++) { log(std::to_string(t) + " ", i); }
+        }, rings[t]);
+      });
+    }
+    for (auto& t : threads) { t.join(); }
+  }
+  std::vector<int> next(THREADS, 0);
+  bool ordered = true;
+  for (auto& line : readLines(file)) {
+    std::istringstream in(line);
+    int t, i;
+    in >> t >> i;
+    ordered = ordered && i == next[t]++;
+  }
+  for (int n : next) { std::cout << n << " "; }
+  std::cout << ordered << std::endl;
+  std::fclose(file);
+
+  // Output:
+  // 5000 5000 5000 5000 1
+}
+
+int main()
+{
+  std::cout << "--- async-log ---" << std::endl;
+  testLines();
+  testFullRing();
+  testThreads();
+}
@@ -0,0 +1,81 @@
+// C++ Effects library
+// Maciej Pirog, Huawei Edinburgh Research Centre, maciej.pirog@huawei.com
+// License: MIT
+
+// Test: Reverse-mode automatic differentiation
+
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include "cpp-effects/cpp-effects.h"
+#include "cpp-effects/autodiff.h"
+
+namespace eff = cpp_effects;
+
+using eff::ad_var;
+
+void print(double y, const std::vector<double>& dx)
+{
+  std::cout << y << " :";
+  for (double d : dx) { std::cout << " " << d; }
+  std::cout << std::endl;
+}
+
+// A user-defined operation
+
+ad_var square(ad_var x)
+{
+  return eff::ad_apply(x.value * x.value, x, 2 * x.value);
+}
+
+int main()
+{
+  std::cout << "--- autodiff ---" << std::endl;
+  std::cout << std::fixed << std::setprecision(4);
+
+  std::vector<double> dx;
+  double y;
+
+  // x * y + sin(x) at (2, 3)
+  y = eff::gradient([](const std::vector<ad_var>& v) { return v[0] * v[1] + sin(v[0]); }, {2, 3}, dx);
+  print(y, dx);
+
+  // Constants, subtraction, and division: (x - 1) / (2 * y) at (5, 2)
+  y = eff::gradient([](const std::vector<ad_var>& v) { return (v[0] - 1) / (2 * v[1]); }, {5, 2}, dx);
+  print(y, dx);
+
+  // A variable used many times: exp(x) * log(x) + sqrt(x) - cos(x) at 1
+  y = eff::gradient([](const std::vector<ad_var>& v) {
+    return exp(v[0]) * log(v[0]) + sqrt(v[0]) - cos(v[0]);
+  }, {1}, dx);
+  print(y, dx);
+
+  // A user-defined operation, and an input that is not used:
+  // -square(x) at (3, 4)
+  y = eff::gradient([](const std::vector<ad_var>& v) { return -square(v[0]); }, {3, 4}, dx);
+  print(y, dx);
+
+  // The tape is reused (and cleared) by subsequent computations
+  auto tape = std::make_shared<eff::ad_tape>();
+  for (int n : {10, 3}) {
+    y = eff::gradient(tape, [n](const std::vector<ad_var>& v) {
+      ad_var p = 1;
+      for (int i = 0; i < n; i++) { p = p * v[0]; }
+      return p;
+    }, {1.5}, dx);
+    std::cout << tape->size() << " nodes: ";
+    print(y, dx);
+  }
+}
+
+// Output:
+// --- autodiff ---
+// 6.9093 : 2.5839 2.0000
+// 1.0000 : 0.2500 -0.5000
+// 0.4597 : 4.0598
+// -9.0000 : -6.0000 0.0000
+// 12 nodes: 57.6650 : 384.4336
+// 5 nodes: 3.3750 : 6.7500
@@ -0,0 +1,93 @@
+// C++ Effects library
+// Maciej Pirog, Huawei Edinburgh Research Centre, maciej.pirog@huawei.com
+// License: MIT
+
+// Test: Batching the calls to a kernel across lightweight threads
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#include "cpp-effects/cpp-effects.h"
+#include "cpp-effects/batching.h"
+
+namespace eff = cpp_effects;
+
+using Loop = eff::batch_loop<int, std::string>;
+
+void kernel(const int* in, std::string* out, std::size_t n)
+{
+  for (std::size_t i = 0; i < n; i++) { out[i] = std::to_string(in[i] * 2); }
+}
+
+void printBatches(Loop& loop)
+{
+  loop.on_batch = [](std::size_t size, std::chrono::nanoseconds) { std::cout << "[" << size << "] "; };
+}
+
+// Every thread calls the kernel twice, and a batch runs as soon as it
+// has two inputs
+
+void testFull()
+{
+  Loop loop(kernel, 2);
+  printBatches(loop);
+  for (int t = 0; t < 3; t++) {
+    loop.spawn([t](){
+      for (int i = 0; i < 2; i++) { std::cout << Loop::call(t * 10 + i) << " "; }
+    });
+  }
+  loop.run();
+  std::cout << std::endl;
+
+  // Output:
+  // [2] 0 [2] 20 40 [2] 2 22 42
+}
+
+// Threads spawned during run, and a batch that is never full
+
+void testIdle()
+{
+  Loop loop(kernel, 100);
+  printBatches(loop);
+  loop.spawn([&loop](){
+    for (int t = 1; t <= 3; t++) {
+      loop.spawn([t](){ std::cout << Loop::call(t) << " "; });
+    }
+    std::cout << Loop::call(0) << " ";
+  });
+  loop.run();
+  std::cout << std::endl;
+
+  // Output:
+  // [4] 0 2 4 6
+}
+
+// A thread that does not call the kernel runs for longer than the
+// latency bound, so the batch runs before the next thread calls
+
+void testLatency()
+{
+  for (auto bound : {std::chrono::milliseconds(0), std::chrono::milliseconds(1)}) {
+    Loop loop(kernel, 100, bound);
+    printBatches(loop);
+    loop.spawn([](){ std::cout << Loop::call(1) << " "; });
+    loop.spawn([](){ std::this_thread::sleep_for(std::chrono::milliseconds(5)); });
+    loop.spawn([](){ std::cout << Loop::call(2) << " "; });
+    loop.run();
+    std::cout << std::endl;
+  }
+
+  // Output:
+  // [2] 2 4
+  // [1] 2 [1] 4
+}
+
+int main()
+{
+  std::cout << "--- batching ---" << std::endl;
+  testFull();
+  testIdle();
+  testLatency();
+}
@@ -0,0 +1,180 @@
+// C++ Effects library
+// Maciej Pirog, Huawei Edinburgh Research Centre, maciej.pirog@huawei.com
+// License: MIT
+
+// Test: Epoch-based memory reclamation with quiescent states
+
+#include <atomic>
+#include <iostream>
+#include <optional>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "cpp-effects/cpp-effects.h"
+#include "cpp-effects/clause-modifiers.h"
+#include "cpp-effects/epoch-reclamation.h"
+#include "cpp-effects/resumption-queues.h"
+
+namespace eff = cpp_effects;
+
+// Nodes that count how many of them were freed
+
+std::atomic<int> freed{0};
+
+struct Node {
+  ~Node() { freed++; }
+};
+
+// -------------
+// Grace periods
+// -------------
+
+// Participants are used by one system thread each, but for a
+// deterministic test, two of them are used by the same thread
+
+void testGracePeriod()
+{
+  eff::epoch_domain domain;
+  {
+    eff::epoch_participant a(domain);
+    std::optional<eff::epoch_participant> b(domain);
+
+    a.retire(new Node);  // In the epoch 1
+    a.reclaim();  // Both have seen the epoch 1, so it advances to 2
+    std::cout << freed << " " << a.pending() << " ";
+    b->quiescent();
+    a.reclaim();  // a has not seen the epoch 2
+    std::cout << freed << " ";
+    a.quiescent();
+    a.reclaim();  // Both have seen the epoch 2, so the node is freed
+    std::cout << freed << " " << a.pending() << std::endl;
+
+    // An offline participant does not hold back the others, and its
+    // retired nodes are freed by the others
+    b->retire(new Node);
+    b.reset();
+    std::cout << domain.orphaned() << " ";
+    a.retire(new Node);
+    for (int i = 0; i < 3; i++) {
+      a.quiescent();
+      a.reclaim();
+    }
+    std::cout << freed << " " << domain.orphaned() << " " << a.pending() << std::endl;
+
+    // The nodes that are not freed when the participants go offline
+    // are freed by the domain
+    a.retire(new Node);
+  }
+  std::cout << domain.orphaned() << " ";
+  domain.drain();
+  std::cout << freed << std::endl;
+
+  // Output:
+  // 0 1 0 1 0
+  // 1 3 0 0
+  // 1 4
+}
+
+void testTooMany()
+{
+  eff::epoch_domain domain(2);
+  eff::epoch_participant a(domain);
+  {
+    eff::epoch_participant b(domain);
+    try {
+      eff::epoch_participant c(domain);
+    } catch (const std::length_error&) {
+      std::cout << "too many ";
+    }
+  }
+  eff::epoch_participant c(domain);  // The slot of b is reused
+  std::cout << "ok" << std::endl;
+
+  // Output:
+  // too many ok
+}
+
+// ------------------------------
+// Quiescent states of schedulers
+// ------------------------------
+
+// Lightweight threads on many system threads share a list. A thread
+// does not keep pointers across yields, so the scheduler announces a
+// quiescent state between resumptions.
+
+struct Yield : eff::command<> { };
+
+class Scheduler : public eff::flat_handler<void, eff::no_manage<Yield>> {
+public:
+  static void Run(eff::epoch_domain& domain, int threads, std::function<void()> f)
+  {
+    eff::epoch_participant me(domain);
+    participant = &me;
+    for (int i = 0; i < threads; i++) { ready.push_back(eff::wrap<Scheduler>(f)); }
+    while (!ready.empty()) {
+      ready.pop_front().resume();
+      me.quiescent();
+    }
+  }
+  static thread_local eff::epoch_participant* participant;
+private:
+  static thread_local eff::resumption_queue<void()> ready;
+  void handle_command(Yield, eff::resumption<void()> r) override
+  {
+    ready.push_back(std::move(r));
+  }
+};
+
+thread_local eff::epoch_participant* Scheduler::participant = nullptr;
+thread_local eff::resumption_queue<void()> Scheduler::ready;
+
+struct Item {
+  int value;
+  Item* next;
+  ~Item() { freed++; }
+};
+
+void testSchedulers()
+{
+  freed = 0;
+  const int SYSTEM = 4, THREADS = 4, OPS = 2000;
+  std::atomic<Item*> head{nullptr};
+  std::atomic<int64_t> sum{0};
+  {
+    eff::epoch_domain domain(SYSTEM, 8);
+    std::vector<std::thread> system;
+    for (int s = 0; s < SYSTEM; s++) {
+      system.emplace_back([&](){
+        Scheduler::Run(domain, THREADS, [&](){
+          for (int i = 0; i < OPS; i++) {
+            // Push, and pop (a Treiber stack, which is safe from ABA
+            // as popped nodes are not reused while anyone can see them)
+            Item* n = new Item{1, head.load()};
+            while (!head.compare_exchange_weak(n->next, n)) { }
+            Item* h = head.load();
+            while (h && !head.compare_exchange_weak(h, h->next)) { }
+            if (h) {
+              sum += h->value;
+              Scheduler::participant->retire(h);
+            }
+            if (i % 8 == 0) { eff::static_invoke_command<Scheduler>(Yield{}); }
+          }
+        });
+      });
+    }
+    for (auto& t : system) { t.join(); }
+  }
+  std::cout << sum << " " << freed << " " << (head == nullptr) << std::endl;
+
+  // Output:
+  // 32000 32000 1
+}
+
+int main()
+{
+  std::cout << "--- epoch-reclamation ---" << std::endl;
+  testGracePeriod();
+  testTooMany();
+  testSchedulers();
+}
@@ -0,0 +1,66 @@
+// C++ Effects library
+// Maciej Pirog, Huawei Edinburgh Research Centre, maciej.pirog@huawei.com
+// License: MIT
+
+// Test: Batched generators and their k-way merge
+
+#include <iostream>
+#include <vector>
+
+#include "cpp-effects/cpp-effects.h"
+#include "cpp-effects/generator.h"
+
+namespace eff = cpp_effects;
+
+// The values from..to with a step
+
+eff::generator<int> range(int from, int to, int step, std::size_t batchSize)
+{
+  return eff::generator<int>([=](auto yield) {
+    for (int i = from; i < to; i += step) { yield(i); }
+  }, batchSize);
+}
+
+void print(eff::generator<int> g)
+{
+  for (; g; g.next()) { std::cout << g.value() << " "; }
+  std::cout << std::endl;
+}
+
+int main()
+{
+  std::cout << "--- generator ---" << std::endl;
+
+  // Batches of 1, 3, and more than all the values
+  for (std::size_t b : {1, 3, 100}) { print(range(0, 8, 1, b)); }
+
+  // Empty generator
+  print(range(0, 0, 1, 4));
+
+  // The merge of sorted generators (equal values in the order of the
+  // inputs), including an empty one
+  print(eff::merge(range(0, 12, 3, 2), range(1, 12, 4, 1), range(0, 0, 1, 1), range(2, 9, 2, 5)));
+
+  // A merge of merges
+  std::vector<eff::generator<int>> inputs;
+  inputs.push_back(eff::merge(range(0, 5, 2, 1), range(1, 5, 2, 1)));
+  inputs.push_back(range(5, 8, 1, 2));
+  print(eff::merge(std::move(inputs), 3));
+
+  // Abandoned before exhausted
+  {
+    auto g = range(0, 1000, 1, 7);
+    g.next();
+    std::cout << g.value() << std::endl;
+  }
+}
+
+// Output:
+// --- generator ---
+// 0 1 2 3 4 5 6 7
+// 0 1 2 3 4 5 6 7
+// 0 1 2 3 4 5 6 7
+//
+// 0 1 2 3 4 5 6 6 8 9 9
+// 0 1 2 3 4 5 6 7
+// 1
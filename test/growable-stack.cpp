@@ -0,0 +1,103 @@
+// C++ Effects library
+// Maciej Pirog, Huawei Edinburgh Research Centre, maciej.pirog@huawei.com
+// License: MIT
+
+// Test: Handlers that select the stack allocator of their fibers
+
+#include <functional>
+#include <iostream>
+
+#include "cpp-effects/cpp-effects.h"
+#include "cpp-effects/growable-stack.h"
+
+namespace eff = cpp_effects;
+
+struct Yield : eff::command<> {
+  int64_t value;
+};
+
+// Prints the yielded values, and then resumes
+
+class Printer : public eff::flat_handler<int64_t, Yield> {
+public:
+  using stack_allocator = eff::growable_stack;
+private:
+  int64_t handle_command(Yield y, eff::resumption<int64_t()> r) override
+  {
+    std::cout << y.value << " ";
+    return std::move(r).resume();
+  }
+};
+
+// A recursion much deeper than the default stack of a fiber (about
+// 4 MiB of stack), which yields on the way down and on the way up
+
+__attribute__((noinline))
+int64_t deep(int64_t n)
+{
+  volatile char frame[480];
+  frame[0] = 1;
+  if (n % 4000 == 0) { eff::invoke_command(Yield{{}, n}); }
+  if (n == 0) { return 0; }
+  return deep(n - 1) + frame[0];
+}
+
+void testDeep()
+{
+  std::cout << eff::handle<Printer>(std::bind(deep, 8000)) << std::endl;
+
+  // Output:
+  // 8000 4000 0 8000
+}
+
+void testReuse()
+{
+  // The stacks of finished fibers are reused
+  for (int i = 0; i < 3; i++) {
+    std::cout << eff::handle<Printer>(std::bind(deep, 4000)) << " ";
+  }
+  std::cout << std::endl;
+  std::cout << "stacks mapped: " << eff::growable_stack::mapped_stacks() << std::endl;
+
+  // Output:
+  // 4000 0 4000 4000 0 4000 4000 0 4000
+  // stacks mapped: 1
+}
+
+// A stack allocator that is not default-constructible, which counts
+// its stacks
+
+class CountingStack {
+public:
+  CountingStack(int* count) : count(count) { }
+  boost::context::stack_context allocate()
+  {
+    (*count)++;
+    return boost::context::fixedsize_stack().allocate();
+  }
+  void deallocate(boost::context::stack_context& sctx) noexcept
+  {
+    boost::context::fixedsize_stack().deallocate(sctx);
+  }
+private:
+  int* count;
+};
+
+void testInstance()
+{
+  // A resumption lifted with an allocator uses the given instance
+  int count = 0;
+  eff::resumption<int()> r(std::allocator_arg, CountingStack(&count), [](){ return 42; });
+  std::cout << std::move(r).resume() << " " << count << std::endl;
+
+  // Output:
+  // 42 1
+}
+
+int main()
+{
+  std::cout << "--- growable-stack ---" << std::endl;
+  testDeep();
+  testReuse();
+  testInstance();
+}
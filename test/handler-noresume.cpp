@@ -87,6 +87,44 @@ void testError()
 // Error!
 // Bye!
 
+// ------------------------------------------------
+// Aborting a handler resumed in a different context
+// ------------------------------------------------
+
+struct Suspend : eff::command<> { };
+
+class Abortable : public eff::flat_handler<int, Suspend, eff::no_resume<Error>> {
+public:
+  static eff::resumption<int()> suspended;
+private:
+  int handle_command(Suspend, eff::resumption<int()> r) override
+  {
+    suspended = std::move(r);
+    return 0;
+  }
+  int handle_command(Error) override
+  {
+    return -1;
+  }
+};
+
+eff::resumption<int()> Abortable::suspended;
+
+void testResumed()
+{
+  // When the computation is resumed, the caller of handle is gone, so
+  // the metastack holds the only reference to the handler
+  std::cout << eff::handle<Abortable>([](){
+    eff::invoke_command(Suspend{});
+    eff::invoke_command(Error{});
+    return 1;
+  }) << " ";
+  std::cout << std::move(Abortable::suspended).resume() << std::endl;
+}
+
+// Output:
+// 0 -1
+
 // ----
 // Main
 // ----
@@ -96,4 +134,5 @@ int main()
   std::cout << "--- noresume-handler ---" << std::endl;
   test();
   testError();
+  testResumed();
 }
@@ -0,0 +1,121 @@
+// C++ Effects library
+// Maciej Pirog, Huawei Edinburgh Research Centre, maciej.pirog@huawei.com
+// License: MIT
+
+// Test: Handler references stay valid when the handler is captured in
+// a resumption and resumed (possibly in a different context)
+
+#include <functional>
+#include <iostream>
+
+#include "cpp-effects/cpp-effects.h"
+#include "cpp-effects/resumption-queues.h"
+
+namespace eff = cpp_effects;
+
+struct Yield : eff::command<> {
+  int value;
+};
+
+struct Ask : eff::command<int> { };
+
+using Res = eff::resumption<void()>;
+
+// Parks the computation in a queue
+
+class Park : public eff::flat_handler<void, Yield> {
+public:
+  static eff::resumption_queue<void()> queue;
+  static int last;
+private:
+  void handle_command(Yield y, Res r) override
+  {
+    last = y.value;
+    queue.push_back(std::move(r));
+  }
+};
+
+eff::resumption_queue<void()> Park::queue;
+int Park::last = -1;
+
+template <typename Answer>
+class Reader : public eff::flat_handler<Answer, Ask> {
+public:
+  Reader(int val) : val(val) { }
+private:
+  int val;
+  Answer handle_command(Ask, eff::resumption<Answer(int)> r) override
+  {
+    return std::move(r).tail_resume(val);
+  }
+};
+
+// -----------------
+// Particular tests
+// -----------------
+
+void testGenerator()
+{
+  // The body keeps the reference to its handler for its whole life,
+  // and it is resumed from contexts with different handlers on top
+  eff::handle_ref<Park>([](auto href) {
+    for (int i = 0; i < 3; i++) {
+      eff::static_invoke_command<Park>(href, Yield{{}, i});
+    }
+  });
+  while (!Park::queue.empty()) {
+    std::cout << Park::last << " ";
+    auto r = Park::queue.pop_front();
+    eff::handle<Reader<void>>([&](){ std::move(r).resume(); }, 0);
+  }
+  std::cout << std::endl;
+
+  // Output:
+  // 0 1 2
+}
+
+void testNested()
+{
+  // A command to the outer handler captures both handlers, and the
+  // references to both handlers are used after the resumption
+  eff::handle_ref<Park>([](auto outer) {
+    eff::handle_ref<Reader<void>>([=](auto inner) {
+      for (int i = 0; i < 3; i++) {
+        int x = eff::static_invoke_command<Reader<void>>(inner, Ask{});
+        eff::invoke_command(outer, Yield{{}, x + i});
+      }
+    }, 10);
+  });
+  while (!Park::queue.empty()) {
+    std::cout << Park::last << " ";
+    Park::queue.pop_front().resume();
+  }
+  std::cout << std::endl;
+
+  // Output:
+  // 10 11 12
+}
+
+void testLabels()
+{
+  // References do not depend on labels, so handlers with the same
+  // label are told apart
+  eff::handle_ref<Reader<void>>(7, [](auto outer) {
+    eff::handle_ref<Reader<void>>(7, [=](auto inner) {
+      std::cout << eff::invoke_command(outer, Ask{}) << " ";
+      std::cout << eff::invoke_command(inner, Ask{}) << " ";
+      std::cout << eff::invoke_command(7, Ask{}) << std::endl;
+    }, 2);
+  }, 1);
+
+  // Output:
+  // 1 2 2
+}
+
+int main()
+{
+  std::cout << "--- handler-ref ---" << std::endl;
+  testGenerator();
+  testNested();
+  testLabels();
+}
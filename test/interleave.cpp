@@ -0,0 +1,103 @@
+// C++ Effects library
+// Maciej Pirog, Huawei Edinburgh Research Centre, maciej.pirog@huawei.com
+// License: MIT
+
+// Test: Interleaving computations with the light suspend/resume path
+
+#include <iostream>
+#include <stdexcept>
+
+#include "cpp-effects/cpp-effects.h"
+#include "cpp-effects/clause-modifiers.h"
+#include "cpp-effects/interleave.h"
+
+namespace eff = cpp_effects;
+
+struct Print : eff::command<> { int value; };
+
+class Printer : public eff::flat_handler<void, eff::plain<Print>> {
+  void handle_command(Print p) override
+  {
+    std::cout << p.value << " ";
+  }
+};
+
+// Every index prints itself three times, yielding in between
+
+void steps(std::size_t i)
+{
+  for (int s = 0; s < 3; s++) {
+    std::cout << i << s << " ";
+    eff::interleave_yield();
+  }
+}
+
+int main()
+{
+  std::cout << "--- interleave ---" << std::endl;
+
+  // A group of 2 computations for 3 indices, so the third index starts
+  // when the first one is done
+  eff::interleave(3, 2, steps);
+  std::cout << std::endl;
+
+  // More computations than indices, and a group of 1
+  eff::interleave(2, 10, steps);
+  std::cout << std::endl;
+  eff::interleave(2, 1, steps);
+  std::cout << std::endl;
+
+  // Outside of a group, yield does nothing
+  steps(7);
+  std::cout << std::endl;
+
+  // A member can invoke a command with a plain clause
+  eff::handle<Printer>([](){
+    eff::interleave(2, 2, [](std::size_t i) {
+      eff::invoke_command(Print{{}, (int)i});
+      eff::interleave_yield();
+      eff::invoke_command(Print{{}, (int)i + 10});
+    });
+  });
+  std::cout << std::endl;
+
+  // Nested groups
+  eff::interleave(2, 2, [](std::size_t i) {
+    eff::interleave(2, 2, [i](std::size_t j) {
+      std::cout << i << j << " ";
+      eff::interleave_yield();
+      std::cout << i << j << "' ";
+    });
+    eff::interleave_yield();
+    std::cout << i << "! ";
+  });
+  std::cout << std::endl;
+
+  // An exception stops the group, after the other members are done
+  // with their current indices
+  try {
+    eff::interleave(10, 2, [](std::size_t i) {
+      if (i == 2) { throw std::runtime_error("index 2"); }
+      eff::interleave_yield();
+      std::cout << i << " ";
+    });
+  } catch (const std::runtime_error& e) {
+    std::cout << "caught " << e.what() << std::endl;
+  }
+
+  // One stack per member
+  int64_t stacks = eff::allocated_stacks();
+  eff::interleave(100, 4, [](std::size_t) { eff::interleave_yield(); });
+  std::cout << "stacks: " << eff::allocated_stacks() - stacks << std::endl;
+}
+
+// Output:
+// --- interleave ---
+// 00 10 01 11 02 12 20 21 22
+// 00 10 01 11 02 12
+// 00 01 02 10 11 12
+// 70 71 72
+// 0 1 10 11
+// 00 01 00' 01' 10 11 10' 11' 0! 1!
+// 0 1 caught index 2
+// stacks: 4
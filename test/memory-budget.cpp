@@ -0,0 +1,71 @@
+// C++ Effects library
+// Maciej Pirog, Huawei Edinburgh Research Centre, maciej.pirog@huawei.com
+// License: MIT
+
+// Test: Accounting of the memory of stacks against a budget
+
+#include <iostream>
+
+#include "cpp-effects/cpp-effects.h"
+#include "cpp-effects/memory-budget.h"
+#include "cpp-effects/resumption-queues.h"
+
+namespace eff = cpp_effects;
+
+eff::memory_budget budget;
+
+eff::memory_budget& testBudget() { return budget; }
+
+struct Yield : eff::command<> { };
+
+class Scheduler : public eff::flat_handler<void, Yield> {
+public:
+  using stack_allocator = eff::budgeted_stack<eff::ctx::fixedsize_stack, testBudget>;
+  static eff::resumption_queue<void()> queue;
+private:
+  void handle_command(Yield, eff::resumption<void()> r) override
+  {
+    queue.push_back(std::move(r));
+  }
+};
+
+eff::resumption_queue<void()> Scheduler::queue;
+
+int main()
+{
+  std::cout << "--- memory-budget ---" << std::endl;
+
+  // The budget alone
+  {
+    eff::memory_budget b(100);
+    std::cout << b.try_charge(60) << b.try_charge(60) << b.try_charge(40) << " ";
+    std::cout << b.committed() << " " << b.exceeded() << " ";
+    b.release(50);
+    b.charge(10);
+    std::cout << b.committed() << " " << b.peak() << std::endl;
+  }
+
+  // Stacks of suspended computations are charged until the
+  // computations finish. A computation lifted by wrap waits on the
+  // stack of the wrapper, which is freed when the handler is started
+  // (so, for a moment, the computation has two stacks).
+  std::size_t stack = eff::ctx::stack_traits::default_size();
+  for (int i = 0; i < 3; i++) {
+    Scheduler::queue.push_back(eff::wrap<Scheduler>([](){ eff::invoke_command(Yield{}); }));
+  }
+  std::cout << budget.committed() / stack << std::endl;
+  for (int i = 0; i < 3; i++) { Scheduler::queue.pop_front().resume(); }  // All yield
+  std::cout << budget.committed() / stack << std::endl;
+  Scheduler::queue.pop_front().resume();  // Finishes
+  std::cout << budget.committed() / stack << std::endl;
+  Scheduler::queue.clear();
+  std::cout << budget.committed() / stack << " " << budget.peak() / stack << std::endl;
+}
+
+// Output:
+// --- memory-budget ---
+// 101 100 1 60 100
+// 3
+// 3
+// 2
+// 0 4
@@ -0,0 +1,87 @@
+// C++ Effects library
+// Maciej Pirog, Huawei Edinburgh Research Centre, maciej.pirog@huawei.com
+// License: MIT
+
+// Test: Output effect with chunks handed over to a sink
+
+#include <iostream>
+#include <string>
+
+#include <unistd.h>
+
+#include "cpp-effects/cpp-effects.h"
+#include "cpp-effects/output-sink.h"
+
+namespace eff = cpp_effects;
+
+// Prints every chunk, and checks that the chunks are always the same
+// memory (so nothing is copied, and the memory is bounded)
+
+class PrintingSink : public eff::output_sink {
+public:
+  const char* first = nullptr;
+  bool same = true;
+  void consume(const char* data, std::size_t size) override
+  {
+    if (!first) { first = data; }
+    same = same && data == first;
+    std::cout << "[" << std::string(data, size) << "]";
+  }
+};
+
+int main()
+{
+  std::cout << "--- output-sink ---" << std::endl;
+
+  // Chunks of 4 bytes
+  PrintingSink sink;
+  eff::handle_ref<eff::output<void>>([](eff::handler_ref href) {
+    eff::output_writer<void> out(href);
+    out.write("hello");
+    out.put(',');
+    out.put(' ');
+    out.write("world", 5);
+    out.flush();
+    out.put('!');
+  }, &sink, 4);
+  std::cout << " " << sink.same << std::endl;
+
+  // Nothing is handed over if nothing is written
+  eff::handle_ref<eff::output<void>>([](eff::handler_ref href) {
+    eff::output_writer<void> out(href);
+  }, &sink, 4);
+  std::cout << "nothing" << std::endl;
+
+  // The answer of the body, and a writer that outlives the first one
+  int n = eff::handle_ref<eff::output<int>>([](eff::handler_ref href) {
+    {
+      eff::output_writer<int> out(href);
+      out.write("ab");
+    }
+    eff::output_writer<int> out(href);
+    out.write("cd");
+    return 42;
+  }, &sink, 16);
+  std::cout << " " << n << std::endl;
+
+  // A file descriptor
+  int fds[2];
+  if (::pipe(fds) != 0) { return 1; }
+  eff::fd_sink pipe(fds[1]);
+  eff::handle_ref<eff::output<void>>([](eff::handler_ref href) {
+    eff::output_writer<void> out(href);
+    for (int i = 0; i < 10; i++) { out.put('0' + i); }
+  }, &pipe, 3);
+  ::close(fds[1]);
+  char buffer[32];
+  auto size = ::read(fds[0], buffer, sizeof(buffer));
+  ::close(fds[0]);
+  std::cout << std::string(buffer, size) << " " << pipe.written() << std::endl;
+}
+
+// Output:
+// --- output-sink ---
+// [hell][o, w][orld][!] 1
+// nothing
+// [ab][cd] 42
+// 0123456789 10
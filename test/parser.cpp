@@ -0,0 +1,156 @@
+// C++ Effects library
+// Maciej Pirog, Huawei Edinburgh Research Centre, maciej.pirog@huawei.com
+// License: MIT
+
+// Test: Parser combinators with complete and incremental input
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "cpp-effects/cpp-effects.h"
+#include "cpp-effects/clause-modifiers.h"
+#include "cpp-effects/parser.h"
+
+namespace eff = cpp_effects;
+
+using P = eff::parser;
+
+// Sums of lists of numbers: "(1 2 3) (4 5)"
+
+int number()
+{
+  P::lookahead r;
+  std::size_t n = 0;
+  int x = 0;
+  for (; r[n] >= '0' && r[n] <= '9'; n++) { x = x * 10 + (r[n] - '0'); }
+  if (n == 0) { P::fail(); }
+  P::advance(n);
+  return x;
+}
+
+int list()
+{
+  P::ch('(');
+  int sum = 0;
+  P::many([](){ P::spaces(); return number(); }, [&](int x){ sum += x; });
+  P::spaces();
+  P::ch(')');
+  return sum;
+}
+
+// Every list is printed as soon as it is parsed, and the input before
+// it is dropped
+
+void lists()
+{
+  P::many([](){ P::spaces(); return list(); }, [](int sum){ std::cout << sum << " "; P::cut(); });
+  P::spaces();
+}
+
+// Ordered choice with backtracking, and a rule with packrat memoization
+
+int parsed = 0;  // The number of times the rule list is run
+
+int choice(P::memo<int>& m)
+{
+  auto memoList = [&](){ return m([](){ parsed++; return list(); }); };
+  return P::alt(
+    [&](){ int x = memoList(); P::ch('!'); return x * 10; },
+    [&](){ return memoList(); });
+}
+
+// The input is read from a vector of chunks by a plain clause
+
+class Chunks : public eff::flat_handler<void, eff::plain<eff::parser_input>> {
+public:
+  Chunks(std::vector<std::string> chunks) : chunks(chunks) { }
+private:
+  std::vector<std::string> chunks;
+  std::size_t next = 0;
+  std::string_view handle_command(eff::parser_input) override
+  {
+    std::cout << "[" << next << "]";
+    return next < chunks.size() ? std::string_view(chunks[next++]) : std::string_view();
+  }
+};
+
+int main()
+{
+  std::cout << "--- parser ---" << std::endl;
+
+  // The entire input
+  std::cout << P::parse("(1 2 3) (40 2)", lists) << std::endl;
+  std::cout << P::parse("(1 2 3) (40 2", lists) << std::endl;
+
+  // Chunks given by a handler (the number 23 is split between chunks)
+  eff::handle<Chunks>([](){
+    std::cout << P::parse_incremental(lists) << std::endl;
+  }, std::vector<std::string>{"(1 2", "3 4) ", "(5)"});
+
+  // Chunks fed to a push parser
+  {
+    eff::push_parser p(lists);
+    for (const char* chunk : {"(", "10 2", "0) (", "1", "2 3)"}) {
+      std::cout << "<" << chunk << "> ";
+      p.feed(chunk);
+    }
+    std::cout << p.finish() << std::endl;
+  }
+
+  // The push parser is done after a failure (the first list is
+  // printed before)
+  {
+    eff::push_parser p(lists);
+    p.feed("(1) x");
+    std::cout << p.done() << " ";
+    p.feed("(2)");
+    std::cout << p.finish() << std::endl;
+  }
+
+  // Memoization: the list is parsed once, although the first
+  // alternative fails after it
+  {
+    P::memo<int> m;
+    int x = 0;
+    std::cout << P::parse("(1 2)", [&](){ x = choice(m); }) << " " << x << " " << parsed << std::endl;
+    m.clear();
+    parsed = 0;
+    std::cout << P::parse("(1 2)!", [&](){ x = choice(m); }) << " " << x << " " << parsed << std::endl;
+  }
+
+  // Rejected inputs
+  std::cout << P::parse(")", lists) << " "
+            << P::parse("(1 x)", lists) << " "
+            << P::parse("(1 2", lists) << std::endl;
+
+  // A failure before alt, many, or memo is not cleared by their
+  // backtracking
+  auto x = [](){ P::ch('x'); return 0; };
+  auto b = [](){ P::ch('b'); return 0; };
+  std::cout << P::parse("b", [&](){ P::ch('a'); P::alt(x, b); }) << " "
+            << P::parse("b", [&](){ P::ch('a'); P::many(x, [](int){ }); P::ch('b'); }) << " "
+            << P::parse("b", [&](){ P::ch('a'); P::memo<int> m; m(x); P::ch('b'); }) << " "
+            << P::parse("ab", [&](){ P::ch('a'); P::alt(x, b); }) << std::endl;
+
+  // A failed rule is remembered as failed
+  {
+    P::memo<int> m;
+    std::cout << P::parse("(1 2)", [&](){
+      P::alt([&](){ m(x); return 0; }, [&](){ m(x); return 0; }, [](){ return list(); });
+    }) << std::endl;
+  }
+}
+
+// Output:
+// --- parser ---
+// 6 42 1
+// 6 0
+// [0][1]28 [2]5 [3]1
+// <(> <10 2> <0) (> 30 <1> <2 3)> 15 1
+// 1 1 0
+// 1 3 1
+// 1 30 1
+// 0 0 0
+// 0 0 0 1
+// 1
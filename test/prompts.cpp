@@ -0,0 +1,144 @@
+// C++ Effects library
+// Maciej Pirog, Huawei Edinburgh Research Centre, maciej.pirog@huawei.com
+// License: MIT
+
+// Test: Delimited control with prompts
+
+#include <functional>
+#include <iostream>
+#include <string>
+
+#include "cpp-effects/cpp-effects.h"
+#include "cpp-effects/prompts.h"
+
+namespace eff = cpp_effects;
+
+struct Ask : eff::command<int> { };
+
+template <typename Answer>
+class Reader : public eff::flat_handler<Answer, Ask> {
+public:
+  Reader(int val) : val(val) { }
+private:
+  int val;
+  Answer handle_command(Ask, eff::resumption<Answer(int)> r) override
+  {
+    return std::move(r).tail_resume(val);
+  }
+};
+
+// -----------------
+// Particular tests
+// -----------------
+
+void testShift0()
+{
+  // The example from examples/shift0-reset.cpp
+  auto p = eff::new_prompt<std::string>();
+  std::cout << eff::push_prompt(p, [=]() -> std::string {
+    return "2 + 2 = " + std::to_string(2 + eff::take_subcont<int>(p, [](auto k) {
+      return "It is not true that " + eff::push_subcont(std::move(k), 3);
+    }));
+  }) << std::endl;
+
+  // Output:
+  // It is not true that 2 + 2 = 5
+}
+
+void testMultiple()
+{
+  // The subcontinuation includes the prompt, so the computation can
+  // take subcontinuations many times
+  auto p = eff::new_prompt<int>();
+  std::cout << eff::push_prompt(p, [=]() {
+    int x = eff::take_subcont<int>(p, [](auto k) { return eff::push_subcont(std::move(k), 1) * 10; });
+    int y = eff::take_subcont<int>(p, [](auto k) { return eff::push_subcont(std::move(k), 2) * 100; });
+    return x + y;
+  }) << std::endl;
+
+  // Output:
+  // 3000
+}
+
+void testDiscard()
+{
+  // The subcontinuation is discarded, so the prompt works as an exception
+  auto p = eff::new_prompt<void>();
+  eff::push_prompt(p, [=]() {
+    std::cout << "before ";
+    eff::take_subcont<void>(p, [](auto) { std::cout << "abort "; });
+    std::cout << "after ";
+  });
+  std::cout << std::endl;
+
+  // Output:
+  // before abort
+}
+
+void testNested()
+{
+  // The outer prompt captures the inner prompt and a handler, which
+  // still work after the subcontinuation is pushed in a different
+  // context
+  auto outer = eff::new_prompt<int>();
+  auto inner = eff::new_prompt<int>();
+  eff::resumption<int(int)> saved;
+  int result = eff::push_prompt(outer, [&]() {
+    return eff::push_prompt(inner, [&]() {
+      return eff::handle<Reader<int>>([&]() {
+        int x = eff::take_subcont<int>(outer, [&](auto k) { saved = std::move(k); return 0; });
+        int y = eff::take_subcont<int>(inner, [](auto k) { return eff::push_subcont(std::move(k), 100) + 1; });
+        return x + y + eff::invoke_command(Ask{});
+      }, 1000);
+    });
+  });
+  std::cout << result << " ";
+  std::cout << eff::handle<Reader<int>>([&]() { return eff::push_subcont(std::move(saved), 10); }, 5)
+            << std::endl;
+
+  // Output:
+  // 0 1111
+}
+
+void testSamePrompt()
+{
+  // A prompt pushed twice refers to the innermost push
+  auto p = eff::new_prompt<std::string>();
+  std::cout << eff::push_prompt(p, [=]() {
+    std::string s = eff::push_prompt(p, [=]() {
+      return eff::take_subcont<std::string>(p, [](auto) -> std::string { return "inner"; });
+    });
+    return s + " " + eff::take_subcont<std::string>(p, [](auto) -> std::string { return "outer"; });
+  }) << std::endl;
+
+  // Output:
+  // outer
+}
+
+void testRepush()
+{
+  // The function pushes the prompt again (as in shift), so the prompt
+  // is on the metastack twice when the subcontinuation is pushed
+  auto p = eff::new_prompt<int>();
+  std::cout << eff::push_prompt(p, [=]() {
+    int x = eff::take_subcont<int>(p, [=](auto k) {
+      return eff::push_prompt(p, [&]() { return eff::push_subcont(std::move(k), 1) * 2; });
+    });
+    int y = eff::take_subcont<int>(p, [](auto k) { return eff::push_subcont(std::move(k), 10) + 1; });
+    return x + y;
+  }) << std::endl;
+
+  // Output:
+  // 24
+}
+
+int main()
+{
+  std::cout << "--- prompts ---" << std::endl;
+  testShift0();
+  testMultiple();
+  testDiscard();
+  testNested();
+  testSamePrompt();
+  testRepush();
+}
@@ -0,0 +1,100 @@
+// C++ Effects library
+// Maciej Pirog, Huawei Edinburgh Research Centre, maciej.pirog@huawei.com
+// License: MIT
+
+// Test: Resumptions as move-only functions
+
+#include <iostream>
+#include <string>
+
+#include "cpp-effects/cpp-effects.h"
+#include "cpp-effects/resumption-function.h"
+
+namespace eff = cpp_effects;
+
+struct Ask : eff::command<int> { };
+
+// The handler gives the computation as a function of the answer to Ask
+
+class Suspend : public eff::handler<eff::resumption_function<std::string(int)>, std::string, Ask> {
+  eff::resumption_function<std::string(int)> handle_command(Ask,
+    eff::resumption<eff::resumption_function<std::string(int)>(int)> r) override
+  {
+    // The nested function is called immediately, so that the answer of
+    // the resumed computation is a string
+    return [r = std::move(r)](int x) mutable -> std::string {
+      return std::move(r).resume(x)(0);
+    };
+  }
+  eff::resumption_function<std::string(int)> handle_return(std::string s) override
+  {
+    return [s](int) { return s; };
+  }
+};
+
+struct Noisy {
+  ~Noisy() { std::cout << "destroyed" << std::endl; }
+};
+
+std::string body()
+{
+  Noisy n;
+  int x = eff::invoke_command(Ask{});
+  return "got " + std::to_string(x);
+}
+
+int main()
+{
+  std::cout << "--- resumption-function ---" << std::endl;
+
+  // Called
+  {
+    auto f = eff::handle<Suspend>(body);
+    std::cout << (bool)f << std::endl;
+    std::cout << f(42) << std::endl;
+  }
+
+  // Moved, then called
+  {
+    auto f = eff::handle<Suspend>(body);
+    eff::resumption_function<std::string(int)> g;
+    std::cout << (bool)g << std::endl;
+    g = std::move(f);
+    std::cout << (bool)f << " " << (bool)g << std::endl;
+    std::cout << g(7) << std::endl;
+  }
+
+  // Dropped without a call: the suspended computation is destroyed
+  {
+    auto f = eff::handle<Suspend>(body);
+    std::cout << "dropping" << std::endl;
+  }
+  std::cout << "dropped" << std::endl;
+
+  // as_function
+  {
+    struct Twice : eff::command<int> { };
+    class H : public eff::flat_handler<int, Twice> {
+      int handle_command(Twice, eff::resumption<int(int)> r) override
+      {
+        auto k = eff::as_function(std::move(r));
+        return k(21);
+      }
+    };
+    std::cout << eff::handle<H>([](){ return 2 * eff::invoke_command(Twice{}); }) << std::endl;
+  }
+}
+
+// Output:
+// --- resumption-function ---
+// 1
+// destroyed
+// got 42
+// 0
+// 0 1
+// destroyed
+// got 7
+// dropping
+// destroyed
+// dropped
+// 42
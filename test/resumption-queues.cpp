@@ -0,0 +1,201 @@
+// C++ Effects library
+// Maciej Pirog, Huawei Edinburgh Research Centre, maciej.pirog@huawei.com
+// License: MIT
+
+// Test: Intrusive containers of resumptions
+
+#include <functional>
+#include <iostream>
+
+#include "cpp-effects/cpp-effects.h"
+#include "cpp-effects/resumption-queues.h"
+
+namespace eff = cpp_effects;
+
+struct Yield : eff::command<> {
+  int64_t priority;
+};
+
+void yield(int64_t priority = 0)
+{
+  eff::invoke_command(Yield{{}, priority});
+}
+
+using Res = eff::resumption<void()>;
+
+// ---------------------------------------------
+// Schedulers parametrised by the parking policy
+// ---------------------------------------------
+
+class Fifo : public eff::flat_handler<void, Yield> {
+public:
+  static eff::resumption_queue<void()> queue;
+  static void Run()
+  {
+    while (!queue.empty()) { queue.pop_front().resume(); }
+  }
+private:
+  void handle_command(Yield, Res r) override { queue.push_back(std::move(r)); }
+};
+
+eff::resumption_queue<void()> Fifo::queue;
+
+class Lifo : public eff::flat_handler<void, Yield> {
+public:
+  static eff::resumption_stack<void()> stack;
+  static void Run()
+  {
+    while (!stack.empty()) { stack.pop().resume(); }
+  }
+private:
+  void handle_command(Yield, Res r) override { stack.push(std::move(r)); }
+};
+
+eff::resumption_stack<void()> Lifo::stack;
+
+class Prio : public eff::flat_handler<void, Yield> {
+public:
+  static eff::resumption_heap<void()> heap;
+  static void Run()
+  {
+    while (!heap.empty()) { heap.pop().resume(); }
+  }
+private:
+  void handle_command(Yield y, Res r) override { heap.push(std::move(r), y.priority); }
+};
+
+eff::resumption_heap<void()> Prio::heap;
+
+// A thread that yields with "next" goes to the slot of the run queue
+
+struct YieldNext : eff::command<> { };
+
+class RunNext : public eff::flat_handler<void, Yield, YieldNext> {
+public:
+  static eff::resumption_run_queue<void()> queue;
+  static void Run()
+  {
+    while (!queue.empty()) { queue.pop_front().resume(); }
+  }
+private:
+  void handle_command(Yield, Res r) override { queue.push_back(std::move(r)); }
+  void handle_command(YieldNext, Res r) override { queue.push_next(std::move(r)); }
+};
+
+eff::resumption_run_queue<void()> RunNext::queue(2);
+
+// -----------------
+// Particular tests
+// -----------------
+
+void worker(int k)
+{
+  for (int i = 0; i < 3; i++) {
+    std::cout << k;
+    yield();
+  }
+}
+
+void testQueue()
+{
+  for (int k = 0; k < 4; k++) {
+    Fifo::queue.push_back(eff::wrap<Fifo>(std::bind(worker, k)));
+  }
+  Fifo::Run();
+  std::cout << std::endl;
+
+  // Output:
+  // 012301230123
+}
+
+void testStack()
+{
+  for (int k = 0; k < 4; k++) {
+    Lifo::stack.push(eff::wrap<Lifo>(std::bind(worker, k)));
+  }
+  Lifo::Run();
+  std::cout << std::endl;
+
+  // Output:
+  // 333222111000
+}
+
+void testHeap()
+{
+  // Worker k runs its i-th step with priority (k + 1) * (i + 1), so
+  // the steps are interleaved in the order of their "deadlines".
+  for (int k = 0; k < 4; k++) {
+    Prio::heap.push(eff::wrap<Prio>([k](){
+      for (int i = 0; i < 3; i++) {
+        std::cout << k;
+        yield((k + 1) * (i + 2));
+      }
+    }), k);
+  }
+  Prio::Run();
+  std::cout << std::endl;
+
+  // Output:
+  // 010203121323
+}
+
+void testRunQueue()
+{
+  // Worker 0 always yields to the slot, but it runs at most twice in a
+  // row when the others are waiting. A push to an occupied slot sends
+  // the previous occupant to the back of the queue.
+  RunNext::queue.push_back(eff::wrap<RunNext>([](){
+    for (int i = 0; i < 6; i++) {
+      std::cout << 0;
+      eff::invoke_command(YieldNext{});
+    }
+  }));
+  for (int k = 1; k < 3; k++) {
+    RunNext::queue.push_back(eff::wrap<RunNext>(std::bind(worker, k)));
+  }
+  RunNext::Run();
+  std::cout << " ";
+  for (int k = 1; k < 4; k++) {
+    RunNext::queue.push_next(eff::wrap<RunNext>([k](){ std::cout << k; }));
+  }
+  RunNext::Run();
+  std::cout << std::endl;
+
+  // Output:
+  // 000100201212 312
+}
+
+void testDestroy()
+{
+  // Resumptions left in a container are destroyed together with the
+  // container, which unwinds their stacks.
+  struct Guard { ~Guard() { std::cout << "~"; } };
+  {
+    eff::resumption_queue<void()> q;
+    eff::resumption_stack<void()> s;
+    eff::resumption_heap<void()> h;
+    for (int i = 0; i < 6; i++) {
+      eff::wrap<Fifo>([](){ Guard g; yield(); }).resume();
+    }
+    for (int i = 0; i < 2; i++) {
+      q.push_back(Fifo::queue.pop_front());
+      s.push(Fifo::queue.pop_front());
+      h.push(Fifo::queue.pop_front(), i);
+    }
+    std::cout << q.size() + s.size() + h.size() << " ";
+  }
+  std::cout << std::endl;
+
+  // Output:
+  // 6 ~~~~~~
+}
+
+int main()
+{
+  std::cout << "--- resumption-queues ---" << std::endl;
+  testQueue();
+  testStack();
+  testHeap();
+  testRunQueue();
+  testDestroy();
+}
@@ -0,0 +1,109 @@
+// C++ Effects library
+// Maciej Pirog, Huawei Edinburgh Research Centre, maciej.pirog@huawei.com
+// License: MIT
+
+// Test: Awaiting P2300-style senders in lightweight threads
+
+#include <iostream>
+#include <stdexcept>
+
+#include "cpp-effects/cpp-effects.h"
+#include "cpp-effects/senders.h"
+
+namespace eff = cpp_effects;
+
+using Loop = eff::sender_loop;
+
+void testJust()
+{
+  Loop::spawn([](){
+    std::cout << eff::await_sender(eff::just(10)) << " ";
+    std::cout << eff::await_sender(eff::then(eff::just(10), [](int x) { return x * 2; })) << " ";
+    std::cout << eff::await_sender(eff::then(eff::then(eff::just(1), [](int x) { return x + 1; }),
+                                             [](int x) { return x * 100; })) << std::endl;
+  });
+  Loop::run();
+
+  // Output:
+  // 10 20 200
+}
+
+// Two threads that await schedule take turns
+
+void testSchedule()
+{
+  for (int t = 0; t < 2; t++) {
+    Loop::spawn([t](){
+      for (int i = 0; i < 3; i++) {
+        std::cout << eff::await_sender(eff::then(Loop::schedule(), [=]() { return t * 10 + i; })) << " ";
+      }
+    });
+  }
+  Loop::run();
+  std::cout << std::endl;
+
+  // Output:
+  // 0 10 1 11 2 12
+}
+
+// Void senders, and then with a void result
+
+void testVoid()
+{
+  Loop::spawn([](){
+    eff::await_sender(Loop::schedule());
+    std::cout << "scheduled ";
+    eff::await_sender(eff::then(eff::just(5), [](int x) { std::cout << "got " << x << " "; }));
+    std::cout << "done" << std::endl;
+  });
+  Loop::run();
+
+  // Output:
+  // scheduled got 5 done
+}
+
+// An exception thrown in then is rethrown by await_sender
+
+void testError()
+{
+  Loop::spawn([](){
+    try {
+      eff::await_sender(eff::then(Loop::schedule(), []() -> int { throw std::runtime_error("boom"); }));
+      std::cout << "lost" << std::endl;
+    } catch (const std::runtime_error& e) {
+      std::cout << "error " << e.what() << std::endl;
+    }
+  });
+  Loop::run();
+
+  // Output:
+  // error boom
+}
+
+// Threads spawned during run
+
+void testSpawn()
+{
+  Loop::spawn([](){
+    for (int t = 1; t <= 3; t++) {
+      Loop::spawn([t](){ std::cout << eff::await_sender(eff::just(t)) << " "; });
+    }
+    eff::await_sender(Loop::schedule());
+    std::cout << 0 << " ";
+  });
+  Loop::run();
+  std::cout << std::endl;
+
+  // Output:
+  // 1 2 3 0
+}
+
+int main()
+{
+  std::cout << "--- senders ---" << std::endl;
+  testJust();
+  testSchedule();
+  testVoid();
+  testError();
+  testSpawn();
+}
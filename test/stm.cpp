@@ -0,0 +1,192 @@
+// C++ Effects library
+// Maciej Pirog, Huawei Edinburgh Research Centre, maciej.pirog@huawei.com
+// License: MIT
+
+// Test: Software transactional memory
+
+#include <atomic>
+#include <functional>
+#include <iostream>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "cpp-effects/cpp-effects.h"
+#include "cpp-effects/clause-modifiers.h"
+#include "cpp-effects/resumption-queues.h"
+#include "cpp-effects/stm.h"
+
+namespace eff = cpp_effects;
+
+// ------------
+// Transactions
+// ------------
+
+void testTransactions()
+{
+  eff::tvar a(1), b(2);
+
+  // A transaction reads its own writes
+  eff::atomically([&](const eff::tx& tx) {
+    tx.write(a, tx.read(a) + tx.read(b));
+    tx.write(a, tx.read(a) * 10);
+  });
+  int64_t diff = 0;
+  eff::atomically([&](const eff::tx& tx) { diff = tx.read(a) - tx.read(b); });
+  std::cout << a.peek() << " " << b.peek() << " " << diff << std::endl;
+
+  // The runner of transactions is reused
+  int64_t stacks = eff::allocated_stacks();
+  for (int i = 0; i < 100; i++) {
+    eff::atomically([&](const eff::tx& tx) { tx.write(b, tx.read(b) + 1); });
+  }
+  std::cout << b.peek() << " " << eff::allocated_stacks() - stacks << std::endl;
+
+  // An exception aborts the transaction
+  try {
+    eff::atomically([&](const eff::tx& tx) {
+      tx.write(a, 0);
+      throw std::runtime_error("error");
+    });
+  } catch (const std::runtime_error& e) {
+    std::cout << e.what() << " " << a.peek() << std::endl;
+  }
+
+  // Output:
+  // 30 2 28
+  // 102 0
+  // error 30
+}
+
+// ---------
+// Conflicts
+// ---------
+
+// A transaction reads x, and before it commits, another system thread
+// writes to x, so the transaction is aborted and run again
+
+void testConflict()
+{
+  eff::tvar x(0), y(0);
+  std::atomic<int> stage{0};
+  std::thread other([&](){
+    while (stage.load() != 1) { }
+    eff::atomically([&](const eff::tx& tx) { tx.write(x, 10); });
+    eff::stm_release_thread();
+    stage = 2;
+  });
+  int attempts = 0;
+  eff::atomically([&](const eff::tx& tx) {
+    attempts++;
+    int64_t v = tx.read(x);
+    if (attempts == 1) {
+      stage = 1;
+      while (stage.load() != 2) { }
+    }
+    tx.write(y, v + 1);
+  });
+  other.join();
+  std::cout << attempts << " " << y.peek() << " " << eff::stm_take_stats().aborts << std::endl;
+
+  // Output:
+  // 2 11 1
+}
+
+// -----
+// Retry
+// -----
+
+// A scheduler of lightweight threads, which puts a thread that waits
+// for a change back in the queue when it is woken up
+
+class Scheduler : public eff::flat_handler<void, eff::no_manage<eff::stm_await>> {
+public:
+  static void Run(const std::vector<std::function<void()>>& threads)
+  {
+    for (auto& f : threads) { ready.push_back(eff::wrap<Scheduler>(f)); }
+    while (!ready.empty()) { ready.pop_front().resume(); }
+  }
+private:
+  static eff::resumption_queue<void()> ready;
+  void handle_command(eff::stm_await, eff::resumption<void()> r) override
+  {
+    std::cout << "wait ";
+    eff::stm_on_change([r = std::move(r)]() mutable {
+      std::cout << "wake ";
+      ready.push_back(std::move(r));
+    });
+  }
+};
+
+eff::resumption_queue<void()> Scheduler::ready;
+
+void testRetry()
+{
+  eff::tvar pot(0), other(0);
+  Scheduler::Run({
+    [&](){
+      eff::atomically([&](const eff::tx& tx) {
+        int64_t n = tx.read(pot);
+        if (n == 0) { tx.retry(); }
+        tx.write(pot, n - 1);
+      });
+      std::cout << "got ";
+    },
+    [&](){
+      // Does not wake up the consumer
+      eff::atomically([&](const eff::tx& tx) { tx.write(other, 1); });
+      std::cout << "put ";
+      eff::atomically([&](const eff::tx& tx) { tx.write(pot, tx.read(pot) + 1); });
+    }
+  });
+  std::cout << pot.peek() << " " << eff::stm_take_stats().retries << std::endl;
+
+  // Output:
+  // wait put wake got 0 1
+}
+
+// --------------
+// Bank transfers
+// --------------
+
+void testBank()
+{
+  const int SYSTEM = 4, TRANSFERS = 5000, ACCOUNTS = 8;
+  std::vector<eff::tvar> accounts(ACCOUNTS);
+  for (auto& a : accounts) {
+    eff::atomically([&](const eff::tx& tx) { tx.write(a, 100); });
+  }
+  std::vector<std::thread> system;
+  for (int s = 0; s < SYSTEM; s++) {
+    system.emplace_back([&, s](){
+      for (int i = 0; i < TRANSFERS; i++) {
+        std::size_t from = (i * 7 + s) % ACCOUNTS, to = (i * 3 + s + 1) % ACCOUNTS;
+        eff::atomically([&](const eff::tx& tx) {
+          int64_t balance = tx.read(accounts[from]);
+          if (from == to || balance == 0) { return; }
+          tx.write(accounts[from], balance - 1);
+          tx.write(accounts[to], tx.read(accounts[to]) + 1);
+        });
+      }
+      eff::stm_release_thread();
+    });
+  }
+  for (auto& t : system) { t.join(); }
+  int64_t total = 0;
+  for (auto& a : accounts) { total += a.peek(); }
+  std::cout << total << std::endl;
+
+  // Output:
+  // 800
+}
+
+int main()
+{
+  std::cout << "--- stm ---" << std::endl;
+  testTransactions();
+  testConflict();
+  testRetry();
+  testBank();
+  eff::stm_release_thread();
+}
+
@@ -0,0 +1,197 @@
+// C++ Effects library
+// Maciej Pirog, Huawei Edinburgh Research Centre, maciej.pirog@huawei.com
+// License: MIT
+
+// Test: Registry of suspended computations
+
+#include <iostream>
+#include <list>
+#include <thread>
+
+#include "cpp-effects/cpp-effects.h"
+#include "cpp-effects/clause-modifiers.h"
+#include "cpp-effects/prompts.h"
+
+namespace eff = cpp_effects;
+
+struct Yield : eff::command<> { };
+
+using Res = eff::resumption<void()>;
+
+class Scheduler : public eff::flat_handler<void, Yield> {
+public:
+  static std::list<Res> queue;
+private:
+  void handle_command(Yield, Res r) override
+  {
+    queue.push_back(std::move(r));
+  }
+};
+
+std::list<Res> Scheduler::queue;
+
+class Parker : public eff::flat_handler<void, eff::no_manage<Yield>> {
+public:
+  static std::list<Res> queue;
+private:
+  void handle_command(Yield, Res r) override
+  {
+    queue.push_back(std::move(r));
+  }
+};
+
+std::list<Res> Parker::queue;
+
+struct Summary {
+  int count = 0;
+  int schedulers = 0;
+  std::size_t frames = 0;
+  bool stacks = true;
+  bool ages = true;
+};
+
+Summary summary()
+{
+  Summary s;
+  eff::for_each_suspended([&](const eff::suspended_computation& c) {
+    s.count++;
+    if (*c.handler == typeid(Scheduler)) { s.schedulers++; }
+    s.frames += c.frames;
+    s.stacks = s.stacks && c.stack_size > 0;
+    s.ages = s.ages && c.age >= 0;
+  });
+  return s;
+}
+
+void print(const Summary& s)
+{
+  std::cout << s.count << " " << s.schedulers << " " << s.frames << " "
+            << (s.stacks ? "stacks" : "NO STACKS") << " " << (s.ages ? "ages" : "NO AGES") << std::endl;
+}
+
+// -----------------
+// Particular tests
+// -----------------
+
+void testDisabled()
+{
+  // Nothing is recorded when the registry is disabled
+  eff::handle<Scheduler>([](){ eff::invoke_command(Yield{}); });
+  print(summary());
+  Scheduler::queue.clear();
+
+  // Output:
+  // 0 0 0 stacks ages
+}
+
+void testCount()
+{
+  // Two computations captured by a scheduler (one with a nested
+  // handler), and one by a no_manage clause
+  eff::enable_suspended_registry();
+  eff::handle<Scheduler>([](){ eff::invoke_command(Yield{}); });
+  eff::handle<Scheduler>(100, [](){
+    eff::handle<Parker>([](){ eff::invoke_command(100, Yield{}); });
+  });
+  eff::handle<Parker>([](){ eff::invoke_command(Yield{}); });
+  print(summary());
+
+  // Resuming removes a computation from the registry
+  std::move(Scheduler::queue.front()).resume();
+  Scheduler::queue.pop_front();
+  print(summary());
+
+  // So does destroying it
+  Scheduler::queue.clear();
+  Parker::queue.clear();
+  print(summary());
+  eff::enable_suspended_registry(false);
+
+  // Output:
+  // 3 2 4 stacks ages
+  // 2 1 3 stacks ages
+  // 0 0 0 stacks ages
+}
+
+void testResuspend()
+{
+  // A computation that is resumed and captured again is registered again
+  eff::enable_suspended_registry();
+  eff::handle<Scheduler>([](){
+    for (int i = 0; i < 3; i++) { eff::invoke_command(Yield{}); }
+  });
+  while (!Scheduler::queue.empty()) {
+    print(summary());
+    auto r = std::move(Scheduler::queue.front());
+    Scheduler::queue.pop_front();
+    std::move(r).resume();
+  }
+  print(summary());
+  eff::enable_suspended_registry(false);
+
+  // Output:
+  // 1 1 1 stacks ages
+  // 1 1 1 stacks ages
+  // 1 1 1 stacks ages
+  // 0 0 0 stacks ages
+}
+
+void testPrompt()
+{
+  // Subcontinuations are registered too
+  eff::enable_suspended_registry();
+  auto p = eff::new_prompt<int>();
+  eff::resumption<int(int)> k;
+  eff::push_prompt(p, [&](){
+    return eff::take_subcont<int>(p, [&](auto sk) { k = std::move(sk); return 0; });
+  });
+  print(summary());
+  std::move(k).resume(1);
+  print(summary());
+  eff::enable_suspended_registry(false);
+
+  // Output:
+  // 1 0 1 stacks ages
+  // 0 0 0 stacks ages
+}
+
+void testThreads()
+{
+  // A computation resumed or destroyed in another thread is removed
+  // from the registry of the thread that captured it
+  eff::enable_suspended_registry();
+  eff::handle<Scheduler>([](){ eff::invoke_command(Yield{}); });
+  eff::handle<Scheduler>([](){ eff::invoke_command(Yield{}); });
+  print(summary());
+  std::thread([](){
+    print(summary());
+    std::move(Scheduler::queue.front()).resume();
+    Scheduler::queue.pop_front();
+  }).join();
+  print(summary());
+  std::thread([](){ Scheduler::queue.clear(); }).join();
+  print(summary());
+
+  // The registry of a thread outlives the thread
+  std::thread([](){ eff::handle<Scheduler>([](){ eff::invoke_command(Yield{}); }); }).join();
+  print(summary());
+  Scheduler::queue.clear();
+  eff::enable_suspended_registry(false);
+
+  // Output:
+  // 2 2 2 stacks ages
+  // 0 0 0 stacks ages
+  // 1 1 1 stacks ages
+  // 0 0 0 stacks ages
+  // 0 0 0 stacks ages
+}
+
+int main()
+{
+  std::cout << "--- suspended-registry ---" << std::endl;
+  testDisabled();
+  testCount();
+  testResuspend();
+  testPrompt();
+  testThreads();
+}
@@ -0,0 +1,75 @@
+// C++ Effects library
+// Maciej Pirog, Huawei Edinburgh Research Centre, maciej.pirog@huawei.com
+// License: MIT
+
+// Test: Every thread has its own metastack, so threads can use
+// handlers independently
+
+#include <functional>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "cpp-effects/cpp-effects.h"
+
+namespace eff = cpp_effects;
+
+struct Get : eff::command<int64_t> { };
+
+struct Put : eff::command<> {
+  int64_t val;
+};
+
+// State with a context switch on every command, so that the threads
+// interleave while their computations are suspended
+
+template <typename Answer>
+class State : public eff::flat_handler<Answer, Get, Put> {
+public:
+  State(int64_t init) : state(init) { }
+private:
+  int64_t state;
+  Answer handle_command(Get, eff::resumption<Answer(int64_t)> r) override
+  {
+    return std::move(r).tail_resume(state);
+  }
+  Answer handle_command(Put p, eff::resumption<Answer()> r) override
+  {
+    state = p.val;
+    return std::move(r).tail_resume();
+  }
+};
+
+// The thread k adds k to the state n times in n nested handlers, and
+// returns the value of the outermost state
+
+int64_t count(int64_t k, int64_t n)
+{
+  std::function<int64_t(int64_t)> nest = [&](int64_t depth) -> int64_t {
+    if (depth == 0) {
+      for (int64_t i = 0; i < n; i++) {
+        eff::invoke_command(n, Put{{}, eff::invoke_command(n, Get{}) + k});
+      }
+      return eff::invoke_command(n, Get{});
+    }
+    return eff::handle<State<int64_t>>(depth, std::bind(nest, depth - 1), 0);
+  };
+  return nest(n);
+}
+
+int main()
+{
+  std::cout << "--- thread-metastack ---" << std::endl;
+
+  std::vector<int64_t> results(4);
+  std::vector<std::thread> threads;
+  for (int k = 0; k < 4; k++) {
+    threads.emplace_back([&results, k](){ results[k] = count(k, 1000); });
+  }
+  for (auto& t : threads) { t.join(); }
+  for (auto r : results) { std::cout << r << " "; }
+  std::cout << std::endl;
+
+  // Output:
+  // 0 1000 2000 3000
+}
@@ -0,0 +1,126 @@
+// C++ Effects library
+// Maciej Pirog, Huawei Edinburgh Research Centre, maciej.pirog@huawei.com
+// License: MIT
+
+// Test: Request handlers in lightweight threads over a Unix domain
+// socket
+
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <system_error>
+#include <string>
+#include <thread>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "cpp-effects/cpp-effects.h"
+#include "cpp-effects/unix-server.h"
+
+namespace eff = cpp_effects;
+
+// Every line is answered with its length. The request "COUNT" is
+// answered with the number of lines so far, after all the previous
+// responses were flushed, and "BIG" with 1MB of dots.
+
+void handler(eff::connection& conn)
+{
+  int lines = 0;
+  while (auto line = conn.read_line()) {
+    if (*line == "COUNT") {
+      conn.write(std::to_string(lines) + "\n");
+      conn.flush();
+    } else if (*line == "BIG") {
+      conn.write(std::string(1024 * 1024, '.'));
+      conn.flush();
+    } else {
+      lines++;
+      conn.write(std::to_string(line->size()) + " ");
+    }
+  }
+  conn.write("end");  // Flushed when the handler returns
+}
+
+// A client that sends the request in pieces (so that the handler
+// suspends in the middle of a line), and reads the responses until the
+// server closes the connection
+
+std::string request(const std::string& path, const std::string& text)
+{
+  int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  sockaddr_un addr{};
+  addr.sun_family = AF_UNIX;
+  std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+  if (::connect(fd, (sockaddr*)&addr, sizeof(addr)) != 0) { return "connect failed"; }
+  for (std::size_t i = 0; i < text.size(); i += 3) {
+    if (::write(fd, text.data() + i, std::min<std::size_t>(3, text.size() - i)) < 0) { break; }
+    std::this_thread::sleep_for(std::chrono::microseconds(100));
+  }
+  ::shutdown(fd, SHUT_WR);
+  std::string response;
+  char buffer[256];
+  ssize_t n;
+  while ((n = ::read(fd, buffer, sizeof(buffer))) > 0) { response.append(buffer, n); }
+  ::close(fd);
+  return response;
+}
+
+// A client that disconnects without reading the response
+
+void disconnect(const std::string& path, const std::string& text)
+{
+  int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  sockaddr_un addr{};
+  addr.sun_family = AF_UNIX;
+  std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+  if (::connect(fd, (sockaddr*)&addr, sizeof(addr)) == 0) {
+    [[maybe_unused]] ssize_t n = ::write(fd, text.data(), text.size());
+  }
+  ::close(fd);
+}
+
+int main()
+{
+  std::cout << "--- unix-server ---" << std::endl;
+
+  // A path that does not fit in a socket address
+  try {
+    eff::unix_server tooLong("/tmp/" + std::string(200, 'x'));
+  } catch (const std::system_error& e) {
+    std::cout << "too long: " << (e.code().value() == ENAMETOOLONG) << std::endl;
+  }
+
+  std::string path = "/tmp/cpp-effects-test-unix-server-" + std::to_string(::getpid()) + ".sock";
+  eff::unix_server server(path);
+  std::thread serverThread([&](){ server.serve(2, handler); });
+
+  // Two clients at the same time
+  std::string a, b;
+  std::thread clientA([&](){ a = request(path, "hello\nworld!\nCOUNT\nx\n"); });
+  std::thread clientB([&](){ b = request(path, "effects\nCOUNT\n"); });
+  clientA.join();
+  clientB.join();
+  std::cout << a << std::endl;
+  std::cout << b << std::endl;
+
+  // Clients that disconnect before their responses are written do not
+  // bring the server down
+  for (int i = 0; i < 4; i++) { disconnect(path, "BIG\nBIG\n"); }
+  std::cout << request(path, "still\nthere\n") << std::endl;
+
+  server.stop();
+  serverThread.join();
+  std::cout << "stopped" << std::endl;
+}
+
+// Output:
+// --- unix-server ---
+// too long: 1
+// 5 6 2
+// 1 end
+// 7 1
+// end
+// 5 5 end
+// stopped